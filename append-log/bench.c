@@ -0,0 +1,207 @@
+#include "uv_append_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Durable records/s of the group commit log against one write and one
+ * fsync per record.
+ *
+ *   bench.o [-m group|fsync] [-f FILE] [-c CLIENTS] [-n RECORDS] [-s SIZE]
+ *
+ * Every client keeps one record in flight and submits the next one from
+ * the callback of the previous, like a request handler waiting for its
+ * commit. FILE is truncated first and removed afterwards; place it on the
+ * disk to be measured, tmpfs makes syncs free.
+ */
+
+#define MAX_CLIENTS 4096
+
+typedef struct {
+    uv_append_req_t req; // group
+    uv_fs_t fs_req; // fsync
+    int64_t offset;
+    uint64_t start;
+} client_t;
+
+uv_loop_t* loop;
+const char* path = "bench.log";
+int fsync_mode = 0;
+int clients = 64;
+int64_t records = 20000;
+size_t size = 256;
+
+client_t client_list[MAX_CLIENTS];
+char* payload;
+int64_t submitted;
+int64_t completed;
+int64_t failures;
+uint64_t* latencies;
+
+uv_append_log_t append_log;
+uv_file fd;
+int64_t tail;
+
+/////////////////////////////////////////////////////////////////////
+// group commit
+
+void append_cb(uv_append_req_t* req, int status);
+
+void append_next(client_t* client) {
+    if (submitted >= records)
+        return;
+    submitted++;
+    client->start = uv_hrtime();
+    if (uv_append_log_write(&append_log, &client->req, payload, size, append_cb)) {
+        failures++;
+        completed++;
+    }
+}
+
+void append_cb(uv_append_req_t* req, int status) {
+    client_t* client = (client_t*) req->data;
+
+    latencies[completed++] = uv_hrtime() - client->start;
+    if (status)
+        failures++;
+    append_next(client);
+}
+
+/////////////////////////////////////////////////////////////////////
+// write + fsync per record
+
+void fsync_next(client_t* client);
+
+void fsync_cb(uv_fs_t* req) {
+    client_t* client = (client_t*) req->data;
+
+    if (req->result < 0)
+        failures++;
+    uv_fs_req_cleanup(req);
+    latencies[completed++] = uv_hrtime() - client->start;
+    fsync_next(client);
+}
+
+void write_cb(uv_fs_t* req) {
+    client_t* client = (client_t*) req->data;
+    int result = req->result;
+
+    uv_fs_req_cleanup(req);
+    if (result != (int) size) {
+        failures++;
+        latencies[completed++] = uv_hrtime() - client->start;
+        fsync_next(client);
+        return;
+    }
+    uv_fs_fsync(loop, req, fd, fsync_cb);
+}
+
+void fsync_next(client_t* client) {
+    if (submitted >= records)
+        return;
+    submitted++;
+    client->start = uv_hrtime();
+    client->offset = tail;
+    tail += size;
+    uv_fs_write(loop, &client->fs_req, fd, payload, size, client->offset, write_cb);
+}
+
+/////////////////////////////////////////////////////////////////////
+
+int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+void close_cb(uv_append_log_t* log) {
+}
+
+void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-m group|fsync] [-f file] [-c clients] "
+            "[-n records] [-s size]\n", name);
+}
+
+int main(int argc, char** argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "m:f:c:n:s:")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (!strcmp(optarg, "group")) fsync_mode = 0;
+                else if (!strcmp(optarg, "fsync")) fsync_mode = 1;
+                else { usage(argv[0]); return 1; }
+                break;
+            case 'f': path = optarg; break;
+            case 'c': clients = atoi(optarg); break;
+            case 'n': records = atoll(optarg); break;
+            case 's': size = strtoul(optarg, NULL, 10); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (clients < 1 || clients > MAX_CLIENTS || records < 1 || size < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    loop = uv_default_loop();
+    payload = (char*) malloc(size);
+    memset(payload, 'r', size - 1);
+    payload[size - 1] = '\n';
+    latencies = (uint64_t*) calloc(records, sizeof(*latencies));
+
+    unlink(path);
+    if (fsync_mode) {
+        uv_fs_t req;
+        fd = uv_fs_open(loop, &req, path, O_WRONLY | O_CREAT, 0644, NULL);
+        uv_fs_req_cleanup(&req);
+        if (fd < 0) {
+            perror(path);
+            return 1;
+        }
+    } else if (uv_append_log_open(loop, &append_log, path)) {
+        perror(path);
+        return 1;
+    }
+
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < clients; ++i) {
+        client_list[i].req.data = &client_list[i];
+        client_list[i].fs_req.data = &client_list[i];
+        if (fsync_mode)
+            fsync_next(&client_list[i]);
+        else
+            append_next(&client_list[i]);
+    }
+    uv_run(loop, UV_RUN_DEFAULT);
+    double elapsed = (uv_hrtime() - start) / 1e9;
+
+    uint64_t syncs = completed;
+    if (fsync_mode) {
+        uv_fs_t req;
+        uv_fs_close(loop, &req, fd, NULL);
+        uv_fs_req_cleanup(&req);
+    } else {
+        syncs = append_log.batches;
+        uv_append_log_close(&append_log, close_cb);
+        uv_run(loop, UV_RUN_DEFAULT);
+    }
+    unlink(path);
+
+    qsort(latencies, completed, sizeof(*latencies), compare_u64);
+    printf("mode=%s clients=%d size=%zu records=%lld failures=%lld "
+            "records/s=%.0f MB/s=%.2f records/sync=%.1f "
+            "p50_ms=%.3f p99_ms=%.3f max_ms=%.3f\n",
+            fsync_mode ? "fsync" : "group", clients, size,
+            (long long) completed, (long long) failures,
+            completed / elapsed, completed * size / elapsed / (1024 * 1024),
+            syncs ? (double) completed / syncs : 0.0,
+            latencies[completed / 2] / 1e6,
+            latencies[(completed - 1) * 99 / 100] / 1e6,
+            latencies[completed - 1] / 1e6);
+
+    free(latencies);
+    free(payload);
+    return failures != 0;
+}
@@ -0,0 +1,210 @@
+#include "uv_append_log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+#define INITIAL_BATCH_SIZE (64 * 1024)
+
+static void start_batch(uv_append_log_t* log);
+
+static void fail_reqs(uv_append_batch_t* batch) {
+    while (!QUEUE_EMPTY(&batch->reqs)) {
+        QUEUE* q = QUEUE_HEAD(&batch->reqs);
+        uv_append_req_t* req = QUEUE_DATA(q, uv_append_req_t, queue);
+
+        QUEUE_REMOVE(q);
+        req->cb(req, -1);
+    }
+    batch->len = 0;
+}
+
+/**
+ * Reports the batch in flight and starts the next one.
+ */
+static void batch_done(uv_append_log_t* log, int status) {
+    uv_append_batch_t* batch = log->writing;
+
+    /* still busy while the callbacks run, records they submit gather in
+     * the pending batch */
+    if (status) {
+        /* the file end is unknown now, offsets handed out for pending
+         * records are wrong, so they fail as well */
+        log->failed = 1;
+        fail_reqs(batch);
+        fail_reqs(log->pending);
+    } else {
+        log->size += batch->len;
+        log->batches++;
+        while (!QUEUE_EMPTY(&batch->reqs)) {
+            QUEUE* q = QUEUE_HEAD(&batch->reqs);
+            uv_append_req_t* req = QUEUE_DATA(q, uv_append_req_t, queue);
+
+            QUEUE_REMOVE(q);
+            log->records++;
+            req->cb(req, 0);
+        }
+        batch->len = 0;
+    }
+
+    log->busy = 0;
+    start_batch(log);
+}
+
+static void sync_cb(uv_fs_t* req) {
+    uv_append_log_t* log = (uv_append_log_t*) req->data;
+    int result = req->result;
+
+    uv_fs_req_cleanup(req);
+    batch_done(log, result < 0 ? -1 : 0);
+}
+
+static void write_cb(uv_fs_t* req);
+
+static void write_rest(uv_append_log_t* log) {
+    uv_append_batch_t* batch = log->writing;
+
+    if (uv_fs_write(log->loop, &log->fs_req, log->fd,
+                batch->base + log->written, batch->len - log->written,
+                log->write_offset + log->written, write_cb)) {
+        batch_done(log, -1);
+    }
+}
+
+static void write_cb(uv_fs_t* req) {
+    uv_append_log_t* log = (uv_append_log_t*) req->data;
+    int result = req->result;
+
+    uv_fs_req_cleanup(req);
+    if (result < 0) {
+        batch_done(log, -1);
+        return;
+    }
+
+    log->written += result;
+    if (log->written < log->writing->len) {
+        write_rest(log);
+        return;
+    }
+
+    /* one sync for every record in the batch */
+    if (uv_fs_fdatasync(log->loop, &log->fs_req, log->fd, sync_cb))
+        batch_done(log, -1);
+}
+
+static void close_file(uv_append_log_t* log) {
+    uv_fs_t req;
+
+    uv_fs_close(log->loop, &req, log->fd, NULL);
+    uv_fs_req_cleanup(&req);
+    free(log->buffers[0].base);
+    free(log->buffers[1].base);
+    log->close_cb(log);
+}
+
+/**
+ * Swaps the buffers and writes what gathered, unless a batch is in
+ * flight already.
+ */
+static void start_batch(uv_append_log_t* log) {
+    if (log->busy)
+        return;
+
+    if (log->pending->len == 0) {
+        if (log->close_cb != NULL)
+            close_file(log);
+        return;
+    }
+
+    uv_append_batch_t* batch = log->pending;
+    log->pending = log->writing;
+    log->writing = batch;
+
+    log->busy = 1;
+    log->write_offset = log->size;
+    log->written = 0;
+    write_rest(log);
+}
+
+int uv_append_log_open(uv_loop_t* loop, uv_append_log_t* log, const char* path) {
+    uv_fs_t req;
+    int fd;
+
+    if (log == NULL || path == NULL) {
+        return 1;
+    }
+
+    fd = uv_fs_open(loop, &req, path, O_WRONLY | O_CREAT, 0644, NULL);
+    uv_fs_req_cleanup(&req);
+    if (fd < 0) {
+        return 2;
+    }
+
+    if (uv_fs_fstat(loop, &req, fd, NULL)) {
+        uv_fs_req_cleanup(&req);
+        uv_fs_close(loop, &req, fd, NULL);
+        uv_fs_req_cleanup(&req);
+        return 3;
+    }
+    log->size = ((uv_statbuf_t*) req.ptr)->st_size;
+    uv_fs_req_cleanup(&req);
+
+    log->loop = loop;
+    log->fd = fd;
+    log->fs_req.data = log;
+    log->tail = log->size;
+    log->records = 0;
+    log->batches = 0;
+    log->busy = 0;
+    log->failed = 0;
+    log->close_cb = NULL;
+    for (int i = 0; i < 2; ++i) {
+        log->buffers[i].base = NULL;
+        log->buffers[i].len = 0;
+        log->buffers[i].size = 0;
+        QUEUE_INIT(&log->buffers[i].reqs);
+    }
+    log->pending = &log->buffers[0];
+    log->writing = &log->buffers[1];
+
+    return 0;
+}
+
+int uv_append_log_write(uv_append_log_t* log, uv_append_req_t* req,
+        const char* data, size_t len, uv_append_cb cb) {
+    uv_append_batch_t* batch = log->pending;
+
+    if (log->failed || log->close_cb != NULL) {
+        return 1;
+    }
+
+    if (batch->len + len > batch->size) {
+        size_t size = batch->size ? batch->size : INITIAL_BATCH_SIZE;
+        while (size < batch->len + len)
+            size *= 2;
+
+        char* base = (char*) realloc(batch->base, size);
+        if (base == NULL) {
+            return 2;
+        }
+        batch->base = base;
+        batch->size = size;
+    }
+
+    memcpy(batch->base + batch->len, data, len);
+    batch->len += len;
+
+    req->log = log;
+    req->cb = cb;
+    req->len = len;
+    req->offset = log->tail;
+    log->tail += len;
+    QUEUE_INSERT_TAIL(&batch->reqs, &req->queue);
+
+    start_batch(log);
+    return 0;
+}
+
+void uv_append_log_close(uv_append_log_t* log, uv_append_log_close_cb close_cb) {
+    log->close_cb = close_cb;
+    start_batch(log);
+}
@@ -0,0 +1,95 @@
+#ifndef UV_APPEND_LOG_H
+#define UV_APPEND_LOG_H
+
+#include "uv.h"
+#include "../internal/queue.h"
+
+/**
+ * Durable append-only log with group commit.
+ *
+ * Records are copied into a batch buffer on submit. While one batch is
+ * being written and synced, new records gather in the next one, so a
+ * single write and a single fdatasync cover everything that arrived in
+ * the meantime. Records are raw bytes, framing is up to the caller.
+ */
+
+typedef struct uv_append_log_s uv_append_log_t;
+typedef struct uv_append_req_s uv_append_req_t;
+
+/**
+ * Called once the record is on stable storage (status 0) or could not be
+ * written (status -1, the error is in uv_last_error(loop)).
+ */
+typedef void (*uv_append_cb)(uv_append_req_t* req, int status);
+
+/**
+ * Called after the log was closed.
+ */
+typedef void (*uv_append_log_close_cb)(uv_append_log_t* log);
+
+/**
+ * One batch buffer, records are appended back to back.
+ */
+typedef struct {
+    char* base;
+    size_t len;
+    size_t size; // allocated, kept between batches
+    QUEUE reqs; // uv_append_req_t in the buffer
+} uv_append_batch_t;
+
+struct uv_append_req_s {
+    /* public */
+    void* data;
+    int64_t offset; // file offset of the record, set on submit
+    size_t len;
+
+    // private
+    uv_append_log_t* log;
+    uv_append_cb cb;
+    QUEUE queue;
+};
+
+struct uv_append_log_s {
+    /* public */
+    void* data;
+    uv_loop_t* loop;
+    int64_t size; // durable bytes in the file
+    uint64_t records; // records made durable
+    uint64_t batches; // fdatasync calls
+
+    // private
+    uv_file fd;
+    uv_fs_t fs_req;
+    int64_t tail; // end offset of everything submitted
+    int64_t write_offset; // where the current batch goes
+    size_t written; // bytes of the current batch written so far
+    int busy; // a batch is being written or synced
+    int failed; // a write or sync failed, the file end is unknown
+    uv_append_batch_t buffers[2];
+    uv_append_batch_t* pending; // gathers new records
+    uv_append_batch_t* writing; // in flight
+    uv_append_log_close_cb close_cb;
+};
+
+/**
+ * Opens or creates path for appending. Blocks while opening.
+ * @return 0 if success
+ */
+int uv_append_log_open(uv_loop_t* loop, uv_append_log_t* log, const char* path);
+
+/**
+ * Copies len bytes of data to the end of the log. cb runs once they are
+ * durable. Records become durable in submit order.
+ * @param req Must stay valid until cb.
+ * @return 0 if success
+ */
+int uv_append_log_write(uv_append_log_t* log, uv_append_req_t* req,
+        const char* data, size_t len, uv_append_cb cb);
+
+/**
+ * Makes everything submitted durable, then closes the file.
+ * No records may be submitted afterwards.
+ */
+void uv_append_log_close(uv_append_log_t* log, uv_append_log_close_cb close_cb);
+
+#endif
@@ -0,0 +1,139 @@
+#include "uv_async_queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Cross-thread message rate and wakeup latency of uv_async_queue.
+ *
+ *   bench.o [MESSAGES]
+ *
+ * For 1 to 32 producer threads, MESSAGES nodes (default 2M) are first
+ * sent as fast as possible (throughput, latency is mostly queueing), then
+ * 2000 per producer with a 100 us pause between sends (wakeup latency).
+ * Latency is measured from uv_hrtime() before the send to the delivery
+ * callback, on every 16th message.
+ */
+
+#define SAMPLE_EVERY 16
+
+typedef struct {
+    uint64_t sent; // uv_hrtime() before the send
+    MPSCQ_NODE node;
+} message_t;
+
+typedef struct {
+    uv_thread_t thread;
+    uv_async_queue_t* aq;
+    message_t* messages;
+    size_t count;
+    unsigned gap_us; // pause between sends, 0 for none
+} producer_t;
+
+uv_loop_t* loop;
+
+volatile int go;
+
+size_t received;
+size_t expected;
+uint64_t* samples;
+size_t nsamples;
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+
+    return x < y ? -1 : x > y;
+}
+
+void producer_run(void* arg) {
+    producer_t* p = (producer_t*) arg;
+
+    while (!go)
+        ;
+
+    for (size_t i = 0; i < p->count; ++i) {
+        p->messages[i].sent = uv_hrtime();
+        uv_async_queue_send(p->aq, &p->messages[i].node);
+
+        if (p->gap_us)
+            usleep(p->gap_us);
+    }
+}
+
+void message_cb(uv_async_queue_t* aq, MPSCQ_NODE* node) {
+    message_t* m = MPSCQ_DATA(node, message_t, node);
+
+    if (received++ % SAMPLE_EVERY == 0)
+        samples[nsamples++] = uv_hrtime() - m->sent;
+
+    /* a producer may still be inside uv_async_send, close after the join */
+    if (received == expected)
+        uv_stop(loop);
+}
+
+static void run(const char* mode, message_t* messages, int nproducers,
+        size_t per_producer, unsigned gap_us) {
+    producer_t producers[32];
+    uv_async_queue_t aq;
+
+    received = 0;
+    nsamples = 0;
+    expected = per_producer * nproducers;
+    go = 0;
+
+    uv_async_queue_init(loop, &aq, message_cb);
+
+    for (int i = 0; i < nproducers; ++i) {
+        producers[i].aq = &aq;
+        producers[i].messages = messages + i * per_producer;
+        producers[i].count = per_producer;
+        producers[i].gap_us = gap_us;
+        uv_thread_create(&producers[i].thread, producer_run, &producers[i]);
+    }
+
+    uint64_t start = uv_hrtime();
+    go = 1;
+    uv_run(loop, UV_RUN_DEFAULT);
+    uint64_t elapsed = uv_hrtime() - start;
+
+    for (int i = 0; i < nproducers; ++i)
+        uv_thread_join(&producers[i].thread);
+
+    uv_async_queue_close(&aq, NULL);
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    qsort(samples, nsamples, sizeof(uint64_t), cmp_u64);
+    printf("%-6s producers=%-2d %10.0f msg/s %8.1f msg/wakeup "
+            "p50=%9.1f us p99=%9.1f us\n", mode, nproducers,
+            expected / (elapsed / 1e9),
+            (double) aq.messages / aq.wakeups,
+            samples[nsamples / 2] / 1e3,
+            samples[nsamples * 99 / 100] / 1e3);
+}
+
+int main(int argc, char** argv) {
+    size_t total = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+    size_t paced = 2000;
+
+    if (total < paced * 32)
+        total = paced * 32;
+
+    message_t* messages = malloc(sizeof(message_t) * total);
+
+    loop = uv_default_loop();
+    samples = malloc(sizeof(uint64_t) * (total / SAMPLE_EVERY + 1));
+
+    for (int nproducers = 1; nproducers <= 32; nproducers *= 2)
+        run("flood", messages, nproducers, total / nproducers, 0);
+
+    for (int nproducers = 1; nproducers <= 32; nproducers *= 2)
+        run("paced", messages, nproducers, paced, 100);
+
+    free(samples);
+    free(messages);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "uv_async_queue.h"
+
+/**
+ * Delivers what is still queued and closes the handle. Nodes delivered
+ * here can not start another close, closing is set already.
+ */
+static void finish_close(uv_async_queue_t* aq) {
+    MPSCQ_NODE* node;
+
+    while ((node = mpscq_pop(&aq->queue)) != NULL) {
+        aq->messages++;
+        aq->cb(aq, node);
+    }
+    uv_close((uv_handle_t*) &aq->async, aq->close_cb);
+}
+
+static void drain(uv_async_queue_t* aq, size_t max) {
+    MPSCQ_NODE* node;
+    size_t n = 0;
+
+    aq->draining = 1;
+    while (!aq->closing && n < max && (node = mpscq_pop(&aq->queue)) != NULL) {
+        n++;
+        aq->cb(aq, node);
+    }
+    aq->draining = 0;
+    aq->messages += n;
+
+    /* closed from the callback, the handle must not be sent to anymore */
+    if (aq->closing) {
+        finish_close(aq);
+        return;
+    }
+
+    /* more may be waiting, come back after the loop had its turn */
+    if (n == max)
+        uv_async_send(&aq->async);
+}
+
+static void async_cb(uv_async_t* handle, int status) {
+    uv_async_queue_t* aq = (uv_async_queue_t*) handle->data;
+
+    aq->wakeups++;
+    drain(aq, UV_ASYNC_QUEUE_MAX_BATCH);
+}
+
+int uv_async_queue_init(uv_loop_t* loop, uv_async_queue_t* aq,
+        uv_async_queue_cb cb) {
+    if (aq == NULL || cb == NULL) {
+        return 1;
+    }
+
+    mpscq_init(&aq->queue);
+    aq->wakeups = 0;
+    aq->messages = 0;
+    aq->cb = cb;
+    aq->draining = 0;
+    aq->closing = 0;
+    aq->close_cb = NULL;
+    aq->async.data = aq;
+
+    return uv_async_init(loop, &aq->async, async_cb);
+}
+
+void uv_async_queue_send(uv_async_queue_t* aq, MPSCQ_NODE* node) {
+    mpscq_push(&aq->queue, node);
+    uv_async_send(&aq->async);
+}
+
+void uv_async_queue_close(uv_async_queue_t* aq, uv_close_cb close_cb) {
+    if (aq->closing)
+        return;
+    aq->closing = 1;
+    aq->close_cb = close_cb;
+
+    /* from inside the callback, drain finishes once it returned */
+    if (!aq->draining)
+        finish_close(aq);
+}
@@ -0,0 +1,55 @@
+#ifndef UV_ASYNC_QUEUE_H
+#define UV_ASYNC_QUEUE_H
+
+#include "uv.h"
+#include "../internal/mpscq.h"
+
+/**
+ * Nodes handled per wakeup before yielding back to the loop.
+ */
+#define UV_ASYNC_QUEUE_MAX_BATCH 4096
+
+typedef struct uv_async_queue_s uv_async_queue_t;
+
+/**
+ * Called on the loop thread for every node, oldest first.
+ */
+typedef void (*uv_async_queue_cb)(uv_async_queue_t* aq, MPSCQ_NODE* node);
+
+struct uv_async_queue_s {
+    /* public */
+    void* data;
+    uint64_t wakeups; // async callbacks run
+    uint64_t messages; // nodes delivered
+
+    // private
+    uv_async_t async;
+    MPSCQ queue;
+    uv_async_queue_cb cb;
+    int draining; // inside cb
+    int closing;
+    uv_close_cb close_cb;
+};
+
+/**
+ * Must be called on the loop thread.
+ * @return 0 if success
+ */
+int uv_async_queue_init(uv_loop_t* loop, uv_async_queue_t* aq,
+        uv_async_queue_cb cb);
+
+/**
+ * Hands node to the loop thread. Safe from any thread, never blocks.
+ * Wakeups coalesce, one callback drains everything sent until then.
+ */
+void uv_async_queue_send(uv_async_queue_t* aq, MPSCQ_NODE* node);
+
+/**
+ * Delivers what is still queued, then closes the async handle.
+ * close_cb receives (uv_handle_t*) &aq->async, its data points to aq.
+ * Producers must have stopped sending. May be called from the node
+ * callback, the rest is delivered once that returned.
+ */
+void uv_async_queue_close(uv_async_queue_t* aq, uv_close_cb close_cb);
+
+#endif
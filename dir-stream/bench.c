@@ -0,0 +1,127 @@
+#include "uv_dir_stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Compares uv_fs_readdir (whole listing in one result) against
+ * uv_dir_stream (fixed-size batches).
+ *
+ *   bench.o create DIR N    creates DIR with N empty files
+ *   bench.o readdir DIR     lists DIR with uv_fs_readdir
+ *   bench.o stream DIR      lists DIR with uv_dir_stream
+ *
+ * Each listing prints one line: mode, entries, time to first entry,
+ * total time and peak RSS. Run each mode in its own process, ru_maxrss
+ * never goes down.
+ */
+
+uv_loop_t* loop;
+
+uint64_t start_time;
+uint64_t first_entry_time;
+size_t entries;
+
+uv_fs_t readdir_req;
+
+static long peak_rss_kb() {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void report(const char* mode) {
+    uint64_t end = uv_hrtime();
+
+    printf("%-8s entries=%-9llu first=%10.3f ms total=%10.3f ms rss=%ld KiB\n",
+            mode, (unsigned long long) entries,
+            (first_entry_time - start_time) / 1e6,
+            (end - start_time) / 1e6, peak_rss_kb());
+}
+
+static int create(const char* dir, long n) {
+    char path[4096];
+
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+        perror("mkdir");
+        return 1;
+    }
+
+    for (long i = 0; i < n; ++i) {
+        snprintf(path, sizeof(path), "%s/f%09ld", dir, i);
+        int fd = open(path, O_WRONLY | O_CREAT, 0644);
+
+        if (fd == -1) {
+            perror("open");
+            return 1;
+        }
+        close(fd);
+    }
+
+    return 0;
+}
+
+void readdir_cb(uv_fs_t* req) {
+    first_entry_time = uv_hrtime();
+
+    if (req->result == -1) {
+        fprintf(stderr, "Error at reading directory: %s.\n",
+                uv_strerror(uv_last_error(loop)));
+    } else {
+        entries = req->result;
+    }
+
+    uv_fs_req_cleanup(req);
+    report("readdir");
+}
+
+void batch_cb(uv_dir_stream_t* stream, int status,
+        const uv_dir_entry_t* batch, size_t nentries) {
+    if (status == -1) {
+        fprintf(stderr, "Error at reading directory: %s.\n",
+                strerror(stream->error));
+        return;
+    }
+
+    if (entries == 0 && nentries > 0)
+        first_entry_time = uv_hrtime();
+
+    entries += nentries;
+
+    if (nentries == 0)
+        report("stream");
+}
+
+int main(int argc, const char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s create DIR N | readdir DIR | stream DIR\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (!strcmp(argv[1], "create"))
+        return create(argv[2], argc > 3 ? atol(argv[3]) : 10000);
+
+    loop = uv_default_loop();
+    start_time = uv_hrtime();
+
+    if (!strcmp(argv[1], "readdir")) {
+        uv_fs_readdir(loop, &readdir_req, argv[2], 0, readdir_cb);
+    } else if (!strcmp(argv[1], "stream")) {
+        uv_dir_stream_t* stream = (uv_dir_stream_t*) malloc(sizeof(uv_dir_stream_t));
+
+        uv_dir_stream_start(stream, loop, argv[2], batch_cb);
+    } else {
+        fprintf(stderr, "Unknown mode %s.\n", argv[1]);
+        return 1;
+    }
+
+    return uv_run(loop, UV_RUN_DEFAULT);
+}
@@ -0,0 +1,49 @@
+#include "uv_dir_stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Shared reference to our event loop.
+ */
+uv_loop_t* loop;
+
+/**
+ * Prints every name of the batch, like `ls -f`.
+ */
+void batch_cb(uv_dir_stream_t* stream, int status,
+        const uv_dir_entry_t* entries, size_t nentries) {
+    if (status == -1) {
+        fprintf(stderr, "Error reading directory: %s.\n",
+                strerror(stream->error));
+        return;
+    }
+
+    for (size_t i = 0; i < nentries; ++i)
+        printf("%s\n", entries[i].name);
+
+    if (nentries == 0)
+        fprintf(stderr, "%llu entries\n", (unsigned long long) stream->total);
+}
+
+int main(int argc, const char** argv) {
+    loop = uv_default_loop();
+
+    /* the stream embeds its batch buffers, keep it off the stack */
+    uv_dir_stream_t* stream = (uv_dir_stream_t*) malloc(sizeof(uv_dir_stream_t));
+
+    int r = uv_dir_stream_start(stream, loop, argc > 1 ? argv[1] : ".",
+            batch_cb);
+
+    if (r) {
+        fprintf(stderr, "Error starting directory stream.\n");
+        return 1;
+    }
+
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    free(stream);
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include "uv_dir_stream.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+
+/**
+ * Layout returned by the getdents64 syscall.
+ */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+static void work_cb(uv_work_t* req);
+static void after_work_cb(uv_work_t* req, int status);
+
+static int is_dot(const char* name) {
+    return name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+static void close_dir(uv_dir_stream_t* stream) {
+#ifdef __linux__
+    if (stream->fd != -1)
+        close(stream->fd);
+#else
+    if (stream->dir != NULL)
+        closedir((DIR*) stream->dir);
+#endif
+    stream->fd = -1;
+    stream->dir = NULL;
+}
+
+#ifdef __linux__
+/**
+ * Parses entries out of buf, refilling it with getdents64 when drained.
+ */
+static void fill_batch(uv_dir_stream_t* stream) {
+    while (stream->nentries < UV_DIR_STREAM_BATCH) {
+        if (stream->buf_pos == stream->buf_len) {
+            /* entries of this batch still point into buf */
+            if (stream->nentries > 0)
+                return;
+
+            long n = syscall(SYS_getdents64, stream->fd, stream->buf,
+                    sizeof(stream->buf));
+
+            if (n < 0) {
+                stream->error = errno;
+                return;
+            }
+            if (n == 0) {
+                stream->eof = 1;
+                return;
+            }
+            stream->buf_pos = 0;
+            stream->buf_len = (size_t) n;
+        }
+
+        struct linux_dirent64* d =
+            (struct linux_dirent64*) (stream->buf + stream->buf_pos);
+        stream->buf_pos += d->d_reclen;
+
+        if (is_dot(d->d_name))
+            continue;
+
+        uv_dir_entry_t* e = &stream->entries[stream->nentries++];
+        e->name = d->d_name;
+        e->ino = d->d_ino;
+        e->type = d->d_type;
+    }
+}
+#else
+/**
+ * Portable fallback: copies readdir() names into buf.
+ */
+static void fill_batch(uv_dir_stream_t* stream) {
+    stream->buf_len = 0;
+
+    /* stop while there is room for any name so no entry is lost */
+    while (stream->nentries < UV_DIR_STREAM_BATCH &&
+            stream->buf_len + NAME_MAX + 1 <= sizeof(stream->buf)) {
+        errno = 0;
+        struct dirent* d = readdir((DIR*) stream->dir);
+
+        if (d == NULL) {
+            if (errno)
+                stream->error = errno;
+            else
+                stream->eof = 1;
+            return;
+        }
+        if (is_dot(d->d_name))
+            continue;
+
+        size_t len = strlen(d->d_name) + 1;
+        uv_dir_entry_t* e = &stream->entries[stream->nentries++];
+        memcpy(stream->buf + stream->buf_len, d->d_name, len);
+        e->name = stream->buf + stream->buf_len;
+        e->ino = d->d_ino;
+        e->type = d->d_type;
+        stream->buf_len += len;
+    }
+}
+#endif
+
+/**
+ * Runs in the threadpool: opens the directory on first use and
+ * reads one batch.
+ */
+static void work_cb(uv_work_t* req) {
+    uv_dir_stream_t* stream = (uv_dir_stream_t*) req->data;
+
+    stream->nentries = 0;
+
+#ifdef __linux__
+    if (stream->fd == -1) {
+        stream->fd = open(stream->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (stream->fd == -1) {
+            stream->error = errno;
+            return;
+        }
+    }
+#else
+    if (stream->dir == NULL) {
+        stream->dir = opendir(stream->path);
+        if (stream->dir == NULL) {
+            stream->error = errno;
+            return;
+        }
+    }
+#endif
+
+    if (!stream->stopped)
+        fill_batch(stream);
+
+    if (stream->eof || stream->error || stream->stopped)
+        close_dir(stream);
+}
+
+static void after_work_cb(uv_work_t* req, int status) {
+    uv_dir_stream_t* stream = (uv_dir_stream_t*) req->data;
+    int done = stream->eof || stream->error || stream->stopped;
+
+    if (stream->error) {
+        stream->cb(stream, -1, NULL, 0);
+    } else if (stream->nentries > 0 || done) {
+        stream->total += stream->nentries;
+        stream->cb(stream, 0, stream->entries, stream->nentries);
+    }
+
+    if (done) {
+        free(stream->path);
+        stream->path = NULL;
+        return;
+    }
+
+    /* the callback may have stopped us, the next round closes the dir */
+    if (uv_queue_work(stream->loop, &stream->work, work_cb, after_work_cb)) {
+        close_dir(stream);
+        stream->cb(stream, -1, NULL, 0);
+        free(stream->path);
+        stream->path = NULL;
+    }
+}
+
+int uv_dir_stream_start(uv_dir_stream_t* stream, uv_loop_t* loop,
+        const char* path, uv_dir_stream_cb cb) {
+    if (stream == NULL || path == NULL || cb == NULL) {
+        return 1;
+    }
+
+    stream->loop = loop;
+    stream->error = 0;
+    stream->total = 0;
+    stream->cb = cb;
+    stream->path = strdup(path);
+    stream->fd = -1;
+    stream->dir = NULL;
+    stream->eof = 0;
+    stream->stopped = 0;
+    stream->buf_pos = 0;
+    stream->buf_len = 0;
+    stream->nentries = 0;
+    stream->work.data = stream;
+
+    if (stream->path == NULL) {
+        return 2;
+    }
+
+    return uv_queue_work(loop, &stream->work, work_cb, after_work_cb);
+}
+
+void uv_dir_stream_stop(uv_dir_stream_t* stream) {
+    stream->stopped = 1;
+}
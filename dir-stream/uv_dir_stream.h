@@ -0,0 +1,72 @@
+#ifndef UV_DIR_STREAM_H
+#define UV_DIR_STREAM_H
+
+#include "uv.h"
+
+/**
+ * Maximum number of entries handed to the callback at once.
+ */
+#define UV_DIR_STREAM_BATCH 1024
+
+/**
+ * Size of the raw getdents64 buffer kept per stream.
+ */
+#define UV_DIR_STREAM_BUF_SIZE (64 * 1024)
+
+/**
+ * A directory entry. name is only valid inside the callback.
+ */
+typedef struct {
+    const char* name;
+    uint64_t ino;
+    unsigned char type; // DT_* value, DT_UNKNOWN if the fs does not tell
+} uv_dir_entry_t;
+
+typedef struct uv_dir_stream_s uv_dir_stream_t;
+
+/**
+ * Called for every batch. nentries == 0 means the directory is exhausted.
+ * On error status is -1 and stream->error holds the errno value.
+ */
+typedef void (*uv_dir_stream_cb)(uv_dir_stream_t* stream, int status,
+        const uv_dir_entry_t* entries, size_t nentries);
+
+struct uv_dir_stream_s {
+    /* public */
+    void* data;
+    uv_loop_t* loop;
+    int error; // errno of the failed call
+    size_t total; // number of entries delivered so far
+
+    // private
+    uv_work_t work;
+    uv_dir_stream_cb cb;
+    char* path;
+    int fd;
+    void* dir; // DIR* where getdents64 is not available
+    int eof;
+    int stopped;
+    size_t buf_pos; // first unparsed byte in buf
+    size_t buf_len; // valid bytes in buf
+    size_t nentries;
+    uv_dir_entry_t entries[UV_DIR_STREAM_BATCH];
+    char buf[UV_DIR_STREAM_BUF_SIZE];
+};
+
+/**
+ * Opens path in the threadpool and starts delivering batches to cb.
+ * The next batch is read after cb returns, so memory use stays constant
+ * regardless of the directory size.
+ * @param stream Must be allocated in caller (it is ~90 KiB, prefer malloc).
+ * @return 0 if success
+ */
+int uv_dir_stream_start(uv_dir_stream_t* stream, uv_loop_t* loop,
+        const char* path, uv_dir_stream_cb cb);
+
+/**
+ * Stops reading after the current batch. May be called from cb.
+ * The directory is closed before the final cb with nentries == 0.
+ */
+void uv_dir_stream_stop(uv_dir_stream_t* stream);
+
+#endif
@@ -0,0 +1,165 @@
+#include "uv_resolver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+/**
+ * Exercises uv_resolver offline against localhost, the first name in
+ * /etc/hosts and a name under the reserved .invalid TLD.
+ */
+
+#define BURST 100
+
+uv_loop_t* loop;
+
+uv_resolver_t resolver;
+
+uv_resolver_req_t burst_reqs[BURST];
+uv_resolver_req_t req;
+
+uv_timer_t expire_timer;
+
+char hosts_name[256] = "localhost";
+
+int burst_left;
+
+void expire_cb(uv_timer_t* handle, int status);
+
+/**
+ * Reads the first host name of /etc/hosts.
+ */
+void read_hosts_name() {
+    char line[512];
+    FILE* f = fopen("/etc/hosts", "r");
+
+    if (f == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), f)) {
+        char addr[256];
+
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%255s %255s", addr, hosts_name) == 2)
+            break;
+    }
+    fclose(f);
+}
+
+void print_counters(const char* step) {
+    printf("%-10s hits=%llu stale=%llu negative=%llu misses=%llu "
+            "coalesced=%llu refreshes=%llu\n", step,
+            (unsigned long long) resolver.hits,
+            (unsigned long long) resolver.stale_hits,
+            (unsigned long long) resolver.negative_hits,
+            (unsigned long long) resolver.misses,
+            (unsigned long long) resolver.coalesced,
+            (unsigned long long) resolver.refreshes);
+}
+
+void print_cb(uv_resolver_req_t* r, int status, const struct addrinfo* res) {
+    char addr[64] = "";
+
+    if (status) {
+        printf("%-10s %s: %s\n", "resolved", (const char*) r->data,
+                uv_strerror(r->error));
+        return;
+    }
+
+    if (res->ai_family == AF_INET)
+        uv_inet_ntop(AF_INET, &((struct sockaddr_in*) res->ai_addr)->sin_addr,
+                addr, sizeof(addr));
+    else if (res->ai_family == AF_INET6)
+        uv_inet_ntop(AF_INET6,
+                &((struct sockaddr_in6*) res->ai_addr)->sin6_addr,
+                addr, sizeof(addr));
+
+    printf("%-10s %s -> %s\n", "resolved", (const char*) r->data, addr);
+}
+
+void negative_cb(uv_resolver_req_t* r, int status,
+        const struct addrinfo* res) {
+    print_cb(r, status, res);
+
+    /* second lookup of the failed name is a negative hit */
+    if (resolver.negative_hits == 0) {
+        uv_resolver_resolve(&resolver, &req, req.data, NULL, negative_cb);
+        return;
+    }
+    print_counters("negative");
+
+    /* let the positive answers expire */
+    uv_timer_start(&expire_timer, expire_cb, 150, 0);
+}
+
+void hosts_cb(uv_resolver_req_t* r, int status, const struct addrinfo* res) {
+    print_cb(r, status, res);
+
+    req.data = "does-not-exist.invalid";
+    uv_resolver_resolve(&resolver, &req, req.data, NULL, negative_cb);
+}
+
+void burst_cb(uv_resolver_req_t* r, int status, const struct addrinfo* res) {
+    if (r == &burst_reqs[0])
+        print_cb(r, status, res);
+
+    if (--burst_left)
+        return;
+
+    print_counters("burst");
+
+    /* cached now, this calls back right away */
+    req.data = "localhost";
+    uv_resolver_resolve(&resolver, &req, "localhost", "80", print_cb);
+    print_counters("hit");
+
+    req.data = hosts_name;
+    uv_resolver_resolve(&resolver, &req, hosts_name, NULL, hosts_cb);
+}
+
+void refreshed_cb(uv_timer_t* handle, int status) {
+    print_counters("refreshed");
+
+    uv_resolver_close(&resolver);
+    uv_close((uv_handle_t*) handle, NULL);
+}
+
+void expire_cb(uv_timer_t* handle, int status) {
+    /* expired but within stale_ms: served stale, refreshed in background */
+    req.data = "localhost";
+    uv_resolver_resolve(&resolver, &req, "localhost", "80", print_cb);
+    print_counters("stale");
+
+    uv_timer_start(handle, refreshed_cb, 100, 0);
+}
+
+int main() {
+    loop = uv_default_loop();
+
+    read_hosts_name();
+
+    /* short ttls so the demo sees expiry */
+    uv_resolver_init(&resolver, loop, 64, 100, 100, 5000);
+    uv_timer_init(loop, &expire_timer);
+
+    /* concurrent lookups of one name share one uv_getaddrinfo */
+    burst_left = BURST;
+    for (int i = 0; i < BURST; ++i) {
+        burst_reqs[i].data = "localhost";
+
+        int r = uv_resolver_resolve(&resolver, &burst_reqs[i], "localhost",
+                "80", burst_cb);
+
+        if (r) {
+            printf("Error at dns request: %s.\n",
+                    uv_strerror(uv_last_error(loop)));
+            return 1;
+        }
+    }
+
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    return 0;
+}
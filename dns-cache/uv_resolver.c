@@ -0,0 +1,295 @@
+#include "uv_resolver.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A cached (or pending) lookup of one node/service pair.
+ */
+typedef struct resolver_entry_s {
+    struct resolver_entry_s* next; // hash chain
+    uint32_t hash;
+    uv_resolver_t* resolver;
+    QUEUE lru_node;
+    QUEUE waiters; // uv_resolver_req_t waiting for req
+    uv_getaddrinfo_t req;
+    int pending; // req is in the threadpool
+    int resolved; // res/status hold an answer
+    int status;
+    uv_err_t error;
+    struct addrinfo* res;
+    uint64_t expires; // uv_now() deadline of the answer
+    const char* service; // points into key, NULL if none
+    size_t key_len;
+    char key[1]; // node '\0' service '\0'
+} resolver_entry_t;
+
+static uint32_t hash_key(const char* key, size_t len) {
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char) key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static resolver_entry_t** bucket_of(uv_resolver_t* resolver, uint32_t hash) {
+    return &resolver->buckets[hash & (resolver->nbuckets - 1)];
+}
+
+static void entry_free(resolver_entry_t* e) {
+    uv_resolver_t* resolver = e->resolver;
+    resolver_entry_t** p = bucket_of(resolver, e->hash);
+
+    while (*p != e)
+        p = &(*p)->next;
+    *p = e->next;
+
+    QUEUE_REMOVE(&e->lru_node);
+    resolver->nentries--;
+
+    if (e->res != NULL)
+        uv_freeaddrinfo(e->res);
+    free(e);
+}
+
+/**
+ * Evicts least recently used entries, pending ones are skipped.
+ */
+static void evict(uv_resolver_t* resolver) {
+    QUEUE* q = QUEUE_PREV(&resolver->lru);
+
+    while (resolver->nentries > resolver->max_entries && q != &resolver->lru) {
+        resolver_entry_t* e = QUEUE_DATA(q, resolver_entry_t, lru_node);
+
+        q = QUEUE_PREV(q);
+        if (e->pending)
+            continue;
+        entry_free(e);
+        resolver->evictions++;
+    }
+}
+
+static void free_entries(uv_resolver_t* resolver) {
+    while (!QUEUE_EMPTY(&resolver->lru)) {
+        QUEUE* q = QUEUE_HEAD(&resolver->lru);
+
+        entry_free(QUEUE_DATA(q, resolver_entry_t, lru_node));
+    }
+
+    free(resolver->buckets);
+    resolver->buckets = NULL;
+}
+
+static void getaddrinfo_cb(uv_getaddrinfo_t* req, int status,
+        struct addrinfo* res) {
+    resolver_entry_t* e = (resolver_entry_t*) req->data;
+    uv_resolver_t* resolver = e->resolver;
+    uv_err_t err = uv_last_error(resolver->loop);
+    QUEUE waiters;
+
+    resolver->pending--;
+    e->pending = 0;
+
+    if (status == 0 || !e->resolved || e->status != 0) {
+        /* keep the old positive answer if only a refresh failed */
+        if (e->res != NULL)
+            uv_freeaddrinfo(e->res);
+        e->res = status == 0 ? res : NULL;
+        e->status = status;
+        e->error = err;
+        e->resolved = 1;
+        e->expires = uv_now(resolver->loop) +
+            (status == 0 ? resolver->ttl_ms : resolver->negative_ttl_ms);
+    } else {
+        /* back off before the next refresh, the old answer stays */
+        e->expires = uv_now(resolver->loop) + resolver->negative_ttl_ms;
+        if (res != NULL)
+            uv_freeaddrinfo(res);
+    }
+
+    QUEUE_INIT(&waiters);
+    if (!QUEUE_EMPTY(&e->waiters)) {
+        QUEUE* first = QUEUE_HEAD(&e->waiters);
+
+        QUEUE_SPLIT(&e->waiters, first, &waiters);
+    }
+
+    /**
+     * nothing is evicted or freed before the last waiter ran, e->res
+     * stays valid even if a callback closes the resolver
+     */
+    resolver->dispatching++;
+    while (!QUEUE_EMPTY(&waiters)) {
+        QUEUE* q = QUEUE_HEAD(&waiters);
+        uv_resolver_req_t* r = QUEUE_DATA(q, uv_resolver_req_t, node);
+
+        QUEUE_REMOVE(q);
+        r->error = e->error;
+        r->cb(r, e->status, e->res);
+    }
+    resolver->dispatching--;
+
+    if (resolver->closing) {
+        if (resolver->dispatching == 0)
+            free_entries(resolver);
+        return;
+    }
+    evict(resolver);
+}
+
+static int start_lookup(resolver_entry_t* e) {
+    uv_resolver_t* resolver = e->resolver;
+
+    if (uv_getaddrinfo(resolver->loop, &e->req, getaddrinfo_cb, e->key,
+                e->service, &resolver->hints)) {
+        return -1;
+    }
+
+    e->pending = 1;
+    resolver->pending++;
+
+    return 0;
+}
+
+int uv_resolver_init(uv_resolver_t* resolver, uv_loop_t* loop,
+        size_t max_entries, uint64_t ttl_ms, uint64_t negative_ttl_ms,
+        uint64_t stale_ms) {
+    if (resolver == NULL || max_entries == 0) {
+        return 1;
+    }
+
+    memset(resolver, 0, sizeof(*resolver));
+    resolver->loop = loop;
+    resolver->max_entries = max_entries;
+    resolver->ttl_ms = ttl_ms;
+    resolver->negative_ttl_ms = negative_ttl_ms;
+    resolver->stale_ms = stale_ms;
+    resolver->hints.ai_family = AF_UNSPEC;
+    resolver->hints.ai_socktype = SOCK_STREAM;
+
+    resolver->nbuckets = 16;
+    while (resolver->nbuckets < max_entries)
+        resolver->nbuckets <<= 1;
+
+    resolver->buckets = calloc(resolver->nbuckets, sizeof(*resolver->buckets));
+    if (resolver->buckets == NULL) {
+        return 2;
+    }
+
+    QUEUE_INIT(&resolver->lru);
+
+    return 0;
+}
+
+int uv_resolver_resolve(uv_resolver_t* resolver, uv_resolver_req_t* req,
+        const char* node, const char* service, uv_resolver_cb cb) {
+    size_t node_len = strlen(node);
+    size_t service_len = service ? strlen(service) : 0;
+    size_t key_len = node_len + 1 + service_len;
+    char key[UV_RESOLVER_MAX_NODE + 1 + UV_RESOLVER_MAX_SERVICE + 1];
+    resolver_entry_t* e;
+    uint32_t hash;
+
+    if (resolver->closing || node_len > UV_RESOLVER_MAX_NODE ||
+            service_len > UV_RESOLVER_MAX_SERVICE) {
+        return -1;
+    }
+
+    /* build the key on the stack for the lookup */
+    memcpy(key, node, node_len + 1);
+    if (service)
+        memcpy(key + node_len + 1, service, service_len + 1);
+    else
+        key[key_len] = '\0';
+
+    hash = hash_key(key, key_len);
+    req->cb = cb;
+
+    for (e = *bucket_of(resolver, hash); e != NULL; e = e->next) {
+        if (e->hash == hash && e->key_len == key_len &&
+                !memcmp(e->key, key, key_len))
+            break;
+    }
+
+    if (e != NULL && e->resolved) {
+        uint64_t now = uv_now(resolver->loop);
+        int fresh = now < e->expires;
+        int stale_ok = e->status == 0 && now < e->expires + resolver->stale_ms;
+
+        if (fresh || stale_ok) {
+            QUEUE_REMOVE(&e->lru_node);
+            QUEUE_INSERT_HEAD(&resolver->lru, &e->lru_node);
+
+            if (!fresh) {
+                resolver->stale_hits++;
+                if (!e->pending && start_lookup(e) == 0)
+                    resolver->refreshes++;
+            } else if (e->status) {
+                resolver->negative_hits++;
+            } else {
+                resolver->hits++;
+            }
+
+            req->error = e->error;
+            cb(req, e->status, e->res);
+            return 0;
+        }
+    }
+
+    if (e != NULL && e->pending) {
+        resolver->coalesced++;
+        QUEUE_INSERT_TAIL(&e->waiters, &req->node);
+        return 0;
+    }
+
+    if (e == NULL) {
+        e = (resolver_entry_t*) malloc(sizeof(resolver_entry_t) + key_len);
+        if (e == NULL) {
+            return -1;
+        }
+
+        memcpy(e->key, key, key_len + 1);
+        e->key_len = key_len;
+        e->service = service ? e->key + node_len + 1 : NULL;
+        e->hash = hash;
+        e->resolver = resolver;
+        e->pending = 0;
+        e->resolved = 0;
+        e->status = 0;
+        e->res = NULL;
+        e->expires = 0;
+        e->req.data = e;
+        QUEUE_INIT(&e->waiters);
+        QUEUE_INSERT_HEAD(&resolver->lru, &e->lru_node);
+
+        e->next = *bucket_of(resolver, hash);
+        *bucket_of(resolver, hash) = e;
+        resolver->nentries++;
+    }
+
+    if (start_lookup(e)) {
+        if (!e->resolved)
+            entry_free(e);
+        return -1;
+    }
+
+    resolver->misses++;
+    QUEUE_INSERT_TAIL(&e->waiters, &req->node);
+
+    return 0;
+}
+
+int uv_resolver_close(uv_resolver_t* resolver) {
+    if (resolver->pending) {
+        return 1;
+    }
+
+    resolver->closing = 1;
+    /* getaddrinfo_cb frees them once its waiters ran */
+    if (resolver->dispatching == 0)
+        free_entries(resolver);
+
+    return 0;
+}
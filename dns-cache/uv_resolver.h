@@ -0,0 +1,95 @@
+#ifndef UV_RESOLVER_H
+#define UV_RESOLVER_H
+
+#include "uv.h"
+#include "../internal/queue.h"
+
+/**
+ * Longest node and service names uv_resolver_resolve accepts, a DNS name
+ * has at most 253 characters.
+ */
+#define UV_RESOLVER_MAX_NODE 255
+#define UV_RESOLVER_MAX_SERVICE 32
+
+typedef struct uv_resolver_s uv_resolver_t;
+typedef struct uv_resolver_req_s uv_resolver_req_t;
+
+/**
+ * res is owned by the resolver and only valid inside the callback.
+ * On error status is -1, res is NULL and req->error holds the reason.
+ */
+typedef void (*uv_resolver_cb)(uv_resolver_req_t* req, int status,
+        const struct addrinfo* res);
+
+struct uv_resolver_req_s {
+    /* public */
+    void* data;
+    uv_err_t error;
+
+    // private
+    QUEUE node; // in the waiters list of an entry
+    uv_resolver_cb cb;
+};
+
+struct uv_resolver_s {
+    /* public */
+    void* data;
+    uv_loop_t* loop;
+    struct addrinfo hints; // passed to every uv_getaddrinfo
+    uint64_t hits;
+    uint64_t stale_hits; // served while a background refresh runs
+    uint64_t negative_hits;
+    uint64_t misses; // misses that started a uv_getaddrinfo
+    uint64_t coalesced; // misses that joined a running uv_getaddrinfo
+    uint64_t refreshes;
+    uint64_t evictions;
+
+    // private
+    size_t max_entries;
+    size_t nentries;
+    uint64_t ttl_ms; // lifetime of successful lookups
+    uint64_t negative_ttl_ms; // lifetime of failed lookups
+    uint64_t stale_ms; // how long expired answers are served while refreshing
+    size_t nbuckets;
+    struct resolver_entry_s** buckets;
+    QUEUE lru; // most recently used first
+    int pending; // uv_getaddrinfo requests in flight
+    int dispatching; // getaddrinfo_cb is calling waiters
+    int closing; // uv_resolver_close ran in a waiter, free after dispatch
+};
+
+/**
+ * @param resolver Must be allocated in caller.
+ * @param max_entries Names kept before the least recently used is evicted.
+ * @param ttl_ms Lifetime of successful lookups.
+ * @param negative_ttl_ms Lifetime of failed lookups.
+ * @param stale_ms Once expired, answers are still served for this long
+ *                 while a refresh runs in the background.
+ * @return 0 if success
+ */
+int uv_resolver_init(uv_resolver_t* resolver, uv_loop_t* loop,
+        size_t max_entries, uint64_t ttl_ms, uint64_t negative_ttl_ms,
+        uint64_t stale_ms);
+
+/**
+ * Resolves node/service through the cache.
+ * On a hit cb is called before this function returns. On a miss one
+ * uv_getaddrinfo is started and every concurrent miss for the same
+ * name waits on it.
+ * @param service May be NULL.
+ * @return 0 if success, -1 if out of memory, node or service are longer
+ *         than UV_RESOLVER_MAX_NODE or UV_RESOLVER_MAX_SERVICE, or the
+ *         resolver is closing
+ */
+int uv_resolver_resolve(uv_resolver_t* resolver, uv_resolver_req_t* req,
+        const char* node, const char* service, uv_resolver_cb cb);
+
+/**
+ * Frees all entries. Must not be called while lookups are pending.
+ * Called from a waiter's callback, the entries are freed once the
+ * remaining waiters of that lookup ran.
+ * @return 0 if success
+ */
+int uv_resolver_close(uv_resolver_t* resolver);
+
+#endif
@@ -4,7 +4,7 @@
 
 uv_loop_t* loop;
 
-uv_getaddrinfo_t* handle;
+uv_getaddrinfo_t handle;
 
 void getaddrinfo_cb(uv_getaddrinfo_t* handle, int status, 
         struct addrinfo* response);
@@ -14,21 +14,33 @@ const char* name = "localhost";
 int main() {
     loop = uv_default_loop();
 
-    int r = uv_getaddrinfo(loop, handle, getaddrinfo_cb, name, "80", NULL);
+    handle.data = (void*) name;
+
+    int r = uv_getaddrinfo(loop, &handle, getaddrinfo_cb, name, "80", NULL);
 
     if (r) {
         printf("Error at dns request: %s.\n",
                 uv_strerror(uv_last_error(loop)));
+
+        return -1;
     }
 
+    uv_run(loop, UV_RUN_DEFAULT);
+
     return 0;
 }
 
 void getaddrinfo_cb(uv_getaddrinfo_t* handle, int status,
         struct addrinfo* response) {
 
-    printf("%s \n", handle->data);
+    if (status == -1) {
+        printf("Error at dns request: %s.\n",
+                uv_strerror(uv_last_error(loop)));
+
+        return;
+    }
+
+    printf("%s \n", (const char*) handle->data);
 
-    free(handle);
     uv_freeaddrinfo(response);
 }
@@ -0,0 +1,451 @@
+#include "uv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * Throughput and latency of the filesystem operations shown in this
+ * directory, run through the threadpool with a fixed number of requests
+ * in flight.
+ *
+ *   uv_fs_bench.o [-d DIR] [-c CONCURRENCY] [-n OPS] [-s SIZE] [-o OP,OP,...]
+ *
+ * Work happens in a scratch directory below DIR (default ./), so point it
+ * at tmpfs or at the disk you care about. Set UV_THREADPOOL_SIZE in the
+ * environment to size the threadpool, libuv reads it on first use.
+ *
+ * Only the named operation is timed. Operations which need a prepared
+ * file descriptor run an untimed companion request on the same slot:
+ * open is followed by a close, close is preceded by an open. Their ops/s
+ * is the rate of the pair, the percentiles are for the operation alone.
+ * unlink removes the files open created, rename and rmdir work on the
+ * directories mkdir created; those are run first when not selected.
+ */
+
+#define MAX_CONCURRENCY 256
+#define READDIR_ENTRIES 100
+
+typedef struct slot_s slot_t;
+typedef int (*issue_fn)(slot_t* slot);
+
+typedef struct {
+    const char* name;
+    issue_fn pre;  // untimed, before the timed request
+    issue_fn run;  // the timed request
+    issue_fn post; // untimed, after the timed request
+    int needs;     // bitmask of operations that must run before
+} op_t;
+
+struct slot_s {
+    uv_fs_t req;
+    int index;
+    int64_t k; // number of the current operation in the phase
+    uv_file fd; // file of this slot for read, write
+    uv_file tmp_fd; // companion descriptor for open, close
+    uint64_t start;
+    char* buf;
+};
+
+uv_loop_t* loop;
+const char* base_dir = "./";
+char scratch[1024];
+int concurrency = 16;
+int64_t ops = 10000;
+size_t size = 4096;
+
+slot_t slots[MAX_CONCURRENCY];
+const op_t* op;
+int64_t next_k;
+int64_t completed;
+int64_t errors;
+uint64_t* latencies;
+
+/////////////////////////////////////////////////////////////////////
+// paths
+
+void slot_file(char* path, int index) {
+    snprintf(path, 1024, "%s/f%d", scratch, index);
+}
+
+void numbered(char* path, const char* prefix, int64_t k) {
+    snprintf(path, 1024, "%s/%s%lld", scratch, prefix, (long long) k);
+}
+
+/////////////////////////////////////////////////////////////////////
+// operations
+
+void step_cb(uv_fs_t* req);
+void timed_cb(uv_fs_t* req);
+
+int pre_open(slot_t* slot) {
+    char path[1024];
+    slot_file(path, slot->index);
+    return uv_fs_open(loop, &slot->req, path, O_RDONLY, 0, step_cb);
+}
+
+int post_close(slot_t* slot) {
+    return uv_fs_close(loop, &slot->req, slot->tmp_fd, step_cb);
+}
+
+int run_open(slot_t* slot) {
+    char path[1024];
+    numbered(path, "o", slot->k);
+    return uv_fs_open(loop, &slot->req, path, O_WRONLY | O_CREAT, 0644, timed_cb);
+}
+
+int run_close(slot_t* slot) {
+    return uv_fs_close(loop, &slot->req, slot->tmp_fd, timed_cb);
+}
+
+int run_read(slot_t* slot) {
+    return uv_fs_read(loop, &slot->req, slot->fd, slot->buf, size, 0, timed_cb);
+}
+
+int run_write(slot_t* slot) {
+    return uv_fs_write(loop, &slot->req, slot->fd, slot->buf, size, 0, timed_cb);
+}
+
+int run_stat(slot_t* slot) {
+    char path[1024];
+    slot_file(path, slot->index);
+    return uv_fs_stat(loop, &slot->req, path, timed_cb);
+}
+
+int run_chown(slot_t* slot) {
+    char path[1024];
+    slot_file(path, slot->index);
+    // to the current owner, so this works without privileges
+    return uv_fs_chown(loop, &slot->req, path, getuid(), getgid(), timed_cb);
+}
+
+int run_readdir(slot_t* slot) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/list", scratch);
+    return uv_fs_readdir(loop, &slot->req, path, 0, timed_cb);
+}
+
+int run_unlink(slot_t* slot) {
+    char path[1024];
+    numbered(path, "o", slot->k);
+    return uv_fs_unlink(loop, &slot->req, path, timed_cb);
+}
+
+int run_mkdir(slot_t* slot) {
+    char path[1024];
+    numbered(path, "d", slot->k);
+    return uv_fs_mkdir(loop, &slot->req, path, 0755, timed_cb);
+}
+
+int run_rename(slot_t* slot) {
+    char path[1024], new_path[1024];
+    numbered(path, "d", slot->k);
+    numbered(new_path, "r", slot->k);
+    return uv_fs_rename(loop, &slot->req, path, new_path, timed_cb);
+}
+
+int run_rmdir(slot_t* slot) {
+    char path[1024];
+    numbered(path, "r", slot->k);
+    return uv_fs_rmdir(loop, &slot->req, path, timed_cb);
+}
+
+enum {
+    OP_WRITE, OP_READ, OP_STAT, OP_CHOWN, OP_READDIR, OP_OPEN, OP_CLOSE,
+    OP_UNLINK, OP_MKDIR, OP_RENAME, OP_RMDIR, OP_COUNT
+};
+
+/* in the order they run */
+const op_t operations[OP_COUNT] = {
+    { "write",   NULL,     run_write,   NULL,       0 },
+    { "read",    NULL,     run_read,    NULL,       0 },
+    { "stat",    NULL,     run_stat,    NULL,       0 },
+    { "chown",   NULL,     run_chown,   NULL,       0 },
+    { "readdir", NULL,     run_readdir, NULL,       0 },
+    { "open",    NULL,     run_open,    post_close, 0 },
+    { "close",   pre_open, run_close,   NULL,       0 },
+    { "unlink",  NULL,     run_unlink,  NULL,       1 << OP_OPEN },
+    { "mkdir",   NULL,     run_mkdir,   NULL,       0 },
+    { "rename",  NULL,     run_rename,  NULL,       1 << OP_MKDIR },
+    { "rmdir",   NULL,     run_rmdir,   NULL,       1 << OP_MKDIR | 1 << OP_RENAME },
+};
+
+/////////////////////////////////////////////////////////////////////
+// driver
+
+void fail(slot_t* slot, const char* what) {
+    if (errors++ == 0) {
+        fprintf(stderr, "%s %s: %s\n", op->name, what,
+                uv_strerror(uv_last_error(loop)));
+    }
+}
+
+/**
+ * Starts the next operation on a slot, or leaves it idle at the end.
+ */
+void next(slot_t* slot) {
+    if (next_k >= ops)
+        return;
+
+    slot->k = next_k++;
+    if (op->pre != NULL) {
+        if (op->pre(slot)) {
+            fail(slot, "prepare");
+            completed++;
+            next(slot);
+        }
+        return;
+    }
+
+    slot->start = uv_hrtime();
+    if (op->run(slot)) {
+        fail(slot, "request");
+        completed++;
+        slot->start = 0;
+        next(slot);
+    }
+}
+
+/**
+ * Completion of an untimed companion request.
+ */
+void step_cb(uv_fs_t* req) {
+    slot_t* slot = (slot_t*) req->data;
+    int result = req->result;
+
+    uv_fs_req_cleanup(req);
+
+    if (op->pre != NULL && slot->start == 0) {
+        // pre finished, start the timed request
+        if (result < 0) {
+            fail(slot, "prepare");
+            completed++;
+            next(slot);
+            return;
+        }
+        slot->tmp_fd = result;
+        slot->start = uv_hrtime();
+        if (op->run(slot)) {
+            fail(slot, "request");
+            completed++;
+            slot->start = 0;
+            next(slot);
+        }
+        return;
+    }
+
+    if (result < 0)
+        fail(slot, "cleanup");
+    completed++;
+    slot->start = 0;
+    next(slot);
+}
+
+/**
+ * Completion of the timed request.
+ */
+void timed_cb(uv_fs_t* req) {
+    slot_t* slot = (slot_t*) req->data;
+    int result = req->result;
+
+    latencies[slot->k] = uv_hrtime() - slot->start;
+    uv_fs_req_cleanup(req);
+
+    if (result < 0) {
+        fail(slot, "request");
+    } else if (op->post != NULL) {
+        slot->tmp_fd = result;
+        if (op->post(slot) == 0)
+            return;
+        fail(slot, "cleanup");
+    }
+
+    completed++;
+    slot->start = 0;
+    next(slot);
+}
+
+int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+double percentile_us(double p) {
+    int64_t i = (int64_t) (p * (ops - 1));
+    return latencies[i] / 1e3;
+}
+
+/**
+ * Runs one operation ops times, concurrency at a time.
+ */
+void run_phase(const op_t* phase, int report) {
+    op = phase;
+    next_k = 0;
+    completed = 0;
+    errors = 0;
+    memset(latencies, 0, ops * sizeof(*latencies));
+
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < concurrency; ++i) {
+        slots[i].start = 0;
+        next(&slots[i]);
+    }
+    uv_run(loop, UV_RUN_DEFAULT);
+    double elapsed = (uv_hrtime() - start) / 1e9;
+
+    if (!report)
+        return;
+
+    qsort(latencies, ops, sizeof(*latencies), compare_u64);
+    printf("%-8s %6d %8lld %12.0f %10.1f %10.1f %10.1f %10.1f %10.1f %8lld\n",
+            op->name, concurrency, (long long) ops, ops / elapsed,
+            percentile_us(0.5), percentile_us(0.9), percentile_us(0.99),
+            percentile_us(0.999), percentile_us(1.0), (long long) errors);
+}
+
+/////////////////////////////////////////////////////////////////////
+// scratch directory
+
+int setup() {
+    char path[1024];
+
+    snprintf(scratch, sizeof(scratch), "%s/uv_fs_bench.%d", base_dir, (int) getpid());
+    if (mkdir(scratch, 0755)) {
+        perror(scratch);
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/list", scratch);
+    mkdir(path, 0755);
+    for (int i = 0; i < READDIR_ENTRIES; ++i) {
+        snprintf(path, sizeof(path), "%s/list/e%d", scratch, i);
+        close(open(path, O_WRONLY | O_CREAT, 0644));
+    }
+
+    for (int i = 0; i < concurrency; ++i) {
+        slots[i].index = i;
+        slots[i].req.data = &slots[i];
+        slots[i].buf = (char*) malloc(size);
+        memset(slots[i].buf, 'x', size);
+
+        slot_file(path, i);
+        slots[i].fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (slots[i].fd == -1) {
+            perror(path);
+            return -1;
+        }
+        if (ftruncate(slots[i].fd, size)) {
+            perror(path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void cleanup() {
+    char path[1024];
+
+    for (int i = 0; i < concurrency; ++i) {
+        if (slots[i].buf == NULL)
+            continue;
+        close(slots[i].fd);
+        slot_file(path, i);
+        unlink(path);
+        free(slots[i].buf);
+    }
+    for (int64_t k = 0; k < ops; ++k) {
+        numbered(path, "o", k);
+        unlink(path);
+        numbered(path, "d", k);
+        rmdir(path);
+        numbered(path, "r", k);
+        rmdir(path);
+    }
+    for (int i = 0; i < READDIR_ENTRIES; ++i) {
+        snprintf(path, sizeof(path), "%s/list/e%d", scratch, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/list", scratch);
+    rmdir(path);
+    rmdir(scratch);
+}
+
+/////////////////////////////////////////////////////////////////////
+
+void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-d dir] [-c concurrency] [-n ops] [-s size] [-o op,op,...]\n"
+            "  operations: ", name);
+    for (int i = 0; i < OP_COUNT; ++i)
+        fprintf(stderr, "%s%s", i ? "," : "", operations[i].name);
+    fprintf(stderr, "\n");
+}
+
+/**
+ * Parses a comma separated list of operation names.
+ * @return bitmask, -1 if a name is unknown
+ */
+int parse_operations(char* list) {
+    int mask = 0;
+    for (char* name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        int i;
+        for (i = 0; i < OP_COUNT; ++i) {
+            if (!strcmp(name, operations[i].name))
+                break;
+        }
+        if (i == OP_COUNT)
+            return -1;
+        mask |= 1 << i;
+    }
+    return mask;
+}
+
+int main(int argc, char** argv) {
+    int selected = (1 << OP_COUNT) - 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:c:n:s:o:")) != -1) {
+        switch (opt) {
+            case 'd': base_dir = optarg; break;
+            case 'c': concurrency = atoi(optarg); break;
+            case 'n': ops = atoll(optarg); break;
+            case 's': size = strtoul(optarg, NULL, 10); break;
+            case 'o': selected = parse_operations(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (concurrency < 1 || concurrency > MAX_CONCURRENCY || ops < 1
+            || size < 1 || selected <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int run = selected;
+    for (int i = OP_COUNT - 1; i >= 0; --i) {
+        if (run & (1 << i))
+            run |= operations[i].needs;
+    }
+
+    loop = uv_default_loop();
+    latencies = (uint64_t*) malloc(ops * sizeof(*latencies));
+    if (setup()) {
+        cleanup();
+        return 1;
+    }
+
+    const char* threads = getenv("UV_THREADPOOL_SIZE");
+    printf("# dir=%s threadpool=%s size=%zu\n", base_dir, threads ? threads : "default", size);
+    printf("%-8s %6s %8s %12s %10s %10s %10s %10s %10s %8s\n",
+            "op", "conc", "ops", "ops/s", "p50_us", "p90_us", "p99_us",
+            "p999_us", "max_us", "errors");
+    for (int i = 0; i < OP_COUNT; ++i) {
+        if (run & (1 << i))
+            run_phase(&operations[i], selected & (1 << i));
+    }
+
+    cleanup();
+    free(latencies);
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include <uv.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Event loop overhead microbenchmarks.
+ *
+ *   bench.o [ITERATIONS] [REPETITIONS]
+ *
+ * Every benchmark runs ITERATIONS operations on a fresh loop, repeated
+ * REPETITIONS times, and is printed as ns/op mean and standard deviation.
+ * Output is one JSON document on stdout.
+ *
+ * Prepare and check handles do not keep the loop from blocking in poll,
+ * so they run next to an empty idle handle; compare them to "idle".
+ */
+
+#ifndef BENCH_CFLAGS
+#define BENCH_CFLAGS ""
+#endif
+
+/* the operation counter of the running benchmark */
+int64_t counter;
+int64_t iterations;
+
+uv_idle_t idler;
+uv_prepare_t preparer;
+uv_check_t checker;
+uv_timer_t timer;
+uv_async_t async;
+
+void idle_cb(uv_idle_t* handle, int status) {
+    if (++counter >= iterations)
+        uv_idle_stop(handle);
+}
+
+void idle_noop_cb(uv_idle_t* handle, int status) {
+}
+
+void prepare_cb(uv_prepare_t* handle, int status) {
+    if (++counter >= iterations) {
+        uv_prepare_stop(handle);
+        uv_idle_stop(&idler);
+    }
+}
+
+void check_cb(uv_check_t* handle, int status) {
+    if (++counter >= iterations) {
+        uv_check_stop(handle);
+        uv_idle_stop(&idler);
+    }
+}
+
+/* libuv versions differ in whether a timer restarted with 0 timeout
+ * fires again in the same timer phase, so this may not be a full
+ * loop iteration per op */
+void timer_cb(uv_timer_t* handle, int status) {
+    if (++counter < iterations)
+        uv_timer_start(handle, timer_cb, 0, 0);
+}
+
+void async_cb(uv_async_t* handle, int status) {
+    if (++counter < iterations)
+        uv_async_send(handle);
+    else
+        uv_close((uv_handle_t*) handle, NULL);
+}
+
+/**
+ * One benchmark body, returns the number of operations it did.
+ */
+typedef int64_t (*bench_fn)(uv_loop_t* loop);
+
+int64_t bench_idle(uv_loop_t* loop) {
+    uv_idle_init(loop, &idler);
+    uv_idle_start(&idler, idle_cb);
+    uv_run(loop, UV_RUN_DEFAULT);
+    uv_close((uv_handle_t*) &idler, NULL);
+    return counter;
+}
+
+int64_t bench_prepare(uv_loop_t* loop) {
+    uv_idle_init(loop, &idler);
+    uv_idle_start(&idler, idle_noop_cb);
+    uv_prepare_init(loop, &preparer);
+    uv_prepare_start(&preparer, prepare_cb);
+    uv_run(loop, UV_RUN_DEFAULT);
+    uv_close((uv_handle_t*) &idler, NULL);
+    uv_close((uv_handle_t*) &preparer, NULL);
+    return counter;
+}
+
+int64_t bench_check(uv_loop_t* loop) {
+    uv_idle_init(loop, &idler);
+    uv_idle_start(&idler, idle_noop_cb);
+    uv_check_init(loop, &checker);
+    uv_check_start(&checker, check_cb);
+    uv_run(loop, UV_RUN_DEFAULT);
+    uv_close((uv_handle_t*) &idler, NULL);
+    uv_close((uv_handle_t*) &checker, NULL);
+    return counter;
+}
+
+int64_t bench_timer(uv_loop_t* loop) {
+    uv_timer_init(loop, &timer);
+    uv_timer_start(&timer, timer_cb, 0, 0);
+    uv_run(loop, UV_RUN_DEFAULT);
+    uv_close((uv_handle_t*) &timer, NULL);
+    return counter;
+}
+
+int64_t bench_async(uv_loop_t* loop) {
+    uv_async_init(loop, &async, async_cb);
+    uv_async_send(&async);
+    uv_run(loop, UV_RUN_DEFAULT);
+    return counter;
+}
+
+/* uv_run on a loop without handles returns right away */
+int64_t bench_run_default(uv_loop_t* loop) {
+    for (counter = 0; counter < iterations; ++counter)
+        uv_run(loop, UV_RUN_DEFAULT);
+    return counter;
+}
+
+/* one full iteration per call, kept from blocking by an idle handle */
+int64_t bench_run_once(uv_loop_t* loop) {
+    uv_idle_init(loop, &idler);
+    uv_idle_start(&idler, idle_noop_cb);
+    for (counter = 0; counter < iterations; ++counter)
+        uv_run(loop, UV_RUN_ONCE);
+    uv_close((uv_handle_t*) &idler, NULL);
+    return counter;
+}
+
+int64_t bench_run_nowait(uv_loop_t* loop) {
+    uv_idle_init(loop, &idler);
+    uv_idle_start(&idler, idle_noop_cb);
+    for (counter = 0; counter < iterations; ++counter)
+        uv_run(loop, UV_RUN_NOWAIT);
+    uv_close((uv_handle_t*) &idler, NULL);
+    return counter;
+}
+
+/* the loop passed in is not used, every op is a new one */
+int64_t bench_loop_new(uv_loop_t* unused) {
+    int64_t n = iterations / 100 + 1;
+
+    for (counter = 0; counter < n; ++counter)
+        uv_loop_delete(uv_loop_new());
+    return counter;
+}
+
+struct {
+    const char* name;
+    bench_fn fn;
+} benchmarks[] = {
+    { "idle", bench_idle },
+    { "prepare", bench_prepare },
+    { "check", bench_check },
+    { "timer_zero", bench_timer },
+    { "async", bench_async },
+    { "run_default_empty", bench_run_default },
+    { "run_once", bench_run_once },
+    { "run_nowait", bench_run_nowait },
+    { "loop_new_delete", bench_loop_new }
+};
+
+int main(int argc, char** argv) {
+    iterations = argc > 1 ? atoll(argv[1]) : 1000000;
+    int repetitions = argc > 2 ? atoi(argv[2]) : 10;
+    size_t nbench = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    double* samples = malloc(sizeof(double) * repetitions);
+
+    printf("{\n  \"libuv\": \"%s\",\n  \"cflags\": \"%s\",\n"
+            "  \"iterations\": %lld,\n  \"repetitions\": %d,\n"
+            "  \"results\": [\n", uv_version_string(), BENCH_CFLAGS,
+            (long long) iterations, repetitions);
+
+    for (size_t b = 0; b < nbench; ++b) {
+        double mean = 0;
+        double var = 0;
+
+        for (int r = 0; r < repetitions; ++r) {
+            uv_loop_t* loop = uv_loop_new();
+
+            counter = 0;
+            uint64_t start = uv_hrtime();
+            int64_t ops = benchmarks[b].fn(loop);
+            samples[r] = (double) (uv_hrtime() - start) / ops;
+
+            /* let the close callbacks run before the loop goes away */
+            uv_run(loop, UV_RUN_DEFAULT);
+            uv_loop_delete(loop);
+
+            mean += samples[r];
+        }
+        mean /= repetitions;
+        for (int r = 0; r < repetitions; ++r)
+            var += (samples[r] - mean) * (samples[r] - mean);
+        var /= repetitions > 1 ? repetitions - 1 : 1;
+
+        printf("    { \"name\": \"%s\", \"ns_per_op\": %.2f, "
+                "\"stddev\": %.2f }%s\n", benchmarks[b].name, mean,
+                sqrt(var), b + 1 < nbench ? "," : "");
+    }
+
+    printf("  ]\n}\n");
+    free(samples);
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include "uv_sched.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * I/O latency with and without heavy background work.
+ *
+ *   sched_bench.o [SECONDS] [BUDGET_US]
+ *
+ * A helper thread writes its uv_hrtime() into a socketpair every ms.
+ * The loop reads it and records how late it got there. Modes:
+ *
+ *   none   nothing else runs on the loop
+ *   naive  an idle callback runs 20 ms of work at a time
+ *   sched  8 tasks of 20 us steps on uv_sched with BUDGET_US per slice
+ */
+
+#define STEP_WORK 20000
+#define NAIVE_STEPS 1000
+#define NTASKS 8
+#define MAX_SAMPLES 100000
+
+uv_loop_t* loop;
+uv_pipe_t pipe_handle;
+uv_timer_t stop_timer;
+uv_idle_t naive_idle;
+uv_sched_t sched;
+uv_task_t tasks[NTASKS];
+
+volatile int writing;
+int fds[2];
+
+uint64_t samples[MAX_SAMPLES];
+size_t nsamples;
+
+char pending[8]; // partial stamp carried between reads
+size_t npending;
+
+/* keeps the compiler from dropping the work */
+volatile uint32_t sink;
+
+static void burn() {
+    uint32_t x = sink;
+
+    for (int i = 0; i < STEP_WORK; ++i)
+        x = x * 1664525u + 1013904223u;
+    sink = x;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+
+    return x < y ? -1 : x > y;
+}
+
+void writer_run(void* arg) {
+    while (writing) {
+        uint64_t stamp = uv_hrtime();
+
+        if (write(fds[1], &stamp, sizeof(stamp)) != sizeof(stamp))
+            break;
+        usleep(1000);
+    }
+}
+
+uv_buf_t alloc_buffer(uv_handle_t* handle, size_t size) {
+    return uv_buf_init((char*) malloc(size), size);
+}
+
+void read_cb(uv_stream_t* stream, ssize_t nread, uv_buf_t buf) {
+    uint64_t now = uv_hrtime();
+
+    for (ssize_t i = 0; i < nread; ++i) {
+        pending[npending++] = buf.base[i];
+
+        if (npending == sizeof(uint64_t)) {
+            uint64_t stamp;
+
+            memcpy(&stamp, pending, sizeof(stamp));
+            npending = 0;
+            if (nsamples < MAX_SAMPLES)
+                samples[nsamples++] = now - stamp;
+        }
+    }
+
+    free(buf.base);
+}
+
+int task_step(uv_task_t* task) {
+    burn();
+    return 1; // never done, stopped with the run
+}
+
+void naive_cb(uv_idle_t* handle, int status) {
+    for (int i = 0; i < NAIVE_STEPS; ++i)
+        burn();
+}
+
+void stop_cb(uv_timer_t* handle, int status) {
+    uv_stop(loop);
+}
+
+void run(const char* mode, int seconds, uint64_t budget_ns) {
+    uv_thread_t writer;
+
+    loop = uv_loop_new();
+    nsamples = 0;
+    npending = 0;
+
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    uv_pipe_init(loop, &pipe_handle, 0);
+    uv_pipe_open(&pipe_handle, fds[0]);
+    uv_read_start((uv_stream_t*) &pipe_handle, alloc_buffer, read_cb);
+
+    uv_timer_init(loop, &stop_timer);
+    uv_timer_start(&stop_timer, stop_cb, seconds * 1000, 0);
+
+    if (!strcmp(mode, "naive")) {
+        uv_idle_init(loop, &naive_idle);
+        uv_idle_start(&naive_idle, naive_cb);
+    } else if (!strcmp(mode, "sched")) {
+        uv_sched_init(loop, &sched, budget_ns);
+        for (int i = 0; i < NTASKS; ++i)
+            uv_sched_add(&sched, &tasks[i], i % UV_SCHED_PRIORITIES,
+                    task_step, NULL);
+    }
+
+    writing = 1;
+    uv_thread_create(&writer, writer_run, NULL);
+    uv_run(loop, UV_RUN_DEFAULT);
+    writing = 0;
+    uv_thread_join(&writer);
+    close(fds[1]);
+
+    qsort(samples, nsamples, sizeof(uint64_t), cmp_u64);
+    printf("%-6s samples=%-6zu p50=%9.1f us p99=%9.1f us max=%9.1f us",
+            mode, nsamples, samples[nsamples / 2] / 1e3,
+            samples[nsamples * 99 / 100] / 1e3,
+            samples[nsamples - 1] / 1e3);
+    if (!strcmp(mode, "sched"))
+        printf(" steps=%llu io_yields=%llu",
+                (unsigned long long) sched.steps,
+                (unsigned long long) sched.io_yields);
+    printf("\n");
+
+    /* the loop is not run again, its handles are simply abandoned */
+}
+
+int main(int argc, char** argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 2;
+    uint64_t budget_ns = (argc > 2 ? atoi(argv[2]) : 1000) * 1000ull;
+
+    run("none", seconds, budget_ns);
+    run("naive", seconds, budget_ns);
+    run("sched", seconds, budget_ns);
+
+    return 0;
+}
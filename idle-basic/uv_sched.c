@@ -0,0 +1,159 @@
+#include "uv_sched.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+static void idle_cb(uv_idle_t* handle, int status) {
+    /* only here so uv_run polls with a zero timeout */
+}
+
+/**
+ * @return nonzero if the loop has I/O waiting to be dispatched
+ */
+static int io_pending(uv_sched_t* sched) {
+#ifndef _WIN32
+    struct pollfd pfd;
+
+    pfd.fd = uv_backend_fd(sched->loop);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    return pfd.fd != -1 && poll(&pfd, 1, 0) > 0;
+#else
+    return 0;
+#endif
+}
+
+static void stop_handles(uv_sched_t* sched) {
+    uv_idle_stop(&sched->idle);
+    uv_check_stop(&sched->check);
+}
+
+static uv_task_t* next_task(uv_sched_t* sched) {
+    for (int p = 0; p < UV_SCHED_PRIORITIES; ++p) {
+        if (!QUEUE_EMPTY(&sched->runq[p]))
+            return QUEUE_DATA(QUEUE_HEAD(&sched->runq[p]), uv_task_t, node);
+    }
+    return NULL;
+}
+
+static void check_cb(uv_check_t* handle, int status) {
+    uv_sched_t* sched = (uv_sched_t*) handle->data;
+    uint64_t start = uv_hrtime();
+    uint64_t last_probe = start;
+    uint64_t now = start;
+    uv_task_t* task;
+
+    sched->slices++;
+
+    while ((task = next_task(sched)) != NULL) {
+        int more;
+
+        QUEUE_REMOVE(&task->node);
+        QUEUE_INIT(&task->node);
+        task->steps++;
+        sched->steps++;
+
+        task->running = 1;
+        more = task->step(task);
+        task->running = 0;
+
+        if (task->cancelled) {
+            /* uv_sched_cancel from inside the step already counted it */
+        } else if (more) {
+            /* round robin inside the priority */
+            QUEUE_INSERT_TAIL(&sched->runq[task->priority], &task->node);
+        } else {
+            sched->ntasks--;
+            if (task->done)
+                task->done(task);
+        }
+
+        now = uv_hrtime();
+        if (now - start >= sched->budget_ns)
+            break;
+
+        if (now - last_probe >= UV_SCHED_IO_PROBE_NS) {
+            last_probe = now;
+            if (io_pending(sched)) {
+                sched->io_yields++;
+                break;
+            }
+        }
+    }
+
+    if (sched->ntasks == 0)
+        stop_handles(sched);
+}
+
+int uv_sched_init(uv_loop_t* loop, uv_sched_t* sched, uint64_t budget_ns) {
+    if (sched == NULL || budget_ns == 0) {
+        return 1;
+    }
+
+    sched->loop = loop;
+    sched->slices = 0;
+    sched->steps = 0;
+    sched->io_yields = 0;
+    sched->budget_ns = budget_ns;
+    sched->ntasks = 0;
+
+    for (int p = 0; p < UV_SCHED_PRIORITIES; ++p)
+        QUEUE_INIT(&sched->runq[p]);
+
+    uv_idle_init(loop, &sched->idle);
+    uv_check_init(loop, &sched->check);
+    sched->idle.data = sched;
+    sched->check.data = sched;
+
+    return 0;
+}
+
+int uv_sched_add(uv_sched_t* sched, uv_task_t* task, int priority,
+        uv_task_step_cb step, uv_task_done_cb done) {
+    if (task == NULL || step == NULL) {
+        return 1;
+    }
+    if (priority < 0 || priority >= UV_SCHED_PRIORITIES) {
+        return 2;
+    }
+
+    task->steps = 0;
+    task->priority = priority;
+    task->step = step;
+    task->done = done;
+    task->running = 0;
+    task->cancelled = 0;
+    QUEUE_INSERT_TAIL(&sched->runq[priority], &task->node);
+
+    if (sched->ntasks++ == 0) {
+        uv_idle_start(&sched->idle, idle_cb);
+        uv_check_start(&sched->check, check_cb);
+    }
+
+    return 0;
+}
+
+void uv_sched_cancel(uv_sched_t* sched, uv_task_t* task) {
+    if (task->running) {
+        /* check_cb sees the flag once the step returned */
+        if (task->cancelled)
+            return;
+        task->cancelled = 1;
+    } else {
+        if (QUEUE_EMPTY(&task->node))
+            return;
+        QUEUE_REMOVE(&task->node);
+        QUEUE_INIT(&task->node);
+    }
+
+    if (--sched->ntasks == 0)
+        stop_handles(sched);
+}
+
+void uv_sched_close(uv_sched_t* sched) {
+    uv_close((uv_handle_t*) &sched->idle, NULL);
+    uv_close((uv_handle_t*) &sched->check, NULL);
+    sched->ntasks = 0;
+}
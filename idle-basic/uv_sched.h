@@ -0,0 +1,88 @@
+#ifndef UV_SCHED_H
+#define UV_SCHED_H
+
+#include "uv.h"
+#include "../internal/queue.h"
+
+/**
+ * Number of priority levels, 0 is the highest.
+ */
+#define UV_SCHED_PRIORITIES 4
+
+/**
+ * How often (ns) a running slice asks the backend whether I/O is ready.
+ */
+#define UV_SCHED_IO_PROBE_NS 50000
+
+typedef struct uv_sched_s uv_sched_t;
+typedef struct uv_task_s uv_task_t;
+
+/**
+ * Does one small piece of work.
+ * @return 0 when the task is finished, anything else to be called again
+ */
+typedef int (*uv_task_step_cb)(uv_task_t* task);
+
+typedef void (*uv_task_done_cb)(uv_task_t* task);
+
+struct uv_task_s {
+    /* public */
+    void* data;
+    uint64_t steps; // steps run so far
+
+    // private
+    QUEUE node;
+    int running; // inside step
+    int cancelled; // by uv_sched_cancel from inside step
+    int priority;
+    uv_task_step_cb step;
+    uv_task_done_cb done;
+};
+
+struct uv_sched_s {
+    /* public */
+    void* data;
+    uv_loop_t* loop;
+    uint64_t slices; // check callbacks that ran tasks
+    uint64_t steps;
+    uint64_t io_yields; // slices cut short because I/O was ready
+
+    // private
+    uint64_t budget_ns; // time per loop iteration spent in tasks
+    int ntasks;
+    uv_idle_t idle; // keeps poll from blocking while tasks are queued
+    uv_check_t check; // runs the slice after the I/O callbacks
+    QUEUE runq[UV_SCHED_PRIORITIES];
+};
+
+/**
+ * Tasks run in the check phase, after the I/O callbacks of the iteration,
+ * for at most budget_ns per iteration. While tasks are queued the loop
+ * polls without blocking, so I/O that arrives during a slice is handled
+ * right after it. Higher priorities always run first, tasks of equal
+ * priority take turns step by step.
+ * @param sched Must be allocated in caller.
+ * @return 0 if success
+ */
+int uv_sched_init(uv_loop_t* loop, uv_sched_t* sched, uint64_t budget_ns);
+
+/**
+ * Queues task. done (may be NULL) is called once step returned 0.
+ * @return 0 if success
+ */
+int uv_sched_add(uv_sched_t* sched, uv_task_t* task, int priority,
+        uv_task_step_cb step, uv_task_done_cb done);
+
+/**
+ * Removes a queued task, done is not called.
+ * From inside its own step too: the task is not run again once step
+ * returns, whatever it returned.
+ */
+void uv_sched_cancel(uv_sched_t* sched, uv_task_t* task);
+
+/**
+ * Closes the idle and check handles. Queued tasks are dropped.
+ */
+void uv_sched_close(uv_sched_t* sched);
+
+#endif
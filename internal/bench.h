@@ -0,0 +1,171 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Microbenchmark harness with JSON output.
+ *
+ *   static void push_pop(void* arg, int thread) { ... ops operations ... }
+ *
+ *   bench_t b;
+ *   bench_open(&b, "queue", "bench_queue.json", commit);
+ *   bench_case(&b, "push_pop", 1024, 4, push_pop, states, ops);
+ *   bench_close(&b);
+ *
+ * A case runs BENCH_WARMUP times unmeasured, then BENCH_REPS times. With
+ * more than one thread every thread runs fn at once (released together
+ * by a barrier) and a repetition takes as long as the slowest thread.
+ * The median and the median absolute deviation of ns per operation are
+ * printed and appended to the JSON file, so runs on two commits can be
+ * diffed: a median moving by more than a few MADs is a real change.
+ */
+
+#ifndef BENCH_WARMUP
+#define BENCH_WARMUP 3
+#endif
+#ifndef BENCH_REPS
+#define BENCH_REPS 15
+#endif
+
+typedef void (*bench_fn)(void* arg, int thread);
+
+typedef struct {
+    const char* suite;
+    FILE* json;
+    int cases;
+} bench_t;
+
+typedef struct {
+    bench_fn fn;
+    void* arg;
+    int thread;
+    pthread_barrier_t* barrier;
+    double start;
+    double end;
+} bench_thread_t;
+
+/* keeps the compiler from dropping the loops */
+static volatile long bench_sink;
+
+static inline double bench_now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int bench_compare_double(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return x < y ? -1 : x > y;
+}
+
+static inline double bench_median(double* v, int n) {
+    qsort(v, n, sizeof(double), bench_compare_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/**
+ * @param commit recorded in the JSON file, may be NULL
+ * @return 0 if success
+ */
+static inline int bench_open(bench_t* b, const char* suite, const char* path,
+        const char* commit) {
+    b->suite = suite;
+    b->cases = 0;
+    b->json = fopen(path, "w");
+    if (b->json == NULL) {
+        perror(path);
+        return -1;
+    }
+    fprintf(b->json, "{\n  \"suite\": \"%s\",\n  \"commit\": \"%s\",\n"
+            "  \"warmup\": %d,\n  \"reps\": %d,\n  \"results\": [", suite,
+            commit != NULL ? commit : "", BENCH_WARMUP, BENCH_REPS);
+    return 0;
+}
+
+static void* bench_thread(void* arg) {
+    bench_thread_t* t = (bench_thread_t*) arg;
+
+    pthread_barrier_wait(t->barrier);
+    t->start = bench_now_ns();
+    t->fn(t->arg, t->thread);
+    t->end = bench_now_ns();
+    return NULL;
+}
+
+/**
+ * @return wall time of one run of fn on threads threads
+ */
+static inline double bench_run(bench_fn fn, void* arg, int threads) {
+    if (threads == 1) {
+        double start = bench_now_ns();
+        fn(arg, 0);
+        return bench_now_ns() - start;
+    }
+
+    pthread_t ids[threads];
+    bench_thread_t state[threads];
+    pthread_barrier_t barrier;
+    double start = 0;
+    double end = 0;
+
+    pthread_barrier_init(&barrier, NULL, threads);
+    for (int i = 0; i < threads; ++i) {
+        state[i].fn = fn;
+        state[i].arg = arg;
+        state[i].thread = i;
+        state[i].barrier = &barrier;
+        pthread_create(&ids[i], NULL, bench_thread, &state[i]);
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(ids[i], NULL);
+        if (i == 0 || state[i].start < start)
+            start = state[i].start;
+        if (state[i].end > end)
+            end = state[i].end;
+    }
+    pthread_barrier_destroy(&barrier);
+    return end - start;
+}
+
+/**
+ * Measures fn, each thread does ops operations per run.
+ * @param n size parameter of the case, only reported
+ * @return median ns per operation
+ */
+static inline double bench_case(bench_t* b, const char* name, size_t n, int threads,
+        bench_fn fn, void* arg, size_t ops) {
+    double samples[BENCH_REPS];
+    double deviations[BENCH_REPS];
+
+    for (int i = 0; i < BENCH_WARMUP; ++i)
+        bench_run(fn, arg, threads);
+    for (int i = 0; i < BENCH_REPS; ++i)
+        samples[i] = bench_run(fn, arg, threads) / ops;
+
+    double median = bench_median(samples, BENCH_REPS);
+    for (int i = 0; i < BENCH_REPS; ++i)
+        deviations[i] = samples[i] > median ? samples[i] - median : median - samples[i];
+    double mad = bench_median(deviations, BENCH_REPS);
+
+    printf("%-8s %-16s n=%-8zu threads=%-2d %9.2f ns/op  mad %7.2f  min %9.2f\n",
+            b->suite, name, n, threads, median, mad, samples[0]);
+    fprintf(b->json, "%s\n    {\"name\": \"%s\", \"n\": %zu, \"threads\": %d, "
+            "\"ops\": %zu, \"median_ns\": %.3f, \"mad_ns\": %.3f, \"min_ns\": %.3f}",
+            b->cases++ ? "," : "", name, n, threads, ops, median, mad, samples[0]);
+    return median;
+}
+
+static inline void bench_close(bench_t* b) {
+    fprintf(b->json, "\n  ]\n}\n");
+    fclose(b->json);
+}
+
+#endif
@@ -0,0 +1,182 @@
+#include "queue.h"
+#include "cdeque.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Compares the chunked deque with the intrusive QUEUE list.
+ *
+ *   bench_cdeque.o [MAX_N]
+ *
+ * Runs push_back, full iteration and pop_front from 1k up to MAX_N
+ * (default 10M) elements. Elements are linked in shuffled order, as
+ * they would be after some time of heap churn. Cache misses come from
+ * perf_event_open where the kernel allows it and print as -1 otherwise.
+ */
+
+struct item_s {
+    long value;
+    QUEUE node;
+};
+
+static int perf_fd = -1;
+
+static void perf_open() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static void perf_start() {
+#ifdef __linux__
+    if (perf_fd != -1) {
+        ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+static int64_t perf_stop() {
+    uint64_t count = 0;
+
+#ifdef __linux__
+    if (perf_fd != -1) {
+        ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(perf_fd, &count, sizeof(count)) == sizeof(count))
+            return (int64_t) count;
+    }
+#endif
+    return -1;
+}
+
+static double now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double t_start;
+
+static void start() {
+    perf_start();
+    t_start = now_ns();
+}
+
+static void stop(const char* impl, const char* op, size_t n) {
+    double ns = now_ns() - t_start;
+    int64_t misses = perf_stop();
+
+    printf("%-6s %-9s n=%-9zu %8.2f ns/op %8.3f misses/op\n", impl, op, n,
+            ns / n, misses < 0 ? -1.0 : (double) misses / n);
+}
+
+/* keeps the compiler from dropping the loops */
+volatile long sink;
+
+static void bench_queue(struct item_s** items, size_t n) {
+    QUEUE head;
+    QUEUE* q;
+    long sum = 0;
+
+    QUEUE_INIT(&head);
+
+    start();
+    for (size_t i = 0; i < n; ++i)
+        QUEUE_INSERT_TAIL(&head, &items[i]->node);
+    stop("queue", "push_back", n);
+
+    start();
+    QUEUE_FOREACH(q, &head)
+        sum += QUEUE_DATA(q, struct item_s, node)->value;
+    stop("queue", "foreach", n);
+
+    start();
+    while (!QUEUE_EMPTY(&head)) {
+        q = QUEUE_HEAD(&head);
+        QUEUE_REMOVE(q);
+        sum += QUEUE_DATA(q, struct item_s, node)->value;
+    }
+    stop("queue", "pop_front", n);
+
+    sink = sum;
+}
+
+static void bench_cdeque(struct item_s** items, size_t n) {
+    cdeque_t d;
+    cdeque_iter_t it;
+    struct item_s* item;
+    long sum = 0;
+
+    cdeque_init(&d);
+
+    start();
+    for (size_t i = 0; i < n; ++i)
+        cdeque_push_back(&d, items[i]);
+    stop("cdeque", "push_back", n);
+
+    start();
+    CDEQUE_FOREACH(item, &it, &d)
+        sum += item->value;
+    stop("cdeque", "foreach", n);
+
+    start();
+    while ((item = cdeque_pop_front(&d)) != NULL)
+        sum += item->value;
+    stop("cdeque", "pop_front", n);
+
+    cdeque_destroy(&d);
+    sink = sum;
+}
+
+int main(int argc, char** argv) {
+    size_t max_n = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    perf_open();
+    srand(1);
+
+    for (size_t n = 1000; n <= max_n; n *= 10) {
+        struct item_s* pool = malloc(sizeof(struct item_s) * n);
+        struct item_s** items = malloc(sizeof(struct item_s*) * n);
+
+        for (size_t i = 0; i < n; ++i) {
+            pool[i].value = i;
+            items[i] = &pool[i];
+        }
+        for (size_t i = n - 1; i > 0; --i) {
+            size_t j = ((size_t) rand() * RAND_MAX + rand()) % (i + 1);
+            struct item_s* swap = items[i];
+
+            items[i] = items[j];
+            items[j] = swap;
+        }
+
+        bench_queue(items, n);
+        bench_cdeque(items, n);
+
+        free(items);
+        free(pool);
+    }
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include "queue.h"
+#include "bench.h"
+#include <unistd.h>
+
+/**
+ * QUEUE microbenchmarks with JSON output.
+ *
+ *   bench_queue.o [json file] [commit]
+ *
+ * For list sizes from 16 to 1M:
+ *   push_pop      pop the head and push it to the tail, a FIFO in steady state
+ *   foreach       sum all elements, ops are elements visited
+ *   remove_insert unlink an element from the middle and insert it at the head
+ * each on 1, 2 and 4 threads with a list per thread (QUEUE is not thread
+ * safe, this shows how the walks share caches and memory bandwidth), and
+ *   push_pop_locked one list shared by all threads behind a mutex
+ *
+ * Elements are linked in shuffled order, as they would be after some
+ * time of heap churn.
+ */
+
+#define OPS (1 << 20)
+#define MAX_THREADS 4
+
+struct item_s {
+    long value;
+    QUEUE node;
+};
+
+typedef struct {
+    QUEUE head;
+    struct item_s* items;
+    size_t n;
+    char pad[64]; // keep the heads of different threads apart
+} list_t;
+
+static list_t lists[MAX_THREADS];
+static list_t shared;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int seed = 1;
+
+static void list_init(list_t* list, size_t n) {
+    size_t* order = malloc(sizeof(size_t) * n);
+
+    list->items = malloc(sizeof(struct item_s) * n);
+    list->n = n;
+    for (size_t i = 0; i < n; ++i) {
+        list->items[i].value = i;
+        order[i] = i;
+    }
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t j = rand_r(&seed) % (i + 1);
+        size_t swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+    QUEUE_INIT(&list->head);
+    for (size_t i = 0; i < n; ++i)
+        QUEUE_INSERT_TAIL(&list->head, &list->items[order[i]].node);
+    free(order);
+}
+
+static void list_destroy(list_t* list) {
+    free(list->items);
+}
+
+static void push_pop(void* arg, int thread) {
+    QUEUE* head = &lists[thread].head;
+
+    for (size_t i = 0; i < OPS; ++i) {
+        QUEUE* q = QUEUE_HEAD(head);
+        QUEUE_REMOVE(q);
+        QUEUE_INSERT_TAIL(head, q);
+    }
+}
+
+static void foreach(void* arg, int thread) {
+    list_t* list = &lists[thread];
+    size_t rounds = OPS / list->n ? OPS / list->n : 1;
+    long sum = 0;
+    QUEUE* q;
+
+    for (size_t r = 0; r < rounds; ++r) {
+        QUEUE_FOREACH(q, &list->head)
+            sum += QUEUE_DATA(q, struct item_s, node)->value;
+    }
+    bench_sink = sum;
+}
+
+static void remove_insert(void* arg, int thread) {
+    list_t* list = &lists[thread];
+    unsigned int s = thread + 1;
+
+    for (size_t i = 0; i < OPS; ++i) {
+        QUEUE* q = &list->items[rand_r(&s) % list->n].node;
+        QUEUE_REMOVE(q);
+        QUEUE_INSERT_HEAD(&list->head, q);
+    }
+}
+
+static void push_pop_locked(void* arg, int thread) {
+    for (size_t i = 0; i < OPS; ++i) {
+        pthread_mutex_lock(&shared_lock);
+        QUEUE* q = QUEUE_HEAD(&shared.head);
+        QUEUE_REMOVE(q);
+        QUEUE_INSERT_TAIL(&shared.head, q);
+        pthread_mutex_unlock(&shared_lock);
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "bench_queue.json";
+    const char* commit = argc > 2 ? argv[2] : NULL;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    bench_t b;
+
+    if (bench_open(&b, "queue", path, commit))
+        return 1;
+
+    for (size_t n = 16; n <= (1 << 20); n *= 16) {
+        for (int i = 0; i < MAX_THREADS; ++i)
+            list_init(&lists[i], n);
+        list_init(&shared, n);
+
+        for (int threads = 1; threads <= MAX_THREADS && threads <= cpus; threads *= 2) {
+            bench_case(&b, "push_pop", n, threads, push_pop, NULL, OPS);
+            bench_case(&b, "foreach", n, threads, foreach, NULL,
+                    (OPS / n ? OPS / n : 1) * n);
+            bench_case(&b, "remove_insert", n, threads, remove_insert, NULL, OPS);
+            bench_case(&b, "push_pop_locked", n, threads, push_pop_locked, NULL, OPS);
+        }
+
+        for (int i = 0; i < MAX_THREADS; ++i)
+            list_destroy(&lists[i]);
+        list_destroy(&shared);
+    }
+
+    bench_close(&b);
+    printf("results written to %s\n", path);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include "tqueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Compares the typed list layer with the raw QUEUE macros.
+ * Elements are linked in shuffled order so iteration follows pointers
+ * around the heap like a real pending-write list would.
+ */
+
+struct item_s {
+    long value;
+    QUEUE node;
+};
+
+TQUEUE_DEFINE(item_list, struct item_s, node)
+
+static double now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char* impl, const char* op, size_t n, double ns) {
+    printf("%-6s %-10s n=%-8zu %7.2f ns/op\n", impl, op, n, ns / n);
+}
+
+/* keeps the compiler from dropping the loops */
+volatile long sink;
+
+static void bench_raw(struct item_s* items, size_t* order, size_t n) {
+    QUEUE head;
+    QUEUE* q;
+    QUEUE* tmp;
+    long sum = 0;
+    double t;
+
+    QUEUE_INIT(&head);
+
+    t = now_ns();
+    for (size_t i = 0; i < n; ++i)
+        QUEUE_INSERT_TAIL(&head, &items[order[i]].node);
+    report("raw", "push_back", n, now_ns() - t);
+
+    t = now_ns();
+    QUEUE_FOREACH(q, &head)
+        sum += QUEUE_DATA(q, struct item_s, node)->value;
+    report("raw", "foreach", n, now_ns() - t);
+
+    /* drop the odd values while iterating */
+    t = now_ns();
+    QUEUE_FOREACH_SAFE(q, tmp, &head) {
+        if (QUEUE_DATA(q, struct item_s, node)->value & 1)
+            QUEUE_REMOVE(q);
+    }
+    report("raw", "remove_if", n, now_ns() - t);
+
+    t = now_ns();
+    while (!QUEUE_EMPTY(&head)) {
+        q = QUEUE_HEAD(&head);
+        QUEUE_REMOVE(q);
+        sum += QUEUE_DATA(q, struct item_s, node)->value;
+    }
+    report("raw", "pop_front", n / 2, now_ns() - t);
+
+    sink = sum;
+}
+
+static void bench_typed(struct item_s* items, size_t* order, size_t n) {
+    item_list_t list;
+    item_list_t other;
+    struct item_s* item;
+    QUEUE* tmp;
+    long sum = 0;
+    double t;
+
+    item_list_init(&list);
+    item_list_init(&other);
+
+    t = now_ns();
+    for (size_t i = 0; i < n; ++i)
+        item_list_push_back(&list, &items[order[i]]);
+    report("typed", "push_back", n, now_ns() - t);
+
+    t = now_ns();
+    TQUEUE_FOREACH_SAFE(item, tmp, &list, struct item_s, node)
+        sum += item->value;
+    report("typed", "foreach", n, now_ns() - t);
+
+    t = now_ns();
+    TQUEUE_FOREACH_SAFE(item, tmp, &list, struct item_s, node) {
+        if (item->value & 1)
+            item_list_remove(&list, item);
+    }
+    report("typed", "remove_if", n, now_ns() - t);
+
+    t = now_ns();
+    item_list_splice(&other, &list);
+    report("typed", "splice", 1, now_ns() - t);
+
+    t = now_ns();
+    while ((item = item_list_pop_front(&other)) != NULL)
+        sum += item->value;
+    report("typed", "pop_front", n / 2, now_ns() - t);
+
+    sink = sum;
+}
+
+int main(int argc, char** argv) {
+    size_t sizes[] = { 1000, 100000, 1000000 };
+
+    srand(1);
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t n = sizes[s];
+        struct item_s* items = malloc(sizeof(struct item_s) * n);
+        size_t* order = malloc(sizeof(size_t) * n);
+
+        for (size_t i = 0; i < n; ++i) {
+            items[i].value = i;
+            order[i] = i;
+        }
+        for (size_t i = n - 1; i > 0; --i) {
+            size_t j = rand() % (i + 1);
+            size_t swap = order[i];
+
+            order[i] = order[j];
+            order[j] = swap;
+        }
+
+        bench_raw(items, order, n);
+        bench_typed(items, order, n);
+
+        free(order);
+        free(items);
+    }
+
+    return 0;
+}
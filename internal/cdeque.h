@@ -0,0 +1,263 @@
+#ifndef CDEQUE_H_
+#define CDEQUE_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+
+/**
+ * Chunked deque of pointers.
+ *
+ * Same push/pop at both ends and foreach as queue.h, but the pointers
+ * live in CDEQUE_CHUNK sized arrays. Iteration reads them sequentially
+ * instead of loading every next pointer from the previous node, so the
+ * loads of the elements themselves are independent and can overlap.
+ *
+ *   cdeque_t d;
+ *   cdeque_iter_t it;
+ *   struct user_s* user;
+ *
+ *   cdeque_init(&d);
+ *   cdeque_push_back(&d, &john);
+ *   CDEQUE_FOREACH(user, &it, &d) { ... }
+ *   cdeque_destroy(&d);
+ */
+
+#ifndef CDEQUE_CHUNK
+#define CDEQUE_CHUNK 128
+#endif
+
+typedef struct cdeque_chunk_s {
+    struct cdeque_chunk_s* next;
+    struct cdeque_chunk_s* prev;
+    void* items[CDEQUE_CHUNK];
+} cdeque_chunk_t;
+
+typedef struct {
+    cdeque_chunk_t* head;
+    cdeque_chunk_t* tail;
+    size_t head_pos; // index of the first item in head
+    size_t tail_pos; // one past the last item in tail
+    size_t len;
+    cdeque_chunk_t* spare; // one emptied chunk kept to avoid malloc churn
+} cdeque_t;
+
+typedef struct {
+    const cdeque_t* d;
+    cdeque_chunk_t* chunk;
+    size_t pos;
+    size_t end;
+} cdeque_iter_t;
+
+/**
+ * Iterates from front to back. The deque must not change inside the loop.
+ */
+#define CDEQUE_FOREACH(var, it, d)                                            \
+  for (cdeque_iter_init((it), (d));                                           \
+       cdeque_iter_next((it), (void**) &(var)); )
+
+static inline void cdeque_init(cdeque_t* d) {
+    d->head = NULL;
+    d->tail = NULL;
+    d->head_pos = 0;
+    d->tail_pos = 0;
+    d->len = 0;
+    d->spare = NULL;
+}
+
+static inline void cdeque_destroy(cdeque_t* d) {
+    cdeque_chunk_t* c = d->head;
+
+    while (c != NULL) {
+        cdeque_chunk_t* next = c->next;
+
+        free(c);
+        c = next;
+    }
+    free(d->spare);
+    cdeque_init(d);
+}
+
+static inline size_t cdeque_len(const cdeque_t* d) {
+    return d->len;
+}
+
+static inline int cdeque_empty(const cdeque_t* d) {
+    return d->len == 0;
+}
+
+static inline cdeque_chunk_t* cdeque__chunk_new(cdeque_t* d) {
+    cdeque_chunk_t* c = d->spare;
+
+    if (c != NULL)
+        d->spare = NULL;
+    else
+        c = (cdeque_chunk_t*) malloc(sizeof(cdeque_chunk_t));
+
+    if (c != NULL) {
+        c->next = NULL;
+        c->prev = NULL;
+    }
+    return c;
+}
+
+static inline void cdeque__chunk_free(cdeque_t* d, cdeque_chunk_t* c) {
+    if (d->spare == NULL)
+        d->spare = c;
+    else
+        free(c);
+}
+
+/**
+ * Parks the only chunk of an emptied deque, head and tail chunks always
+ * hold at least one item otherwise.
+ */
+static inline void cdeque__reset(cdeque_t* d) {
+    cdeque__chunk_free(d, d->head);
+    d->head = NULL;
+    d->tail = NULL;
+    d->head_pos = 0;
+    d->tail_pos = 0;
+}
+
+/**
+ * @return 0 if success
+ */
+static inline int cdeque_push_back(cdeque_t* d, void* item) {
+    if (d->tail == NULL || d->tail_pos == CDEQUE_CHUNK) {
+        cdeque_chunk_t* c = cdeque__chunk_new(d);
+
+        if (c == NULL)
+            return -1;
+
+        if (d->tail == NULL) {
+            d->head = c;
+            d->head_pos = 0;
+        } else {
+            d->tail->next = c;
+            c->prev = d->tail;
+        }
+        d->tail = c;
+        d->tail_pos = 0;
+    }
+
+    d->tail->items[d->tail_pos++] = item;
+    d->len++;
+
+    return 0;
+}
+
+/**
+ * @return 0 if success
+ */
+static inline int cdeque_push_front(cdeque_t* d, void* item) {
+    if (d->head == NULL || d->head_pos == 0) {
+        cdeque_chunk_t* c = cdeque__chunk_new(d);
+
+        if (c == NULL)
+            return -1;
+
+        if (d->head == NULL) {
+            d->tail = c;
+            d->tail_pos = CDEQUE_CHUNK;
+        } else {
+            d->head->prev = c;
+            c->next = d->head;
+        }
+        d->head = c;
+        d->head_pos = CDEQUE_CHUNK;
+    }
+
+    d->head->items[--d->head_pos] = item;
+    d->len++;
+
+    return 0;
+}
+
+static inline void* cdeque_front(const cdeque_t* d) {
+    return d->len ? d->head->items[d->head_pos] : NULL;
+}
+
+static inline void* cdeque_back(const cdeque_t* d) {
+    return d->len ? d->tail->items[d->tail_pos - 1] : NULL;
+}
+
+/**
+ * @return the removed item, NULL if d is empty
+ */
+static inline void* cdeque_pop_front(cdeque_t* d) {
+    void* item;
+
+    if (d->len == 0)
+        return NULL;
+
+    item = d->head->items[d->head_pos++];
+    d->len--;
+
+    if (d->len == 0) {
+        cdeque__reset(d);
+    } else if (d->head_pos == CDEQUE_CHUNK) {
+        cdeque_chunk_t* c = d->head;
+
+        d->head = c->next;
+        d->head->prev = NULL;
+        d->head_pos = 0;
+        cdeque__chunk_free(d, c);
+    }
+
+    return item;
+}
+
+/**
+ * @return the removed item, NULL if d is empty
+ */
+static inline void* cdeque_pop_back(cdeque_t* d) {
+    void* item;
+
+    if (d->len == 0)
+        return NULL;
+
+    item = d->tail->items[--d->tail_pos];
+    d->len--;
+
+    if (d->len == 0) {
+        cdeque__reset(d);
+    } else if (d->tail_pos == 0) {
+        cdeque_chunk_t* c = d->tail;
+
+        d->tail = c->prev;
+        d->tail->next = NULL;
+        d->tail_pos = CDEQUE_CHUNK;
+        cdeque__chunk_free(d, c);
+    }
+
+    return item;
+}
+
+static inline void cdeque_iter_init(cdeque_iter_t* it, const cdeque_t* d) {
+    it->d = d;
+    it->chunk = d->len ? d->head : NULL;
+    it->pos = d->head_pos;
+    it->end = d->head == d->tail ? d->tail_pos : CDEQUE_CHUNK;
+}
+
+/**
+ * @return 0 once every item was returned
+ */
+static inline int cdeque_iter_next(cdeque_iter_t* it, void** item) {
+    if (it->pos == it->end) {
+        if (it->chunk == NULL || it->chunk == it->d->tail)
+            return 0;
+
+        it->chunk = it->chunk->next;
+        it->pos = 0;
+        it->end = it->chunk == it->d->tail ? it->d->tail_pos : CDEQUE_CHUNK;
+    }
+
+    if (it->chunk == NULL)
+        return 0;
+
+    *item = it->chunk->items[it->pos++];
+    return 1;
+}
+
+#endif /* CDEQUE_H_ */
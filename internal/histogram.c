@@ -0,0 +1,120 @@
+#include "histogram.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define THREADS 4
+#define PER_THREAD 1000000
+#define SAMPLES 100000
+
+static histogram_t per_thread[THREADS];
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+static void* record_thread(void* arg) {
+    int seed_index = (int) (uintptr_t) arg;
+    uint64_t seed = seed_index + 1;
+    for (int i = 0; i < PER_THREAD; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        hist_record(&per_thread[seed_index], seed >> 40);
+    }
+    return NULL;
+}
+
+int main() {
+    /**
+     * Every value lands in a bucket whose upper bound is at most 1/16
+     * above it, and buckets are in value order.
+     */
+    uint64_t values[] = { 0, 1, 15, 16, 17, 31, 32, 33, 1000, 123456789,
+            1ULL << 40, UINT64_MAX };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        int b = hist_bucket(values[i]);
+        assert(b >= 0 && b < HIST_BUCKETS);
+        assert(hist_bucket_max(b) >= values[i]);
+        assert(hist_bucket_max(b) - values[i] <= values[i] / HIST_SUB);
+        assert(b == 0 || hist_bucket_max(b - 1) < values[i]);
+    }
+    assert(hist_bucket(UINT64_MAX) == HIST_BUCKETS - 1);
+
+    /**
+     * Percentiles against the exact ones of a skewed sample.
+     */
+    histogram_t h;
+    uint64_t* samples = malloc(SAMPLES * sizeof(uint64_t));
+    uint64_t seed = 42;
+    hist_init(&h);
+    for (int i = 0; i < SAMPLES; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        samples[i] = 1000 + (seed >> 33) % 1000 * ((seed >> 20) % 64 ? 1 : 100);
+        hist_record(&h, samples[i]);
+    }
+    qsort(samples, SAMPLES, sizeof(uint64_t), compare_u64);
+    double ps[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+    for (int i = 0; i < 5; ++i) {
+        uint64_t exact = samples[(uint64_t) (ps[i] * (SAMPLES - 1))];
+        uint64_t approx = hist_percentile(&h, ps[i]);
+        printf("p%-5g exact %7llu histogram %7llu\n", ps[i] * 100,
+                (unsigned long long) exact, (unsigned long long) approx);
+        assert(approx >= exact && approx - exact <= exact / HIST_SUB);
+    }
+    assert(hist_count(&h) == SAMPLES && h.max == samples[SAMPLES - 1]);
+
+    /**
+     * One histogram per thread, a reader merges them while they record
+     * and again once they are done.
+     */
+    pthread_t threads[THREADS];
+    histogram_t shared;
+    for (int i = 0; i < THREADS; ++i)
+        hist_init(&per_thread[i]);
+    uint64_t start = now_ns();
+    for (int i = 0; i < THREADS; ++i)
+        pthread_create(&threads[i], NULL, record_thread, (void*) (uintptr_t) i);
+    hist_init(&shared);
+    for (int i = 0; i < THREADS; ++i)
+        hist_merge(&shared, &per_thread[i]);
+    assert(hist_count(&shared) <= THREADS * PER_THREAD);
+    for (int i = 0; i < THREADS; ++i)
+        pthread_join(threads[i], NULL);
+    uint64_t elapsed = now_ns() - start;
+    hist_init(&shared);
+    for (int i = 0; i < THREADS; ++i)
+        hist_merge(&shared, &per_thread[i]);
+    assert(hist_count(&shared) == THREADS * PER_THREAD);
+    uint64_t total = 0;
+    for (int i = 0; i < HIST_BUCKETS; ++i)
+        total += shared.buckets[i];
+    assert(total == THREADS * PER_THREAD);
+    printf("%d threads, %d records each: %.1f ns per record\n",
+            THREADS, PER_THREAD, (double) elapsed * THREADS / (THREADS * PER_THREAD));
+
+    /**
+     * What tracing one message costs a single thread: a clock read and a
+     * record per stage.
+     */
+    hist_init(&h);
+    start = now_ns();
+    for (int i = 0; i < PER_THREAD; ++i)
+        hist_record(&h, now_ns() - start);
+    elapsed = now_ns() - start;
+    printf("clock read + record: %.1f ns\n", (double) elapsed / PER_THREAD);
+
+    hist_merge(&shared, &h);
+    assert(hist_count(&shared) == (THREADS + 1) * PER_THREAD);
+
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Log-linear histogram of 64 bit values (nanoseconds, bytes, ...).
+ *
+ * Values below 16 get a bucket each. Above that every power of two is
+ * split into HIST_SUB linear buckets, so a bucket is at most 1/16 of its
+ * value wide: reported percentiles are within 6.25% of the real ones.
+ * The whole uint64_t range fits in HIST_BUCKETS counters (7.6 KiB).
+ *
+ *   histogram_t h;
+ *
+ *   hist_init(&h);
+ *   hist_record(&h, uv_hrtime() - start);
+ *   printf("p99 %llu\n", (unsigned long long) hist_percentile(&h, 0.99));
+ *
+ * Lock-free with one writer per histogram: hist_record uses plain
+ * relaxed atomic loads and stores, no locked instructions, and readers on
+ * other threads never block it. A reader running concurrently sees a
+ * slightly stale but never torn picture. Threads that all record keep a
+ * histogram each and a reader sums them with hist_merge.
+ */
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} histogram_t;
+
+static inline void hist_init(histogram_t* h) {
+    memset(h, 0, sizeof(*h));
+}
+
+static inline int hist_bucket(uint64_t value) {
+    if (value < HIST_SUB)
+        return (int) value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (int) ((value >> shift) & (HIST_SUB - 1));
+}
+
+/**
+ * @return the largest value that falls into bucket
+ */
+static inline uint64_t hist_bucket_max(int bucket) {
+    if (bucket < HIST_SUB)
+        return bucket;
+    int shift = bucket / HIST_SUB - 1;
+    uint64_t low = (uint64_t) (HIST_SUB + bucket % HIST_SUB) << shift;
+    return low + ((uint64_t) 1 << shift) - 1;
+}
+
+/**
+ * Owner thread only.
+ */
+static inline void hist_record(histogram_t* h, uint64_t value) {
+    uint64_t* bucket = &h->buckets[hist_bucket(value)];
+
+    __atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum, h->sum + value, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+    if (value > h->max)
+        __atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t hist_count(const histogram_t* h) {
+    return __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t hist_mean(const histogram_t* h) {
+    uint64_t n = hist_count(h);
+    return n ? __atomic_load_n(&h->sum, __ATOMIC_RELAXED) / n : 0;
+}
+
+/**
+ * @param p between 0 and 1
+ * @return upper bound of the bucket holding the p-th value, never more
+ *         than the largest recorded value, 0 if empty
+ */
+static inline uint64_t hist_percentile(const histogram_t* h, double p) {
+    uint64_t n = 0;
+    uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+    /* sum the buckets instead of trusting count, it may run ahead */
+    for (int i = 0; i < HIST_BUCKETS; ++i)
+        n += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+    if (n == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t) (p * (n - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        seen += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            uint64_t v = hist_bucket_max(i);
+            return v < max ? v : max;
+        }
+    }
+    return max;
+}
+
+/**
+ * Adds the counts of from into into. from may still be recorded to by
+ * its owner, into must not be recorded to concurrently.
+ */
+static inline void hist_merge(histogram_t* into, const histogram_t* from) {
+    for (int i = 0; i < HIST_BUCKETS; ++i)
+        into->buckets[i] += __atomic_load_n(&from->buckets[i], __ATOMIC_RELAXED);
+    into->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+    into->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+    if (max > into->max)
+        into->max = max;
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef MPSCQ_H_
+#define MPSCQ_H_
+
+#include <stddef.h>
+
+/**
+ * Intrusive multi-producer single-consumer queue (Dmitry Vyukov's
+ * non-intrusive-stub design).
+ *
+ * Elements embed an MPSCQ_NODE like they embed a QUEUE for queue.h and
+ * are recovered with MPSCQ_DATA. Any thread may push, push never blocks
+ * and never loops. Only one thread may pop.
+ *
+ * pop can return NULL while a push is half done (the producer swapped
+ * the head but did not link the node yet). The node becomes visible once
+ * that producer returns, so a consumer that is woken after every push
+ * (uv_async_send) will see it on its next wakeup.
+ */
+
+typedef struct mpscq_node_s {
+    struct mpscq_node_s* volatile next;
+} MPSCQ_NODE;
+
+typedef struct {
+    MPSCQ_NODE* volatile head; // last pushed node, written by producers
+    char pad[64 - sizeof(void*)]; // keep producers off the consumer's line
+    MPSCQ_NODE* tail; // next node to pop, consumer only
+    MPSCQ_NODE stub;
+} MPSCQ;
+
+#define MPSCQ_DATA(ptr, type, field)                                          \
+  ((type *) ((char *) (ptr) - offsetof(type, field)))
+
+static inline void mpscq_init(MPSCQ* q) {
+    q->stub.next = NULL;
+    q->head = &q->stub;
+    q->tail = &q->stub;
+}
+
+/**
+ * Wait-free, callable from any thread.
+ */
+static inline void mpscq_push(MPSCQ* q, MPSCQ_NODE* n) {
+    MPSCQ_NODE* prev;
+
+    __atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&q->head, n, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+/**
+ * Consumer thread only.
+ * @return the oldest node, NULL if the queue is (or looks) empty
+ */
+static inline MPSCQ_NODE* mpscq_pop(MPSCQ* q) {
+    MPSCQ_NODE* tail = q->tail;
+    MPSCQ_NODE* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &q->stub) {
+        if (next == NULL)
+            return NULL;
+        q->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+
+    /* tail is the last node unless a push is in progress */
+    if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    /* re-insert the stub so tail can be handed out */
+    mpscq_push(q, &q->stub);
+
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+#endif /* MPSCQ_H_ */
@@ -0,0 +1,124 @@
+#include "pool.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Counts heap allocations of the whole process, to check that a warm
+ * pool serves every request without malloc. Forwards to glibc.
+ *
+ * This covers POOL_DEFINE only, tcp-echo-server/echo_alloc_test.c runs
+ * the echo server's own callbacks.
+ */
+#ifdef __GLIBC__
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static uint64_t malloc_calls = 0;
+
+void* malloc(size_t size) {
+    malloc_calls++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    malloc_calls++;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    malloc_calls++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/**
+ * Stand-ins for the echo server's client and write request, sized like
+ * the real ones (a uv_tcp_t is a few hundred bytes).
+ */
+struct conn_s {
+    char handle[248];
+    int paused;
+};
+
+struct write_req_s {
+    char req[192];
+    char* base;
+    size_t len;
+};
+
+POOL_DEFINE(conn_pool, struct conn_s)
+POOL_DEFINE(write_req_pool, struct write_req_s)
+
+void print_stats(const char* name, const pool_stats_t* stats) {
+    printf("%-15s capacity %zu, in use %zu, high water %zu, "
+            "gets %llu, puts %llu, grows %llu\n", name,
+            stats->capacity, stats->in_use, stats->high_water,
+            (unsigned long long) stats->gets, (unsigned long long) stats->puts,
+            (unsigned long long) stats->grows);
+}
+
+int main() {
+    conn_pool_t conns;
+    write_req_pool_t writes;
+    struct conn_s* open[64];
+    struct write_req_s* pending[256];
+
+    conn_pool_init(&conns, 16, 16);
+    write_req_pool_init(&writes, 64, 64);
+
+    /**
+     * Warm up: more clients and writes in flight than preallocated,
+     * the pools grow in chunks.
+     */
+    for (int i = 0; i < 64; ++i)
+        open[i] = conn_pool_get(&conns);
+    for (int i = 0; i < 256; ++i)
+        pending[i] = write_req_pool_get(&writes);
+    for (int i = 0; i < 64; ++i)
+        conn_pool_put(&conns, open[i]);
+    for (int i = 0; i < 256; ++i)
+        write_req_pool_put(&writes, pending[i]);
+
+    print_stats("conn_pool", &conns.stats);
+    print_stats("write_req_pool", &writes.stats);
+
+    /**
+     * Steady state: gets and puts of a warm pool never go to the heap.
+     */
+#ifdef __GLIBC__
+    uint64_t before = malloc_calls;
+    assert(before >= 8); // the counter sees the chunk allocations
+#endif
+    for (int round = 0; round < 100000; ++round) {
+        int clients = 1 + round % 64;
+        for (int i = 0; i < clients; ++i) {
+            open[i] = conn_pool_get(&conns);
+            open[i]->paused = 0;
+        }
+        for (int i = 0; i < 4 * clients; ++i) {
+            pending[i] = write_req_pool_get(&writes);
+            pending[i]->len = i;
+        }
+        for (int i = 0; i < 4 * clients; ++i)
+            write_req_pool_put(&writes, pending[i]);
+        for (int i = 0; i < clients; ++i)
+            conn_pool_put(&conns, open[i]);
+    }
+#ifdef __GLIBC__
+    printf("malloc calls in steady state: %llu\n",
+            (unsigned long long) (malloc_calls - before));
+    assert(malloc_calls == before);
+#endif
+
+    print_stats("conn_pool", &conns.stats);
+    print_stats("write_req_pool", &writes.stats);
+    assert(conns.stats.in_use == 0 && writes.stats.in_use == 0);
+    assert(conns.stats.grows == 4 && writes.stats.grows == 4);
+
+    conn_pool_destroy(&conns);
+    write_req_pool_destroy(&writes);
+
+    return 0;
+}
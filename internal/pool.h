@@ -0,0 +1,109 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Typed free-list pools for handles and requests.
+ *
+ *   typedef struct { uv_write_t req; uv_buf_t buf; } write_req_t;
+ *   POOL_DEFINE(write_req_pool, write_req_t)
+ *
+ * defines write_req_pool_t and write_req_pool_init(), _get(), _put() and
+ * _destroy(). Objects come from chunks of chunk_size slots which are
+ * never returned to malloc before _destroy, so once the pool reached its
+ * working size _get and _put do not allocate. A slot is reused as the
+ * free-list link while the object is in the pool, _get does not clear it.
+ *
+ * Not thread safe, meant for objects owned by one loop.
+ */
+
+typedef struct {
+    size_t capacity; // objects allocated in chunks
+    size_t in_use; // handed out by _get, not returned yet
+    size_t high_water; // largest in_use seen
+    uint64_t gets;
+    uint64_t puts;
+    uint64_t grows; // chunks allocated
+} pool_stats_t;
+
+#define POOL_DEFINE(name, type)                                               \
+  typedef union name##_slot_u {                                               \
+    type obj;                                                                 \
+    union name##_slot_u* next; /* free list, or chunk list in slot 0 */       \
+  } name##_slot_t;                                                            \
+                                                                              \
+  typedef struct {                                                            \
+    pool_stats_t stats;                                                       \
+    size_t chunk_size;                                                        \
+    name##_slot_t* free;                                                      \
+    name##_slot_t* chunks;                                                    \
+  } name##_t;                                                                 \
+                                                                              \
+  /* adds chunk_size objects, slot 0 of a chunk links the chunks */          \
+  static inline int name##_grow(name##_t* p, size_t n) {                      \
+    name##_slot_t* chunk =                                                    \
+        (name##_slot_t*) malloc((n + 1) * sizeof(name##_slot_t));             \
+    if (chunk == NULL) return -1;                                             \
+    chunk[0].next = p->chunks;                                                \
+    p->chunks = chunk;                                                        \
+    for (size_t i = n; i > 0; --i) {                                          \
+      chunk[i].next = p->free;                                                \
+      p->free = &chunk[i];                                                    \
+    }                                                                         \
+    p->stats.capacity += n;                                                   \
+    p->stats.grows++;                                                         \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
+  /* preallocates initial objects, grows by chunk_size afterwards */         \
+  static inline int name##_init(name##_t* p, size_t initial,                  \
+                                size_t chunk_size) {                          \
+    p->stats.capacity = 0;                                                    \
+    p->stats.in_use = 0;                                                      \
+    p->stats.high_water = 0;                                                  \
+    p->stats.gets = 0;                                                        \
+    p->stats.puts = 0;                                                        \
+    p->stats.grows = 0;                                                       \
+    p->chunk_size = chunk_size ? chunk_size : 1;                              \
+    p->free = NULL;                                                           \
+    p->chunks = NULL;                                                         \
+    return initial ? name##_grow(p, initial) : 0;                             \
+  }                                                                           \
+                                                                              \
+  /* NULL only if growing failed */                                           \
+  static inline type* name##_get(name##_t* p) {                               \
+    name##_slot_t* slot = p->free;                                            \
+    if (slot == NULL) {                                                       \
+      if (name##_grow(p, p->chunk_size)) return NULL;                         \
+      slot = p->free;                                                         \
+    }                                                                         \
+    p->free = slot->next;                                                     \
+    p->stats.gets++;                                                          \
+    if (++p->stats.in_use > p->stats.high_water)                              \
+      p->stats.high_water = p->stats.in_use;                                  \
+    return &slot->obj;                                                        \
+  }                                                                           \
+                                                                              \
+  static inline void name##_put(name##_t* p, type* obj) {                     \
+    name##_slot_t* slot = (name##_slot_t*) obj;                               \
+    slot->next = p->free;                                                     \
+    p->free = slot;                                                           \
+    p->stats.puts++;                                                          \
+    p->stats.in_use--;                                                        \
+  }                                                                           \
+                                                                              \
+  /* frees every chunk, objects still in use become invalid */               \
+  static inline void name##_destroy(name##_t* p) {                            \
+    while (p->chunks != NULL) {                                               \
+      name##_slot_t* next = p->chunks[0].next;                                \
+      free(p->chunks);                                                        \
+      p->chunks = next;                                                       \
+    }                                                                         \
+    p->free = NULL;                                                           \
+    p->stats.capacity = 0;                                                    \
+  }
+
+#endif /* POOL_H_ */
@@ -0,0 +1,81 @@
+#include "tqueue.h"
+#include <stdio.h>
+
+/**
+ * Our item struct we want to store in the list.
+ * Same embedding as in queue.c, the list adds no allocation.
+ */
+struct user_s {
+    int age;
+    char* name;
+
+    QUEUE node;
+};
+
+/**
+ * Generates user_list_t and its typed functions.
+ */
+TQUEUE_DEFINE(user_list, struct user_s, node)
+
+int main() {
+    struct user_s* user;
+    QUEUE* tmp;
+
+    /**
+     * Two owners of users.
+     */
+    user_list_t young;
+    user_list_t old;
+
+    struct user_s users[] = {
+        { 44, "john" },
+        { 32, "henry" },
+        { 99, "willy" },
+        { 18, "tom" }
+    };
+
+    user_list_init(&young);
+    user_list_init(&old);
+
+    /**
+     * Everybody starts in the young list.
+     */
+    for (int i = 0; i < 4; ++i)
+        user_list_push_back(&young, &users[i]);
+
+    printf("young users: %zu\n", user_list_len(&young));
+
+    /**
+     * Move everybody over 40 while iterating.
+     */
+    TQUEUE_FOREACH_SAFE(user, tmp, &young, struct user_s, node) {
+        if (user->age > 40) {
+            user_list_remove(&young, user);
+            user_list_push_back(&old, user);
+        }
+    }
+
+    printf("young users: %zu, old users: %zu\n",
+            user_list_len(&young), user_list_len(&old));
+
+    /**
+     * Hand the whole young list over in one step.
+     */
+    user_list_splice(&old, &young);
+
+    printf("young users: %zu, old users: %zu\n",
+            user_list_len(&young), user_list_len(&old));
+
+    /**
+     * Drain from both ends.
+     */
+    while ((user = user_list_pop_front(&old)) != NULL) {
+        printf("Received user: %s who is %d.\n", user->name, user->age);
+
+        if ((user = user_list_pop_back(&old)) != NULL)
+            printf("Received user from the back: %s who is %d.\n",
+                    user->name, user->age);
+    }
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#ifndef TQUEUE_H_
+#define TQUEUE_H_
+
+#include <stddef.h>
+#include "queue.h"
+
+/**
+ * Typed intrusive lists on top of queue.h.
+ *
+ * Elements embed a plain QUEUE node, exactly like struct user_s in
+ * queue.c, so nothing is allocated. The list head adds an element count:
+ *
+ *   struct user_s { int age; QUEUE node; };
+ *   TQUEUE_DEFINE(user_list, struct user_s, node)
+ *
+ * defines user_list_t and user_list_init(), _len(), _empty(), _first(),
+ * _last(), _next(), _prev(), _push_front(), _push_back(), _pop_front(),
+ * _pop_back(), _remove() and _splice(). Every operation is O(1).
+ */
+
+/**
+ * Iterates over raw QUEUE nodes, q may be removed inside the loop.
+ */
+#define QUEUE_FOREACH_SAFE(q, n, h)                                           \
+  for ((q) = QUEUE_NEXT(h), (n) = QUEUE_NEXT(q);                              \
+       (q) != (h);                                                            \
+       (q) = (n), (n) = QUEUE_NEXT(q))
+
+/**
+ * Iterates over the elements of a typed list, var may be removed (or
+ * pushed to another list) inside the loop. tmp is a scratch QUEUE *.
+ */
+#define TQUEUE_FOREACH_SAFE(var, tmp, list, type, field)                      \
+  for ((var) = QUEUE_EMPTY(&(list)->head) ? NULL :                            \
+           QUEUE_DATA(QUEUE_HEAD(&(list)->head), type, field),                \
+       (tmp) = (var) ? (QUEUE *) QUEUE_NEXT(&(var)->field) : NULL;            \
+       (var) != NULL;                                                         \
+       (var) = (tmp) == &(list)->head ? NULL :                                \
+           QUEUE_DATA((tmp), type, field),                                    \
+       (tmp) = (var) ? (QUEUE *) QUEUE_NEXT(&(var)->field) : NULL)
+
+#define TQUEUE_DEFINE(name, type, field)                                      \
+  typedef struct {                                                            \
+    QUEUE head;                                                               \
+    size_t len;                                                               \
+  } name##_t;                                                                 \
+                                                                              \
+  static inline void name##_init(name##_t* l) {                               \
+    QUEUE_INIT(&l->head);                                                     \
+    l->len = 0;                                                               \
+  }                                                                           \
+                                                                              \
+  static inline size_t name##_len(const name##_t* l) {                        \
+    return l->len;                                                            \
+  }                                                                           \
+                                                                              \
+  static inline int name##_empty(const name##_t* l) {                         \
+    return l->len == 0;                                                       \
+  }                                                                           \
+                                                                              \
+  static inline type* name##_first(name##_t* l) {                             \
+    if (QUEUE_EMPTY(&l->head)) return NULL;                                   \
+    return QUEUE_DATA(QUEUE_NEXT(&l->head), type, field);                     \
+  }                                                                           \
+                                                                              \
+  static inline type* name##_last(name##_t* l) {                              \
+    if (QUEUE_EMPTY(&l->head)) return NULL;                                   \
+    return QUEUE_DATA(QUEUE_PREV(&l->head), type, field);                     \
+  }                                                                           \
+                                                                              \
+  static inline type* name##_next(name##_t* l, type* e) {                     \
+    QUEUE* q = (QUEUE*) QUEUE_NEXT(&e->field);                                \
+    return q == &l->head ? NULL : QUEUE_DATA(q, type, field);                 \
+  }                                                                           \
+                                                                              \
+  static inline type* name##_prev(name##_t* l, type* e) {                     \
+    QUEUE* q = (QUEUE*) QUEUE_PREV(&e->field);                                \
+    return q == &l->head ? NULL : QUEUE_DATA(q, type, field);                 \
+  }                                                                           \
+                                                                              \
+  static inline void name##_push_front(name##_t* l, type* e) {                \
+    QUEUE_INSERT_HEAD(&l->head, &e->field);                                   \
+    l->len++;                                                                 \
+  }                                                                           \
+                                                                              \
+  static inline void name##_push_back(name##_t* l, type* e) {                 \
+    QUEUE_INSERT_TAIL(&l->head, &e->field);                                   \
+    l->len++;                                                                 \
+  }                                                                           \
+                                                                              \
+  /* e must be on l, its node is reset so a second remove is harmless */     \
+  static inline void name##_remove(name##_t* l, type* e) {                    \
+    QUEUE_REMOVE(&e->field);                                                  \
+    QUEUE_INIT(&e->field);                                                    \
+    l->len--;                                                                 \
+  }                                                                           \
+                                                                              \
+  static inline type* name##_pop_front(name##_t* l) {                         \
+    type* e = name##_first(l);                                                \
+    if (e != NULL) name##_remove(l, e);                                       \
+    return e;                                                                 \
+  }                                                                           \
+                                                                              \
+  static inline type* name##_pop_back(name##_t* l) {                          \
+    type* e = name##_last(l);                                                 \
+    if (e != NULL) name##_remove(l, e);                                       \
+    return e;                                                                 \
+  }                                                                           \
+                                                                              \
+  /* moves every element of src to the tail of dst, src ends up empty */     \
+  static inline void name##_splice(name##_t* dst, name##_t* src) {            \
+    if (QUEUE_EMPTY(&src->head)) return;                                      \
+    QUEUE_ADD(&dst->head, &src->head);                                        \
+    QUEUE_INIT(&src->head);                                                   \
+    dst->len += src->len;                                                     \
+    src->len = 0;                                                             \
+  }
+
+#endif /* TQUEUE_H_ */
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Compares `uv_shell cp -r` with `cp -r`.
+#
+#   ./bench_cp.sh [DIR...]
+#
+# Builds a tree of many small files and a few large ones inside every DIR
+# (defaults to tmpfs and /var/tmp as the disk) and times both copies.
+# Page cache is not dropped, run as root with DROP_CACHES=1 for cold runs.
+
+JOBS=${JOBS:-16}
+SMALL=${SMALL:-20000}
+LARGE=${LARGE:-4}
+
+[ $# -eq 0 ] && set -- /dev/shm /var/tmp
+
+for dir in "$@"; do
+    base="$dir/uv-shell-cp-bench"
+    rm -rf "$base" && mkdir -p "$base/src"
+
+    i=0
+    while [ $i -lt $SMALL ]; do
+        sub="$base/src/d$((i / 1000))"
+        [ -d "$sub" ] || mkdir "$sub"
+        head -c $((i % 8192)) /dev/urandom > "$sub/f$i"
+        i=$((i + 1))
+    done
+    i=0
+    while [ $i -lt $LARGE ]; do
+        head -c $((64 * 1024 * 1024)) /dev/urandom > "$base/src/large$i"
+        i=$((i + 1))
+    done
+    sync
+
+    echo "== $dir ($SMALL small files, $LARGE x 64 MiB)"
+
+    [ -n "$DROP_CACHES" ] && echo 3 > /proc/sys/vm/drop_caches
+    start=$(date +%s.%N)
+    cp -r "$base/src" "$base/cp"
+    end=$(date +%s.%N)
+    echo "cp -r          $(awk "BEGIN { print $end - $start }") s"
+
+    [ -n "$DROP_CACHES" ] && echo 3 > /proc/sys/vm/drop_caches
+    start=$(date +%s.%N)
+    ./uv_shell.o cp -r "$base/src" "$base/uv" $JOBS
+    end=$(date +%s.%N)
+    echo "uv_shell cp -r $(awk "BEGIN { print $end - $start }") s"
+
+    rm -rf "$base"
+done
@@ -1,14 +1,58 @@
 #include "uv_shell.h"
+#include <stdlib.h>
+#include <string.h>
 
 uv_loop_t* loop;
 
 uv_fs_t request;
 
+/**
+ * A file with several hard links du counted already.
+ */
+typedef struct du_inode_s {
+    struct du_inode_s * next; // hash chain
+    uint64_t dev;
+    uint64_t ino;
+} du_inode_t;
+
+/**
+ * Totals collected by du.
+ */
+typedef struct {
+    const char * root;
+    uint64_t bytes; // allocated bytes (st_blocks * 512)
+    uint64_t files;
+    uint64_t dirs;
+    uint64_t start; // uv_hrtime() at start
+    du_inode_t ** inodes; // hash table, files with st_nlink > 1
+    size_t nbuckets;
+    size_t ninodes;
+} du_summary_t;
+
+#define DU_INITIAL_BUCKETS 256
+
+uv_tree_walk_t du_walk;
+
+du_summary_t du_summary;
+
+uv_tree_copy_t cp_copy;
+
+uint64_t cp_start;
+
 int main(int argc, const char ** argv) {
     loop = uv_default_loop();
 
     if (!strcmp(argv[1], "mv")) {
         uv_shell_mv(argv[2], argv[3]);
+    } else if (!strcmp(argv[1], "du")) {
+        const char * path = argc > 2 ? argv[2] : ".";
+        int max_requests = argc > 3 ? atoi(argv[3]) : 0;
+
+        uv_shell_du(path, max_requests);
+    } else if (!strcmp(argv[1], "cp") && argc > 4 && !strcmp(argv[2], "-r")) {
+        int max_jobs = argc > 5 ? atoi(argv[5]) : 0;
+
+        uv_shell_cp(argv[3], argv[4], max_jobs);
     }
 
     uv_run(loop, UV_RUN_DEFAULT);
@@ -28,3 +72,156 @@ void uv_shell_mv(const char * old_path, const char * new_path) {
 
     uv_fs_req_cleanup(&request);
 };
+
+static size_t du_bucket(const du_summary_t * summary, uint64_t dev,
+        uint64_t ino) {
+    uint64_t h = (ino ^ (dev << 32 | dev >> 32)) * 0x9e3779b97f4a7c15ull;
+
+    return (size_t) (h >> 32) & (summary->nbuckets - 1);
+}
+
+/**
+ * Remembers dev and ino, the table doubles once it holds a file per
+ * bucket.
+ * @return 1 if it was seen before
+ */
+int du_inode_seen(du_summary_t * summary, uint64_t dev, uint64_t ino) {
+    du_inode_t * inode;
+
+    if (summary->nbuckets > 0) {
+        inode = summary->inodes[du_bucket(summary, dev, ino)];
+        for (; inode != NULL; inode = inode->next) {
+            if (inode->dev == dev && inode->ino == ino)
+                return 1;
+        }
+    }
+
+    if (summary->ninodes >= summary->nbuckets) {
+        size_t old_nbuckets = summary->nbuckets;
+        du_inode_t ** old = summary->inodes;
+        size_t nbuckets = old_nbuckets ? 2 * old_nbuckets : DU_INITIAL_BUCKETS;
+        du_inode_t ** inodes = (du_inode_t **) calloc(nbuckets,
+                sizeof(du_inode_t *));
+
+        /* out of memory, the file may be counted twice */
+        if (inodes == NULL)
+            return 0;
+
+        summary->inodes = inodes;
+        summary->nbuckets = nbuckets;
+        for (size_t i = 0; i < old_nbuckets; ++i) {
+            while (old[i] != NULL) {
+                du_inode_t * next = old[i]->next;
+                size_t b = du_bucket(summary, old[i]->dev, old[i]->ino);
+
+                old[i]->next = inodes[b];
+                inodes[b] = old[i];
+                old[i] = next;
+            }
+        }
+        free(old);
+    }
+
+    inode = (du_inode_t *) malloc(sizeof(du_inode_t));
+    if (inode == NULL)
+        return 0;
+    inode->dev = dev;
+    inode->ino = ino;
+    inode->next = summary->inodes[du_bucket(summary, dev, ino)];
+    summary->inodes[du_bucket(summary, dev, ino)] = inode;
+    summary->ninodes++;
+
+    return 0;
+}
+
+void du_inodes_free(du_summary_t * summary) {
+    for (size_t i = 0; i < summary->nbuckets; ++i) {
+        while (summary->inodes[i] != NULL) {
+            du_inode_t * next = summary->inodes[i]->next;
+
+            free(summary->inodes[i]);
+            summary->inodes[i] = next;
+        }
+    }
+    free(summary->inodes);
+    summary->inodes = NULL;
+    summary->nbuckets = 0;
+    summary->ninodes = 0;
+}
+
+void du_entry_cb(uv_tree_walk_t * walk, const char * path,
+        const uv_statbuf_t * stat) {
+    du_summary_t * summary = (du_summary_t *) walk->data;
+
+    if (stat == NULL) {
+        fprintf(stderr, "du: cannot access %s: %s.\n", path,
+                uv_strerror(uv_last_error(loop)));
+        return;
+    }
+
+    /* like du, every further link to a file is not counted again */
+    if (S_ISREG(stat->st_mode) && stat->st_nlink > 1
+            && du_inode_seen(summary, stat->st_dev, stat->st_ino))
+        return;
+
+    summary->bytes += (uint64_t) stat->st_blocks * 512;
+
+    if (S_ISDIR(stat->st_mode))
+        summary->dirs++;
+    else
+        summary->files++;
+}
+
+void du_done_cb(uv_tree_walk_t * walk) {
+    du_summary_t * summary = (du_summary_t *) walk->data;
+    double elapsed_ms = (uv_hrtime() - summary->start) / 1e6;
+
+    printf("%llu\t%s\n", (unsigned long long) (summary->bytes / 1024),
+            summary->root);
+    fprintf(stderr, "%llu files, %llu directories, %llu errors in %.1f ms\n",
+            (unsigned long long) summary->files,
+            (unsigned long long) summary->dirs,
+            (unsigned long long) walk->errors, elapsed_ms);
+    du_inodes_free(summary);
+}
+
+/**
+ * Prints the disk usage of path in KiB like `du -sk`.
+ * Up to max_requests readdir/stat requests run in the threadpool at once.
+ */
+void uv_shell_du(const char * path, int max_requests) {
+    memset(&du_summary, 0, sizeof(du_summary));
+    du_summary.root = path;
+    du_summary.start = uv_hrtime();
+    du_walk.data = &du_summary;
+
+    int r = uv_tree_walk_start(&du_walk, loop, path, max_requests,
+            du_entry_cb, du_done_cb);
+
+    if (r) fprintf(stderr, "du: cannot start walking %s.\n", path);
+}
+
+void cp_done_cb(uv_tree_copy_t * copy) {
+    double elapsed_ms = (uv_hrtime() - cp_start) / 1e6;
+
+    fprintf(stderr, "%llu files, %llu directories, %llu links, %llu bytes, "
+            "%llu errors in %.1f ms\n",
+            (unsigned long long) copy->files,
+            (unsigned long long) copy->dirs,
+            (unsigned long long) copy->links,
+            (unsigned long long) copy->bytes,
+            (unsigned long long) copy->errors, elapsed_ms);
+}
+
+/**
+ * Copies src to dst recursively like `cp -r`.
+ * Up to max_jobs files (or ranges of large files) are copied at once.
+ */
+void uv_shell_cp(const char * src, const char * dst, int max_jobs) {
+    cp_start = uv_hrtime();
+
+    int r = uv_tree_copy_start(&cp_copy, loop, src, dst, max_jobs,
+            cp_done_cb);
+
+    if (r) fprintf(stderr, "cp: cannot start copying %s.\n", src);
+}
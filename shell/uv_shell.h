@@ -3,6 +3,8 @@
 
 #include "uv.h"
 #include "stdio.h"
+#include "uv_tree_walk.h"
+#include "uv_tree_copy.h"
 
 void print_last_error();
 
@@ -18,4 +20,8 @@ void uv_shell_chown(const char * path, int uid, int gid);
 
 void uv_shell_chmod(const char * path, int mode);
 
+void uv_shell_du(const char * path, int max_requests);
+
+void uv_shell_cp(const char * src, const char * dst, int max_jobs);
+
 #endif
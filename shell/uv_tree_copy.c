@@ -0,0 +1,632 @@
+#include "uv_tree_copy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/**
+ * One file being copied.
+ */
+typedef struct {
+    uv_tree_copy_t* copy;
+    char* src;
+    char* dst;
+    int mode;
+    uint64_t size;
+    int in_fd;
+    int out_fd;
+    int ranges_left; // range work items not finished yet
+    int error; // first errno seen
+} copy_file_t;
+
+typedef enum {
+    COPY_WHOLE, // open, preallocate, copy and close a small file
+    COPY_OPEN, // open and preallocate a large file
+    COPY_RANGE, // copy one range of a large file
+    COPY_CLOSE // close a large file
+} copy_kind_t;
+
+/**
+ * One threadpool work item.
+ */
+typedef struct {
+    uv_work_t req;
+    QUEUE node;
+    copy_file_t* file;
+    copy_kind_t kind;
+    uint64_t offset;
+    uint64_t len;
+    uint64_t copied;
+    int error;
+} copy_work_t;
+
+/**
+ * A directory the copy made, it gets the source mode at the end.
+ */
+typedef struct {
+    QUEUE node;
+    uv_fs_t req;
+    uv_tree_copy_t* copy;
+    char* dst;
+    int mode;
+} copy_dir_t;
+
+/**
+ * A symlink being copied: readlink, then symlink.
+ */
+typedef struct {
+    uv_fs_t req;
+    uv_tree_copy_t* copy;
+    char* src;
+    char* dst;
+} copy_link_t;
+
+static void after_work_cb(uv_work_t* req, int status);
+
+static void submit(uv_tree_copy_t* copy, copy_file_t* file, copy_kind_t kind,
+        uint64_t offset, uint64_t len) {
+    copy_work_t* w = (copy_work_t*) malloc(sizeof(copy_work_t));
+
+    w->req.data = w;
+    w->file = file;
+    w->kind = kind;
+    w->offset = offset;
+    w->len = len;
+    w->copied = 0;
+    w->error = 0;
+    QUEUE_INSERT_TAIL(&copy->pending, &w->node);
+    copy->pending_count++;
+}
+
+static void chmod_cb(uv_fs_t* req);
+
+/**
+ * Applies the source modes to the directories made, newest first: a
+ * directory may lose its write or search bit only after its children.
+ */
+static void apply_modes(uv_tree_copy_t* copy) {
+    while (!QUEUE_EMPTY(&copy->dirs_made)) {
+        QUEUE* q = QUEUE_HEAD(&copy->dirs_made);
+        copy_dir_t* dir = QUEUE_DATA(q, copy_dir_t, node);
+
+        QUEUE_REMOVE(q);
+        if (uv_fs_chmod(copy->loop, &dir->req, dir->dst, dir->mode,
+                chmod_cb) == 0)
+            return;
+        copy->errors++;
+        fprintf(stderr, "cp: cannot set the mode of %s: %s.\n", dir->dst,
+                uv_strerror(uv_last_error(copy->loop)));
+        free(dir->dst);
+        free(dir);
+    }
+
+    free(copy->target);
+    copy->target = NULL;
+    if (copy->done_cb != NULL)
+        copy->done_cb(copy);
+}
+
+static void chmod_cb(uv_fs_t* req) {
+    copy_dir_t* dir = (copy_dir_t*) req->data;
+    uv_tree_copy_t* copy = dir->copy;
+
+    if (req->result == -1) {
+        copy->errors++;
+        fprintf(stderr, "cp: cannot set the mode of %s: %s.\n", dir->dst,
+                uv_strerror(uv_last_error(copy->loop)));
+    }
+    uv_fs_req_cleanup(req);
+    free(dir->dst);
+    free(dir);
+    apply_modes(copy);
+}
+
+static void maybe_done(uv_tree_copy_t* copy) {
+    if (copy->walking || copy->finishing || copy->active_jobs > 0 ||
+            copy->fs_requests > 0 || !QUEUE_EMPTY(&copy->pending))
+        return;
+    copy->finishing = 1;
+    apply_modes(copy);
+}
+
+static void pump(uv_tree_copy_t* copy);
+static void maybe_resume(uv_tree_copy_t* copy);
+
+/**
+ * Copies len bytes at offset between the two fds of file.
+ * Uses copy_file_range where the kernel has it, pread/pwrite otherwise.
+ */
+static int copy_range(copy_work_t* w) {
+    copy_file_t* file = w->file;
+    int64_t off = w->offset;
+    uint64_t left = w->len;
+
+#if defined(__linux__) && defined(SYS_copy_file_range)
+    while (left > 0) {
+        loff_t in_off = off;
+        loff_t out_off = off;
+        long n = syscall(SYS_copy_file_range, file->in_fd, &in_off,
+                file->out_fd, &out_off, (size_t) left, 0);
+
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1) {
+            if (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                    errno == EOPNOTSUPP)
+                break;
+            return errno;
+        }
+        if (n == 0)
+            return 0; // source shrank
+        off += n;
+        left -= n;
+        w->copied += n;
+    }
+#endif
+
+    char buf[64 * 1024];
+
+    while (left > 0) {
+        ssize_t n = pread(file->in_fd, buf,
+                left < sizeof(buf) ? left : sizeof(buf), off);
+
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return errno;
+        if (n == 0)
+            return 0;
+
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t m = pwrite(file->out_fd, buf + done, n - done, off + done);
+
+            if (m == -1 && errno == EINTR)
+                continue;
+            if (m == -1)
+                return errno;
+            done += m;
+        }
+        off += n;
+        left -= n;
+        w->copied += n;
+    }
+
+    return 0;
+}
+
+static int open_files(copy_file_t* file) {
+    file->in_fd = open(file->src, O_RDONLY | O_CLOEXEC);
+    if (file->in_fd == -1)
+        return errno;
+
+    file->out_fd = open(file->dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            file->mode);
+    if (file->out_fd == -1) {
+        int err = errno;
+
+        close(file->in_fd);
+        file->in_fd = -1;
+        return err;
+    }
+
+    /* preallocation is only a hint, ignore filesystems without it */
+    if (file->size > 0)
+        posix_fallocate(file->out_fd, 0, file->size);
+
+    return 0;
+}
+
+static void close_files(copy_file_t* file) {
+    if (file->in_fd != -1)
+        close(file->in_fd);
+    if (file->out_fd != -1)
+        close(file->out_fd);
+    file->in_fd = -1;
+    file->out_fd = -1;
+}
+
+/**
+ * Runs in the threadpool.
+ */
+static void work_cb(uv_work_t* req) {
+    copy_work_t* w = (copy_work_t*) req->data;
+
+    switch (w->kind) {
+        case COPY_WHOLE:
+            w->error = open_files(w->file);
+            if (w->error == 0) {
+                w->error = copy_range(w);
+                close_files(w->file);
+            }
+            break;
+        case COPY_OPEN:
+            w->error = open_files(w->file);
+            break;
+        case COPY_RANGE:
+            w->error = copy_range(w);
+            break;
+        case COPY_CLOSE:
+            close_files(w->file);
+            break;
+    }
+}
+
+static void file_free(copy_file_t* file) {
+    free(file->src);
+    free(file->dst);
+    free(file);
+}
+
+/**
+ * Accounts for a finished work item and submits what follows it.
+ * @param ran 0 if the item never ran in the threadpool
+ */
+static void finish_work(copy_work_t* w, int ran) {
+    copy_file_t* file = w->file;
+    uv_tree_copy_t* copy = file->copy;
+
+    if (!ran) {
+        if (w->kind == COPY_CLOSE)
+            close_files(file); /* cheap enough for the loop thread */
+        else if (!w->error)
+            w->error = ECANCELED;
+    }
+
+    copy->bytes += w->copied;
+
+    if (w->error && !file->error) {
+        file->error = w->error;
+        copy->errors++;
+        fprintf(stderr, "cp: %s: %s.\n", file->src, strerror(w->error));
+    }
+
+    switch (w->kind) {
+        case COPY_WHOLE:
+        case COPY_CLOSE:
+            if (!file->error)
+                copy->files++;
+            file_free(file);
+            break;
+        case COPY_OPEN:
+            if (file->error) {
+                file_free(file);
+                break;
+            }
+            for (uint64_t off = 0; off < file->size;
+                    off += UV_TREE_COPY_RANGE_SIZE) {
+                uint64_t len = file->size - off;
+
+                if (len > UV_TREE_COPY_RANGE_SIZE)
+                    len = UV_TREE_COPY_RANGE_SIZE;
+                file->ranges_left++;
+                submit(copy, file, COPY_RANGE, off, len);
+            }
+            break;
+        case COPY_RANGE:
+            if (--file->ranges_left == 0)
+                submit(copy, file, COPY_CLOSE, 0, 0);
+            break;
+    }
+
+    free(w);
+}
+
+static void after_work_cb(uv_work_t* req, int status) {
+    copy_work_t* w = (copy_work_t*) req->data;
+    uv_tree_copy_t* copy = w->file->copy;
+
+    copy->active_jobs--;
+    finish_work(w, status == 0);
+    pump(copy);
+
+    /* the walk's done callback runs maybe_done itself */
+    if (!copy->walking)
+        maybe_done(copy);
+    else
+        maybe_resume(copy);
+}
+
+static void pump(uv_tree_copy_t* copy) {
+    while (copy->active_jobs < copy->max_jobs && !QUEUE_EMPTY(&copy->pending)) {
+        QUEUE* q = QUEUE_HEAD(&copy->pending);
+        copy_work_t* w = QUEUE_DATA(q, copy_work_t, node);
+
+        QUEUE_REMOVE(q);
+        copy->pending_count--;
+        if (uv_queue_work(copy->loop, &w->req, work_cb, after_work_cb)) {
+            /* may submit a close, which the next round picks up */
+            finish_work(w, 0);
+            continue;
+        }
+        copy->active_jobs++;
+    }
+}
+
+static char* dst_path(uv_tree_copy_t* copy, const char* path) {
+    const char* rest = path + copy->src_len;
+    size_t dst_len = strlen(copy->target);
+    char* dst = (char*) malloc(dst_len + strlen(rest) + 2);
+
+    memcpy(dst, copy->target, dst_len);
+    /* src given with a trailing slash */
+    if (rest[0] != '\0' && rest[0] != '/')
+        dst[dst_len++] = '/';
+    strcpy(dst + dst_len, rest);
+
+    return dst;
+}
+
+/**
+ * Goes on with the walk once no mkdir is in flight and the copies caught
+ * up. Not from entry_cb.
+ */
+static void maybe_resume(uv_tree_copy_t* copy) {
+    if (copy->mkdirs == 0 && copy->pending_count < copy->max_jobs)
+        uv_tree_walk_resume(&copy->walk);
+}
+
+/**
+ * After an fs request of the copy finished.
+ */
+static void fs_request_done(uv_tree_copy_t* copy) {
+    copy->fs_requests--;
+
+    /* the walk's done callback runs maybe_done itself */
+    if (!copy->walking)
+        maybe_done(copy);
+    else
+        maybe_resume(copy);
+}
+
+static void link_free(copy_link_t* link) {
+    free(link->src);
+    free(link->dst);
+    free(link);
+}
+
+static void symlink_cb(uv_fs_t* req) {
+    copy_link_t* link = (copy_link_t*) req->data;
+    uv_tree_copy_t* copy = link->copy;
+
+    if (req->result == -1) {
+        copy->errors++;
+        fprintf(stderr, "cp: %s: %s.\n", link->dst,
+                uv_strerror(uv_last_error(copy->loop)));
+    } else {
+        copy->links++;
+    }
+    uv_fs_req_cleanup(req);
+    link_free(link);
+    fs_request_done(copy);
+}
+
+static void readlink_cb(uv_fs_t* req) {
+    copy_link_t* link = (copy_link_t*) req->data;
+    uv_tree_copy_t* copy = link->copy;
+    char* target = NULL;
+
+    if (req->result != -1)
+        target = strdup((const char*) req->ptr);
+    uv_fs_req_cleanup(req);
+
+    if (target != NULL && uv_fs_symlink(copy->loop, &link->req, target,
+            link->dst, 0, symlink_cb) == 0) {
+        /* the request keeps its own copy of the paths */
+        free(target);
+        return;
+    }
+
+    free(target);
+    copy->errors++;
+    fprintf(stderr, "cp: %s: %s.\n", link->src,
+            uv_strerror(uv_last_error(copy->loop)));
+    link_free(link);
+    fs_request_done(copy);
+}
+
+static void copy_symlink(uv_tree_copy_t* copy, const char* path, char* dst) {
+    copy_link_t* link = (copy_link_t*) malloc(sizeof(copy_link_t));
+
+    link->copy = copy;
+    link->src = strdup(path);
+    link->dst = dst;
+    link->req.data = link;
+
+    if (uv_fs_readlink(copy->loop, &link->req, link->src, readlink_cb)) {
+        copy->errors++;
+        fprintf(stderr, "cp: %s: %s.\n", path,
+                uv_strerror(uv_last_error(copy->loop)));
+        link_free(link);
+        return;
+    }
+    copy->fs_requests++;
+}
+
+static void mkdir_cb(uv_fs_t* req) {
+    copy_dir_t* dir = (copy_dir_t*) req->data;
+    uv_tree_copy_t* copy = dir->copy;
+
+    if (req->result == -1 && uv_last_error(copy->loop).code != UV_EEXIST) {
+        copy->errors++;
+        fprintf(stderr, "cp: cannot create directory %s: %s.\n", dir->dst,
+                uv_strerror(uv_last_error(copy->loop)));
+        free(dir->dst);
+        free(dir);
+    } else if (req->result == -1) {
+        /* merged into a directory that was there, its mode stays */
+        copy->dirs++;
+        free(dir->dst);
+        free(dir);
+    } else {
+        copy->dirs++;
+        QUEUE_INSERT_HEAD(&copy->dirs_made, &dir->node);
+    }
+    uv_fs_req_cleanup(req);
+
+    copy->mkdirs--;
+    fs_request_done(copy);
+}
+
+/**
+ * Creates dst writable for the copy, the source mode is applied once
+ * everything is copied. The walk waits, so nothing is copied into dst
+ * before it exists.
+ */
+static void copy_dir(uv_tree_copy_t* copy, char* dst, int mode) {
+    copy_dir_t* dir = (copy_dir_t*) malloc(sizeof(copy_dir_t));
+
+    dir->copy = copy;
+    dir->dst = dst;
+    dir->mode = mode;
+    dir->req.data = dir;
+    QUEUE_INIT(&dir->node);
+
+    if (uv_fs_mkdir(copy->loop, &dir->req, dst, mode | S_IRWXU, mkdir_cb)) {
+        copy->errors++;
+        fprintf(stderr, "cp: cannot create directory %s: %s.\n", dst,
+                uv_strerror(uv_last_error(copy->loop)));
+        free(dst);
+        free(dir);
+        return;
+    }
+    copy->fs_requests++;
+    copy->mkdirs++;
+    uv_tree_walk_pause(&copy->walk);
+}
+
+static void entry_cb(uv_tree_walk_t* walk, const char* path,
+        const uv_statbuf_t* stat) {
+    uv_tree_copy_t* copy = (uv_tree_copy_t*) walk->data;
+    char* dst;
+
+    if (stat == NULL) {
+        copy->errors++;
+        fprintf(stderr, "cp: cannot access %s: %s.\n", path,
+                uv_strerror(uv_last_error(copy->loop)));
+        return;
+    }
+
+    dst = dst_path(copy, path);
+
+    if (S_ISDIR(stat->st_mode)) {
+        copy_dir(copy, dst, stat->st_mode & 07777);
+    } else if (S_ISLNK(stat->st_mode)) {
+        copy_symlink(copy, path, dst);
+    } else if (S_ISREG(stat->st_mode)) {
+        copy_file_t* file = (copy_file_t*) malloc(sizeof(copy_file_t));
+
+        file->copy = copy;
+        file->src = strdup(path);
+        file->dst = dst;
+        file->mode = stat->st_mode & 07777;
+        file->size = stat->st_size;
+        file->in_fd = -1;
+        file->out_fd = -1;
+        file->ranges_left = 0;
+        file->error = 0;
+
+        if (file->size > UV_TREE_COPY_RANGE_SIZE)
+            submit(copy, file, COPY_OPEN, 0, 0);
+        else
+            submit(copy, file, COPY_WHOLE, 0, file->size);
+        pump(copy);
+
+        /* a slot frees up in after_work_cb, which resumes the walk */
+        if (copy->pending_count >=
+                copy->max_jobs * UV_TREE_COPY_PENDING_PER_JOB)
+            uv_tree_walk_pause(&copy->walk);
+    } else {
+        copy->errors++;
+        fprintf(stderr, "cp: skipping special file %s.\n", path);
+        free(dst);
+    }
+}
+
+static void walk_done_cb(uv_tree_walk_t* walk) {
+    uv_tree_copy_t* copy = (uv_tree_copy_t*) walk->data;
+
+    copy->walking = 0;
+    copy->errors += walk->errors;
+    maybe_done(copy);
+}
+
+/**
+ * cp -r copies into dst/basename(src) when dst is a directory already.
+ */
+static void dst_stat_cb(uv_fs_t* req) {
+    uv_tree_copy_t* copy = (uv_tree_copy_t*) req->data;
+    const char* name = copy->src + copy->src_len;
+    size_t name_len;
+    size_t dst_len = strlen(copy->dst);
+    int is_dir = req->result != -1 &&
+        S_ISDIR(((uv_statbuf_t*) req->ptr)->st_mode);
+
+    uv_fs_req_cleanup(req);
+
+    /* last component of src, without trailing slashes */
+    while (name > copy->src && name[-1] == '/')
+        name--;
+    name_len = name - copy->src;
+    while (name > copy->src && name[-1] != '/')
+        name--;
+    name_len -= name - copy->src;
+
+    copy->target = (char*) malloc(dst_len + name_len + 2);
+    memcpy(copy->target, copy->dst, dst_len + 1);
+    if (is_dir && name_len > 0) {
+        if (dst_len == 0 || copy->dst[dst_len - 1] != '/')
+            copy->target[dst_len++] = '/';
+        memcpy(copy->target + dst_len, name, name_len);
+        copy->target[dst_len + name_len] = '\0';
+    }
+
+    /* keep the walk ahead of the copies, but bounded */
+    if (uv_tree_walk_start(&copy->walk, copy->loop, copy->src,
+            copy->max_jobs, entry_cb, walk_done_cb)) {
+        copy->errors++;
+        fprintf(stderr, "cp: cannot walk %s.\n", copy->src);
+        copy->walking = 0;
+        maybe_done(copy);
+    }
+}
+
+int uv_tree_copy_start(uv_tree_copy_t* copy, uv_loop_t* loop,
+        const char* src, const char* dst, int max_jobs,
+        uv_tree_copy_done_cb done_cb) {
+    if (copy == NULL || src == NULL || dst == NULL) {
+        return 1;
+    }
+
+    copy->loop = loop;
+    copy->files = 0;
+    copy->dirs = 0;
+    copy->links = 0;
+    copy->bytes = 0;
+    copy->errors = 0;
+    copy->src = src;
+    copy->dst = dst;
+    copy->target = NULL;
+    copy->src_len = strlen(src);
+    copy->max_jobs = max_jobs > 0 ? max_jobs : UV_TREE_COPY_DEFAULT_JOBS;
+    copy->active_jobs = 0;
+    copy->fs_requests = 0;
+    copy->mkdirs = 0;
+    copy->walking = 1;
+    copy->finishing = 0;
+    copy->done_cb = done_cb;
+    QUEUE_INIT(&copy->pending);
+    QUEUE_INIT(&copy->dirs_made);
+    copy->pending_count = 0;
+
+    copy->walk.data = copy;
+    copy->req.data = copy;
+
+    return uv_fs_stat(loop, &copy->req, dst, dst_stat_cb) ? 2 : 0;
+}
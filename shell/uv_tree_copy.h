@@ -0,0 +1,70 @@
+#ifndef UV_TREE_COPY_H
+#define UV_TREE_COPY_H
+
+#include "uv.h"
+#include "uv_tree_walk.h"
+
+/**
+ * Files in flight when the caller passes 0.
+ */
+#define UV_TREE_COPY_DEFAULT_JOBS 16
+
+/**
+ * Files larger than this are copied as several ranges in parallel.
+ */
+#define UV_TREE_COPY_RANGE_SIZE (8 * 1024 * 1024)
+
+/**
+ * The walk pauses while more than this many work items per job wait for
+ * a slot, and resumes once fewer than one per job are left.
+ */
+#define UV_TREE_COPY_PENDING_PER_JOB 4
+
+typedef struct uv_tree_copy_s uv_tree_copy_t;
+
+typedef void (*uv_tree_copy_done_cb)(uv_tree_copy_t* copy);
+
+struct uv_tree_copy_s {
+    /* public */
+    void* data;
+    uv_loop_t* loop;
+    uint64_t files;
+    uint64_t dirs;
+    uint64_t links;
+    uint64_t bytes;
+    uint64_t errors;
+
+    // private
+    uv_tree_walk_t walk;
+    const char* src;
+    const char* dst;
+    char* target; // dst, or dst/basename(src) if dst is a directory
+    size_t src_len;
+    int max_jobs; // threadpool work items in flight
+    int active_jobs;
+    int fs_requests; // mkdir, readlink and symlink in flight
+    int mkdirs; // the walk waits while any is in flight
+    int walking;
+    int finishing; // applying directory modes
+    QUEUE pending; // work items waiting for a slot
+    int pending_count;
+    QUEUE dirs_made; // newest first, modes not applied yet
+    uv_fs_t req; // stats dst before the walk starts
+    uv_tree_copy_done_cb done_cb;
+};
+
+/**
+ * Copies the tree at src to dst like `cp -r`: into dst/basename(src) if
+ * dst is a directory already. Directories are created writable before
+ * anything inside them is copied and get their source mode at the end.
+ * Every file is preallocated and copied in the kernel (copy_file_range where
+ * available), large files as UV_TREE_COPY_RANGE_SIZE ranges.
+ * @param copy Must be allocated in caller and stay valid until done_cb.
+ * @param max_jobs Upper bound of copy work items in the threadpool.
+ * @return 0 if success
+ */
+int uv_tree_copy_start(uv_tree_copy_t* copy, uv_loop_t* loop,
+        const char* src, const char* dst, int max_jobs,
+        uv_tree_copy_done_cb done_cb);
+
+#endif
@@ -0,0 +1,215 @@
+#include "uv_tree_walk.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * One path waiting for (or running) a stat or readdir request.
+ */
+typedef struct {
+    QUEUE node;
+    uv_fs_t req;
+    uv_tree_walk_t* walk;
+    char path[1];
+} walk_path_t;
+
+static void stat_cb(uv_fs_t* req);
+static void readdir_cb(uv_fs_t* req);
+static void pump(uv_tree_walk_t* walk);
+
+/**
+ * The loop holds no reference to the walk anymore.
+ */
+static void close_cb(uv_handle_t* handle) {
+    uv_tree_walk_t* walk = (uv_tree_walk_t*) handle->data;
+
+    if (walk->done_cb != NULL)
+        walk->done_cb(walk);
+}
+
+/**
+ * First loop iteration after uv_tree_walk_start, starts the requests.
+ */
+static void start_cb(uv_idle_t* handle, int status) {
+    uv_tree_walk_t* walk = (uv_tree_walk_t*) handle->data;
+
+    uv_idle_stop(handle);
+    walk->started = 1;
+    pump(walk);
+}
+
+static walk_path_t* path_new(uv_tree_walk_t* walk, const char* dir,
+        const char* name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = name ? strlen(name) : 0;
+    walk_path_t* p = (walk_path_t*) malloc(sizeof(walk_path_t) + dir_len +
+            name_len + 1);
+
+    if (p == NULL) return NULL;
+
+    p->walk = walk;
+    p->req.data = p;
+    memcpy(p->path, dir, dir_len);
+
+    if (name) {
+        if (dir_len && dir[dir_len - 1] != '/')
+            p->path[dir_len++] = '/';
+        memcpy(p->path + dir_len, name, name_len);
+    }
+    p->path[dir_len + name_len] = '\0';
+
+    QUEUE_INIT(&p->node);
+
+    return p;
+}
+
+/**
+ * Moves queued paths into the threadpool until max_requests are in flight.
+ * Stats are preferred over readdirs so the queues stay short.
+ */
+static void pump(uv_tree_walk_t* walk) {
+    if (!walk->started || walk->finished)
+        return;
+
+    while (!walk->paused && walk->active_requests < walk->max_requests) {
+        QUEUE* q;
+        walk_path_t* p;
+        int r;
+
+        if (!QUEUE_EMPTY(&walk->stat_queue)) {
+            q = QUEUE_HEAD(&walk->stat_queue);
+            QUEUE_REMOVE(q);
+            p = QUEUE_DATA(q, walk_path_t, node);
+            r = uv_fs_lstat(walk->loop, &p->req, p->path, stat_cb);
+        } else if (!QUEUE_EMPTY(&walk->dir_queue)) {
+            q = QUEUE_HEAD(&walk->dir_queue);
+            QUEUE_REMOVE(q);
+            p = QUEUE_DATA(q, walk_path_t, node);
+            r = uv_fs_readdir(walk->loop, &p->req, p->path, 0, readdir_cb);
+        } else {
+            break;
+        }
+
+        if (r) {
+            walk->errors++;
+            walk->entry_cb(walk, p->path, NULL);
+            free(p);
+            continue;
+        }
+        walk->active_requests++;
+    }
+
+    /* a paused walk may still have paths queued */
+    if (walk->active_requests == 0 && QUEUE_EMPTY(&walk->stat_queue) &&
+            QUEUE_EMPTY(&walk->dir_queue)) {
+        walk->finished = 1;
+        uv_close((uv_handle_t*) &walk->idle, close_cb);
+    }
+}
+
+static void stat_cb(uv_fs_t* req) {
+    walk_path_t* p = (walk_path_t*) req->data;
+    uv_tree_walk_t* walk = p->walk;
+    int is_dir = 0;
+
+    walk->active_requests--;
+
+    if (req->result == -1) {
+        walk->errors++;
+        walk->entry_cb(walk, p->path, NULL);
+    } else {
+        uv_statbuf_t* s = (uv_statbuf_t*) req->ptr;
+
+        is_dir = S_ISDIR(s->st_mode);
+        walk->entries++;
+        walk->entry_cb(walk, p->path, s);
+    }
+
+    uv_fs_req_cleanup(req);
+
+    if (is_dir)
+        QUEUE_INSERT_TAIL(&walk->dir_queue, &p->node);
+    else
+        free(p);
+
+    pump(walk);
+}
+
+static void readdir_cb(uv_fs_t* req) {
+    walk_path_t* p = (walk_path_t*) req->data;
+    uv_tree_walk_t* walk = p->walk;
+
+    walk->active_requests--;
+
+    if (req->result == -1) {
+        walk->errors++;
+        walk->entry_cb(walk, p->path, NULL);
+    } else {
+        /* req->ptr holds req->result names separated by '\0' */
+        const char* name = (const char*) req->ptr;
+
+        for (ssize_t i = 0; i < req->result; ++i) {
+            walk_path_t* child = path_new(walk, p->path, name);
+
+            if (child != NULL)
+                QUEUE_INSERT_TAIL(&walk->stat_queue, &child->node);
+            else
+                walk->errors++;
+
+            name += strlen(name) + 1;
+        }
+    }
+
+    uv_fs_req_cleanup(req);
+    free(p);
+
+    pump(walk);
+}
+
+int uv_tree_walk_start(uv_tree_walk_t* walk, uv_loop_t* loop,
+        const char* root, int max_requests,
+        uv_tree_walk_entry_cb entry_cb, uv_tree_walk_done_cb done_cb) {
+    walk_path_t* p;
+
+    if (walk == NULL || root == NULL || entry_cb == NULL) {
+        return 1;
+    }
+
+    walk->loop = loop;
+    walk->entries = 0;
+    walk->errors = 0;
+    walk->max_requests = max_requests > 0 ? max_requests
+        : UV_TREE_WALK_DEFAULT_REQUESTS;
+    walk->active_requests = 0;
+    walk->paused = 0;
+    walk->started = 0;
+    walk->finished = 0;
+    walk->entry_cb = entry_cb;
+    walk->done_cb = done_cb;
+    QUEUE_INIT(&walk->stat_queue);
+    QUEUE_INIT(&walk->dir_queue);
+
+    p = path_new(walk, root, NULL);
+    if (p == NULL) {
+        return 2;
+    }
+
+    QUEUE_INSERT_TAIL(&walk->stat_queue, &p->node);
+
+    uv_idle_init(loop, &walk->idle);
+    walk->idle.data = walk;
+    uv_idle_start(&walk->idle, start_cb);
+
+    return 0;
+}
+
+void uv_tree_walk_pause(uv_tree_walk_t* walk) {
+    walk->paused = 1;
+}
+
+void uv_tree_walk_resume(uv_tree_walk_t* walk) {
+    if (!walk->paused)
+        return;
+    walk->paused = 0;
+    pump(walk);
+}
@@ -0,0 +1,70 @@
+#ifndef UV_TREE_WALK_H
+#define UV_TREE_WALK_H
+
+#include "uv.h"
+#include "../internal/queue.h"
+
+/**
+ * Number of fs requests kept in flight when the caller passes 0.
+ */
+#define UV_TREE_WALK_DEFAULT_REQUESTS 64
+
+typedef struct uv_tree_walk_s uv_tree_walk_t;
+
+/**
+ * Called once for every entry below (and including) the root.
+ * On error stat is NULL and uv_last_error(walk->loop) holds the reason.
+ */
+typedef void (*uv_tree_walk_entry_cb)(uv_tree_walk_t* walk,
+        const char* path, const uv_statbuf_t* stat);
+
+/**
+ * Called once after the last entry was reported, the walk is not touched
+ * afterwards.
+ */
+typedef void (*uv_tree_walk_done_cb)(uv_tree_walk_t* walk);
+
+struct uv_tree_walk_s {
+    /* public */
+    void* data;
+    uv_loop_t* loop;
+    size_t entries; // number of entries reported
+    size_t errors; // number of failed readdir/stat requests
+
+    // private
+    int max_requests; // upper bound of requests in the threadpool
+    int active_requests; // requests currently in the threadpool
+    int paused; // no new requests until uv_tree_walk_resume
+    int started; // the first loop iteration ran
+    int finished; // idle is closing, done_cb follows
+    uv_idle_t idle; // defers the first request and done_cb to the loop
+    QUEUE stat_queue; // paths waiting for uv_fs_lstat
+    QUEUE dir_queue; // directories waiting for uv_fs_readdir
+    uv_tree_walk_entry_cb entry_cb;
+    uv_tree_walk_done_cb done_cb;
+};
+
+/**
+ * Starts walking the tree below root on the next loop iteration, no
+ * callback runs before this returns. Symlinks are reported but not
+ * followed.
+ * @param walk Must be allocated in caller and stay valid until done_cb.
+ * @param max_requests Upper bound of readdir and stat requests in flight.
+ * @return 0 if success
+ */
+int uv_tree_walk_start(uv_tree_walk_t* walk, uv_loop_t* loop,
+        const char* root, int max_requests,
+        uv_tree_walk_entry_cb entry_cb, uv_tree_walk_done_cb done_cb);
+
+/**
+ * Stops starting new requests, for a consumer that falls behind.
+ * Requests in flight still report their entries.
+ */
+void uv_tree_walk_pause(uv_tree_walk_t* walk);
+
+/**
+ * Continues a paused walk. Do not call it from entry_cb.
+ */
+void uv_tree_walk_resume(uv_tree_walk_t* walk);
+
+#endif
@@ -0,0 +1,152 @@
+#include "uv_stat_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Compares the latency of plain uv_fs_stat with uv_stat_cache.
+ *
+ *   bench.o [DIR] [FILES] [ROUNDS]
+ *
+ * Creates FILES files in DIR and stats every one of them ROUNDS times,
+ * one request at a time, first with uv_fs_stat and then through the cache.
+ * Finally FILES concurrent stats of one path show the miss coalescing.
+ */
+
+uv_loop_t* loop;
+
+uv_stat_cache_t cache;
+uv_stat_cache_req_t cache_req;
+uv_fs_t stat_req;
+
+char** paths;
+int nfiles;
+int rounds;
+int current; // index of the next stat
+uint64_t start_time;
+int burst_left;
+
+void next_raw();
+void next_cached();
+
+static void report(const char* mode) {
+    uint64_t elapsed = uv_hrtime() - start_time;
+    int total = nfiles * rounds;
+
+    printf("%-8s stats=%-8d %8.0f ns/stat\n", mode, total,
+            (double) elapsed / total);
+}
+
+void raw_stat_cb(uv_fs_t* req) {
+    if (req->result == -1) {
+        fprintf(stderr, "Error on reading stats: %s.\n",
+                uv_strerror(uv_last_error(loop)));
+    }
+
+    uv_fs_req_cleanup(req);
+    next_raw();
+}
+
+void next_raw() {
+    if (current == nfiles * rounds) {
+        report("uv_fs");
+
+        current = 0;
+        start_time = uv_hrtime();
+        next_cached();
+        return;
+    }
+
+    uv_fs_stat(loop, &stat_req, paths[current++ % nfiles], raw_stat_cb);
+}
+
+void cached_stat_cb(uv_stat_cache_req_t* req, int status,
+        const uv_statbuf_t* stat) {
+    if (status) {
+        fprintf(stderr, "Error on reading stats: %s.\n",
+                uv_strerror(req->error));
+    }
+
+    /* hits call back synchronously, let next_cached loop instead of
+     * recursing */
+    if (req->data == NULL)
+        next_cached();
+}
+
+void burst_cb(uv_stat_cache_req_t* req, int status,
+        const uv_statbuf_t* stat) {
+    free(req);
+
+    if (--burst_left == 0) {
+        printf("burst    requests=%d misses=%llu coalesced=%llu\n", nfiles,
+                (unsigned long long) cache.misses,
+                (unsigned long long) cache.coalesced);
+        uv_stat_cache_close(&cache);
+    }
+}
+
+void next_cached() {
+    while (current < nfiles * rounds) {
+        uint64_t hits = cache.hits;
+
+        cache_req.data = (void*) 1;
+        uv_stat_cache_stat(&cache, &cache_req, paths[current++ % nfiles],
+                cached_stat_cb);
+        cache_req.data = NULL;
+
+        /* a miss completes later and resumes from cached_stat_cb */
+        if (cache.hits == hits)
+            return;
+    }
+
+    report("cached");
+    printf("cache    hits=%llu misses=%llu hit-rate=%.2f%% evictions=%llu "
+            "invalidations=%llu\n",
+            (unsigned long long) cache.hits,
+            (unsigned long long) cache.misses,
+            100.0 * cache.hits / (cache.hits + cache.misses),
+            (unsigned long long) cache.evictions,
+            (unsigned long long) cache.invalidations);
+
+    /* concurrent misses for one path share one uv_fs_stat */
+    uv_stat_cache_invalidate(&cache, paths[0]);
+    cache.misses = 0;
+    cache.coalesced = 0;
+    burst_left = nfiles;
+    for (int i = 0; i < nfiles; ++i) {
+        uv_stat_cache_req_t* req = malloc(sizeof(uv_stat_cache_req_t));
+
+        uv_stat_cache_stat(&cache, req, paths[0], burst_cb);
+    }
+}
+
+int main(int argc, const char** argv) {
+    const char* dir = argc > 1 ? argv[1] : "/tmp/stat-cache-bench";
+    nfiles = argc > 2 ? atoi(argv[2]) : 1000;
+    rounds = argc > 3 ? atoi(argv[3]) : 100;
+
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+        perror("mkdir");
+        return 1;
+    }
+
+    paths = (char**) malloc(sizeof(char*) * nfiles);
+    for (int i = 0; i < nfiles; ++i) {
+        paths[i] = (char*) malloc(strlen(dir) + 16);
+        sprintf(paths[i], "%s/f%06d", dir, i);
+        close(open(paths[i], O_WRONLY | O_CREAT, 0644));
+    }
+
+    loop = uv_default_loop();
+    uv_stat_cache_init(&cache, loop, nfiles, 1000);
+
+    start_time = uv_hrtime();
+    next_raw();
+
+    return uv_run(loop, UV_RUN_DEFAULT);
+}
@@ -0,0 +1,383 @@
+#include "uv_stat_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A uv_fs_event watcher on the parent directory of cached entries.
+ */
+typedef struct dir_watcher_s {
+    struct dir_watcher_s* next; // hash chain
+    uint32_t hash;
+    uv_stat_cache_t* cache;
+    uv_fs_event_t handle;
+    QUEUE entries; // entries of files inside this directory
+    int watching; // 0 if uv_fs_event_init failed and ttl is used instead
+    int dispatching; // set while fs_event_cb walks entries
+    char path[1];
+} dir_watcher_t;
+
+/**
+ * A cached (or pending) stat result.
+ */
+typedef struct stat_entry_s {
+    struct stat_entry_s* next; // hash chain
+    uint32_t hash;
+    uv_stat_cache_t* cache;
+    dir_watcher_t* watcher;
+    QUEUE lru_node;
+    QUEUE dir_node;
+    QUEUE waiters; // uv_stat_cache_req_t waiting for req
+    uv_fs_t req;
+    int pending; // req is in the threadpool
+    int stale; // invalidated while pending, out of the hash already
+    uint64_t expires; // uv_now() deadline, 0 while the directory is watched
+    uv_statbuf_t stat;
+    const char* name; // last path component
+    char path[1];
+} stat_entry_t;
+
+static void stat_cb(uv_fs_t* req);
+
+/**
+ * FNV-1a of a NUL terminated string.
+ */
+static uint32_t hash_str(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static stat_entry_t* entry_find(uv_stat_cache_t* cache, const char* path,
+        uint32_t hash) {
+    stat_entry_t* e = cache->entries[hash & (cache->nbuckets - 1)];
+
+    for (; e != NULL; e = e->next) {
+        if (e->hash == hash && !strcmp(e->path, path))
+            return e;
+    }
+    return NULL;
+}
+
+static void entry_unlink(uv_stat_cache_t* cache, stat_entry_t* e) {
+    stat_entry_t** p = &cache->entries[e->hash & (cache->nbuckets - 1)];
+
+    while (*p != e)
+        p = &(*p)->next;
+    *p = e->next;
+}
+
+static void watcher_close_cb(uv_handle_t* handle) {
+    free(handle->data);
+}
+
+/**
+ * Closes the watcher once no entry of its directory is left.
+ */
+static void watcher_release(dir_watcher_t* w) {
+    uv_stat_cache_t* cache = w->cache;
+    dir_watcher_t** p;
+
+    if (!QUEUE_EMPTY(&w->entries) || w->dispatching)
+        return;
+
+    p = &cache->watchers[w->hash & (cache->nbuckets - 1)];
+    while (*p != w)
+        p = &(*p)->next;
+    *p = w->next;
+
+    if (w->watching)
+        uv_close((uv_handle_t*) &w->handle, watcher_close_cb);
+    else
+        free(w);
+}
+
+/**
+ * Frees an entry that is not pending.
+ */
+static void entry_remove(stat_entry_t* e) {
+    uv_stat_cache_t* cache = e->cache;
+
+    entry_unlink(cache, e);
+    QUEUE_REMOVE(&e->lru_node);
+    QUEUE_REMOVE(&e->dir_node);
+    cache->nentries--;
+    watcher_release(e->watcher);
+    free(e);
+}
+
+/**
+ * Removes a cached entry. Pending entries leave the hash, so later
+ * callers start a fresh stat; stat_cb still answers their waiters and
+ * frees them.
+ */
+static void entry_invalidate(stat_entry_t* e) {
+    if (e->stale)
+        return;
+    e->cache->invalidations++;
+
+    if (e->pending) {
+        entry_unlink(e->cache, e);
+        e->stale = 1;
+    } else {
+        entry_remove(e);
+    }
+}
+
+static void invalidate_path(uv_stat_cache_t* cache, const char* path) {
+    stat_entry_t* e = entry_find(cache, path, hash_str(path, strlen(path)));
+
+    if (e != NULL)
+        entry_invalidate(e);
+}
+
+static void fs_event_cb(uv_fs_event_t* handle, const char* filename,
+        int events, int status) {
+    dir_watcher_t* w = (dir_watcher_t*) handle->data;
+    uv_stat_cache_t* cache = w->cache;
+    QUEUE* q;
+
+    w->dispatching = 1;
+
+    /* without a name (or on error) anything in the directory may differ */
+    q = QUEUE_HEAD(&w->entries);
+    while (q != &w->entries) {
+        stat_entry_t* e = QUEUE_DATA(q, stat_entry_t, dir_node);
+
+        q = QUEUE_NEXT(q);
+        if (status == 0 && filename != NULL && strcmp(e->name, filename))
+            continue;
+        entry_invalidate(e);
+    }
+
+    /* the directory's own mtime/nlink changed as well */
+    invalidate_path(cache, w->path);
+
+    w->dispatching = 0;
+    watcher_release(w);
+}
+
+static dir_watcher_t* watcher_get(uv_stat_cache_t* cache, const char* dir,
+        size_t len) {
+    uint32_t hash = hash_str(dir, len);
+    dir_watcher_t** bucket = &cache->watchers[hash & (cache->nbuckets - 1)];
+    dir_watcher_t* w;
+
+    for (w = *bucket; w != NULL; w = w->next) {
+        if (w->hash == hash && !strncmp(w->path, dir, len) && !w->path[len])
+            return w;
+    }
+
+    w = (dir_watcher_t*) malloc(sizeof(dir_watcher_t) + len);
+    if (w == NULL)
+        return NULL;
+
+    memcpy(w->path, dir, len);
+    w->path[len] = '\0';
+    w->hash = hash;
+    w->cache = cache;
+    w->dispatching = 0;
+    QUEUE_INIT(&w->entries);
+
+    w->watching = uv_fs_event_init(cache->loop, &w->handle, w->path,
+            fs_event_cb, 0) == 0;
+    w->handle.data = w;
+
+    w->next = *bucket;
+    *bucket = w;
+
+    return w;
+}
+
+static void evict(uv_stat_cache_t* cache) {
+    while (cache->nentries > cache->max_entries) {
+        QUEUE* q = QUEUE_PREV(&cache->lru);
+        stat_entry_t* e = QUEUE_DATA(q, stat_entry_t, lru_node);
+
+        entry_remove(e);
+        cache->evictions++;
+    }
+}
+
+static void stat_cb(uv_fs_t* req) {
+    stat_entry_t* e = (stat_entry_t*) req->data;
+    uv_stat_cache_t* cache = e->cache;
+    uv_err_t err = uv_last_error(cache->loop);
+    int status = req->result == -1 ? -1 : 0;
+    uv_statbuf_t stat;
+    QUEUE waiters;
+
+    cache->pending--;
+    e->pending = 0;
+
+    if (status == 0)
+        memcpy(&stat, req->ptr, sizeof(stat));
+    uv_fs_req_cleanup(req);
+
+    QUEUE_INIT(&waiters);
+    if (!QUEUE_EMPTY(&e->waiters)) {
+        QUEUE* first = QUEUE_HEAD(&e->waiters);
+
+        QUEUE_SPLIT(&e->waiters, first, &waiters);
+    }
+
+    if (status == 0 && !e->stale) {
+        memcpy(&e->stat, &stat, sizeof(stat));
+        QUEUE_INSERT_HEAD(&cache->lru, &e->lru_node);
+        cache->nentries++;
+        evict(cache);
+    } else {
+        /* errors are not cached */
+        if (!e->stale)
+            entry_unlink(cache, e);
+        QUEUE_REMOVE(&e->dir_node);
+        watcher_release(e->watcher);
+        free(e);
+    }
+
+    /* callbacks may touch the cache, so nothing of e is used from here */
+    while (!QUEUE_EMPTY(&waiters)) {
+        QUEUE* q = QUEUE_HEAD(&waiters);
+        uv_stat_cache_req_t* r = QUEUE_DATA(q, uv_stat_cache_req_t, node);
+
+        QUEUE_REMOVE(q);
+        r->error = err;
+        r->cb(r, status, status ? NULL : &stat);
+    }
+}
+
+int uv_stat_cache_init(uv_stat_cache_t* cache, uv_loop_t* loop,
+        size_t max_entries, uint64_t ttl_ms) {
+    if (cache == NULL || max_entries == 0) {
+        return 1;
+    }
+
+    memset(cache, 0, sizeof(*cache));
+    cache->loop = loop;
+    cache->max_entries = max_entries;
+    cache->ttl_ms = ttl_ms;
+
+    cache->nbuckets = 16;
+    while (cache->nbuckets < max_entries)
+        cache->nbuckets <<= 1;
+
+    cache->entries = calloc(cache->nbuckets, sizeof(*cache->entries));
+    cache->watchers = calloc(cache->nbuckets, sizeof(*cache->watchers));
+    if (cache->entries == NULL || cache->watchers == NULL) {
+        free(cache->entries);
+        free(cache->watchers);
+        return 2;
+    }
+
+    QUEUE_INIT(&cache->lru);
+
+    return 0;
+}
+
+int uv_stat_cache_stat(uv_stat_cache_t* cache, uv_stat_cache_req_t* req,
+        const char* path, uv_stat_cache_cb cb) {
+    size_t len = strlen(path);
+    uint32_t hash = hash_str(path, len);
+    stat_entry_t* e = entry_find(cache, path, hash);
+
+    req->cb = cb;
+
+    if (e != NULL && !e->pending && e->expires &&
+            uv_now(cache->loop) >= e->expires) {
+        entry_invalidate(e);
+        e = NULL;
+    }
+
+    if (e != NULL && !e->pending) {
+        /* copy, the callback may invalidate the entry */
+        uv_statbuf_t stat = e->stat;
+
+        cache->hits++;
+        QUEUE_REMOVE(&e->lru_node);
+        QUEUE_INSERT_HEAD(&cache->lru, &e->lru_node);
+        cb(req, 0, &stat);
+        return 0;
+    }
+
+    if (e != NULL) {
+        cache->coalesced++;
+        QUEUE_INSERT_TAIL(&e->waiters, &req->node);
+        return 0;
+    }
+
+    e = (stat_entry_t*) malloc(sizeof(stat_entry_t) + len);
+    if (e == NULL) {
+        return -1;
+    }
+
+    memcpy(e->path, path, len + 1);
+
+    const char* slash = strrchr(e->path, '/');
+    if (slash == NULL) {
+        e->name = e->path;
+        e->watcher = watcher_get(cache, ".", 1);
+    } else {
+        e->name = slash + 1;
+        e->watcher = watcher_get(cache, e->path,
+                slash == e->path ? 1 : (size_t) (slash - e->path));
+    }
+    if (e->watcher == NULL) {
+        free(e);
+        return -1;
+    }
+
+    e->hash = hash;
+    e->cache = cache;
+    e->pending = 1;
+    e->stale = 0;
+    e->expires = e->watcher->watching ? 0
+        : uv_now(cache->loop) + cache->ttl_ms;
+    e->req.data = e;
+    QUEUE_INIT(&e->waiters);
+    QUEUE_INIT(&e->lru_node);
+    QUEUE_INSERT_TAIL(&e->watcher->entries, &e->dir_node);
+    QUEUE_INSERT_TAIL(&e->waiters, &req->node);
+
+    e->next = cache->entries[hash & (cache->nbuckets - 1)];
+    cache->entries[hash & (cache->nbuckets - 1)] = e;
+
+    if (uv_fs_stat(cache->loop, &e->req, e->path, stat_cb)) {
+        entry_unlink(cache, e);
+        QUEUE_REMOVE(&e->dir_node);
+        watcher_release(e->watcher);
+        free(e);
+        return -1;
+    }
+
+    cache->misses++;
+    cache->pending++;
+
+    return 0;
+}
+
+void uv_stat_cache_invalidate(uv_stat_cache_t* cache, const char* path) {
+    invalidate_path(cache, path);
+}
+
+int uv_stat_cache_close(uv_stat_cache_t* cache) {
+    if (cache->pending) {
+        return 1;
+    }
+
+    while (!QUEUE_EMPTY(&cache->lru)) {
+        QUEUE* q = QUEUE_HEAD(&cache->lru);
+
+        entry_remove(QUEUE_DATA(q, stat_entry_t, lru_node));
+    }
+
+    free(cache->entries);
+    free(cache->watchers);
+    cache->entries = NULL;
+    cache->watchers = NULL;
+
+    return 0;
+}
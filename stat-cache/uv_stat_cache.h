@@ -0,0 +1,79 @@
+#ifndef UV_STAT_CACHE_H
+#define UV_STAT_CACHE_H
+
+#include "uv.h"
+#include "../internal/queue.h"
+
+typedef struct uv_stat_cache_s uv_stat_cache_t;
+typedef struct uv_stat_cache_req_s uv_stat_cache_req_t;
+
+/**
+ * On error status is -1 and stat is NULL, req->error holds the uv error.
+ */
+typedef void (*uv_stat_cache_cb)(uv_stat_cache_req_t* req, int status,
+        const uv_statbuf_t* stat);
+
+struct uv_stat_cache_req_s {
+    /* public */
+    void* data;
+    uv_err_t error;
+
+    // private
+    QUEUE node; // in the waiters list of an entry
+    uv_stat_cache_cb cb;
+};
+
+struct uv_stat_cache_s {
+    /* public */
+    void* data;
+    uv_loop_t* loop;
+    uint64_t hits;
+    uint64_t misses; // misses that started a uv_fs_stat
+    uint64_t coalesced; // misses that joined a running uv_fs_stat
+    uint64_t evictions;
+    uint64_t invalidations;
+
+    // private
+    size_t max_entries;
+    size_t nentries; // cached (not pending) entries
+    uint64_t ttl_ms; // used for entries whose directory can not be watched
+    size_t nbuckets;
+    struct stat_entry_s** entries; // hash table of entries
+    struct dir_watcher_s** watchers; // hash table of directory watchers
+    QUEUE lru; // cached entries, most recently used first
+    int pending; // uv_fs_stat requests in flight
+};
+
+/**
+ * @param cache Must be allocated in caller.
+ * @param max_entries Cached entries kept before the least recently used
+ *                    one is evicted.
+ * @param ttl_ms Lifetime of entries in directories uv_fs_event can not watch.
+ * @return 0 if success
+ */
+int uv_stat_cache_init(uv_stat_cache_t* cache, uv_loop_t* loop,
+        size_t max_entries, uint64_t ttl_ms);
+
+/**
+ * Stats path through the cache.
+ * On a hit cb is called before this function returns. On a miss one
+ * uv_fs_stat is started and every concurrent miss for path waits on it.
+ * @return 0 if success
+ */
+int uv_stat_cache_stat(uv_stat_cache_t* cache, uv_stat_cache_req_t* req,
+        const char* path, uv_stat_cache_cb cb);
+
+/**
+ * Drops the cached entry of path, if any.
+ * A stat in flight still answers its waiters, later calls start a new one.
+ */
+void uv_stat_cache_invalidate(uv_stat_cache_t* cache, const char* path);
+
+/**
+ * Frees all entries and closes the watchers.
+ * Must not be called while stats are pending.
+ * @return 0 if success
+ */
+int uv_stat_cache_close(uv_stat_cache_t* cache);
+
+#endif
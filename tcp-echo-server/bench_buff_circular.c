@@ -0,0 +1,108 @@
+/**
+ * uv_buff_circular microbenchmarks with JSON output.
+ *
+ *   bench_buff_circular.o [json file] [commit]
+ *
+ * For rings of 4 to 4096 buffers:
+ *   fill_drain  push until full, then pop until empty
+ *   steady      push one, pop one, with the ring kept half full
+ * on 1, 2 and 4 threads, each with its own ring. Buffers point into a
+ * static array, nothing is allocated while measuring, so this is the
+ * cost of the ring alone. Ops are pushes plus pops.
+ */
+#include <unistd.h>
+#include "buff_circular.h"
+#include "../internal/bench.h"
+
+#define OPS (1 << 18)
+#define MAX_THREADS 4
+
+typedef struct {
+	uv_buff_circular ring;
+	char pad[64]; // keep the rings of different threads apart
+} ring_t;
+
+static ring_t rings[MAX_THREADS];
+static char payload[4096];
+
+static void push_one(uv_buff_circular *ring, size_t i) {
+	uv_buf_t buf;
+	buf.base = &payload[i % sizeof(payload)];
+	buf.len = 1;
+	buff_circular_push(ring, &buf);
+}
+
+static long pop_one(uv_buff_circular *ring) {
+	uv_buf_t buf;
+	buf.base = NULL;
+	buf.len = 0;
+	buff_circular_pop(ring, &buf);
+	return buf.base - payload;
+}
+
+static void fill_drain(void *arg, int thread) {
+	uv_buff_circular *ring = &rings[thread].ring;
+	size_t rounds = OPS / (2 * ring->max_size);
+	long sum = 0;
+
+	for (size_t r = 0; r < (rounds ? rounds : 1); ++r) {
+		for (size_t i = 0; i < ring->max_size; ++i)
+			push_one(ring, i);
+		for (size_t i = 0; i < ring->max_size; ++i)
+			sum += pop_one(ring);
+	}
+	bench_sink = sum;
+}
+
+static void steady(void *arg, int thread) {
+	uv_buff_circular *ring = &rings[thread].ring;
+	long sum = 0;
+
+	for (size_t i = 0; i < OPS / 2; ++i) {
+		push_one(ring, i);
+		sum += pop_one(ring);
+	}
+	bench_sink = sum;
+}
+
+/**
+ * Frees nothing, the buffers are not from malloc.
+ */
+static void ring_destroy(uv_buff_circular *ring) {
+	while (ring->size > 0)
+		pop_one(ring);
+	buff_circular_deinit(ring);
+}
+
+int main(int argc, char **argv) {
+	const char *path = argc > 1 ? argv[1] : "bench_buff_circular.json";
+	const char *commit = argc > 2 ? argv[2] : NULL;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	bench_t b;
+
+	if (bench_open(&b, "buff_circular", path, commit))
+		return 1;
+
+	for (size_t n = 4; n <= 4096; n *= 4) {
+		size_t fill_ops = (OPS / (2 * n) ? OPS / (2 * n) : 1) * 2 * n;
+
+		for (int threads = 1; threads <= MAX_THREADS && threads <= cpus; threads *= 2) {
+			for (int i = 0; i < threads; ++i)
+				buff_circular_init(&rings[i].ring, n);
+			bench_case(&b, "fill_drain", n, threads, fill_drain, NULL, fill_ops);
+
+			for (int i = 0; i < threads; ++i) {
+				for (size_t j = 0; j < n / 2; ++j)
+					push_one(&rings[i].ring, j);
+			}
+			bench_case(&b, "steady", n, threads, steady, NULL, OPS / 2 * 2);
+
+			for (int i = 0; i < threads; ++i)
+				ring_destroy(&rings[i].ring);
+		}
+	}
+
+	bench_close(&b);
+	printf("results written to %s\n", path);
+	return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * Byte ring against pointer ring, with JSON output.
+ *
+ *   bench_byte_ring.o [json file] [commit]
+ *
+ * Both move messages of 16 bytes to 64 KiB the way ring mode does, with
+ * the ring kept half full:
+ *   pointer  read into a read buffer, malloc and copy, push to
+ *            uv_buff_circular; pop, send, free
+ *   mirror   read straight into byte_ring behind a length; send straight
+ *            from it, consume
+ * "read" and "send" are a memcpy from and to a static buffer, standing in
+ * for the kernel's copy. Ops are messages moved through the ring.
+ */
+#include <string.h>
+#include "buff_circular.h"
+#include "byte_ring.h"
+#include "../internal/bench.h"
+
+#define BYTES (64 << 20) // per case, split into messages
+#define MAX_MESSAGE (64 * 1024)
+#define POINTER_SLOTS 64
+#define HEADER sizeof(uint32_t)
+
+static char wire_in[MAX_MESSAGE];
+static char wire_out[MAX_MESSAGE];
+static char read_buffer[MAX_MESSAGE];
+
+static uv_buff_circular pointer_ring;
+static byte_ring_t mirror_ring;
+
+static void pointer_push(size_t n) {
+	memcpy(read_buffer, wire_in, n);
+	uv_buf_t buf;
+	buf.base = (char *) malloc(n);
+	buf.len = n;
+	memcpy(buf.base, read_buffer, n);
+	buff_circular_push(&pointer_ring, &buf);
+}
+
+static void pointer_pop() {
+	uv_buf_t buf;
+	buf.base = NULL;
+	buf.len = 0;
+	buff_circular_pop(&pointer_ring, &buf);
+	memcpy(wire_out, buf.base, buf.len);
+	free(buf.base);
+}
+
+static void pointer(void *arg, int thread) {
+	size_t n = *(size_t *) arg;
+
+	for (size_t i = 0; i < BYTES / n; ++i) {
+		pointer_push(n);
+		pointer_pop();
+	}
+	bench_sink = wire_out[0];
+}
+
+static void mirror_push(size_t n) {
+	char *p = byte_ring_write_ptr(&mirror_ring);
+	uint32_t len = n;
+
+	memcpy(p + HEADER, wire_in, n);
+	memcpy(p, &len, HEADER);
+	byte_ring_produce(&mirror_ring, HEADER + n);
+}
+
+static void mirror_pop() {
+	char *p = byte_ring_read_ptr(&mirror_ring);
+	uint32_t len;
+
+	memcpy(&len, p, HEADER);
+	memcpy(wire_out, p + HEADER, len);
+	byte_ring_consume(&mirror_ring, HEADER + len);
+}
+
+static void mirror(void *arg, int thread) {
+	size_t n = *(size_t *) arg;
+
+	for (size_t i = 0; i < BYTES / n; ++i) {
+		mirror_push(n);
+		mirror_pop();
+	}
+	bench_sink = wire_out[0];
+}
+
+int main(int argc, char **argv) {
+	const char *path = argc > 1 ? argv[1] : "bench_byte_ring.json";
+	const char *commit = argc > 2 ? argv[2] : NULL;
+	bench_t b;
+
+	memset(wire_in, 'a', sizeof(wire_in));
+	if (bench_open(&b, "byte_ring", path, commit))
+		return 1;
+
+	for (size_t n = 16; n <= MAX_MESSAGE; n *= 16) {
+		buff_circular_init(&pointer_ring, POINTER_SLOTS);
+		for (size_t i = 0; i < POINTER_SLOTS / 2; ++i)
+			pointer_push(n);
+		bench_case(&b, "pointer", n, 1, pointer, &n, BYTES / n);
+		while (pointer_ring.size > 0)
+			pointer_pop();
+		buff_circular_deinit(&pointer_ring);
+
+		/* room for as many messages as the pointer ring */
+		if (byte_ring_init(&mirror_ring, POINTER_SLOTS * (HEADER + n))) {
+			fprintf(stderr, "Error on mapping the byte ring.\n");
+			return 1;
+		}
+		for (size_t i = 0; i < POINTER_SLOTS / 2; ++i)
+			mirror_push(n);
+		bench_case(&b, "mirror", n, 1, mirror, &n, BYTES / n);
+		byte_ring_destroy(&mirror_ring);
+	}
+
+	bench_close(&b);
+	printf("results written to %s\n", path);
+	return 0;
+}
@@ -0,0 +1,136 @@
+#include "broadcast.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define WRITE_POOL_CHUNK 1024
+
+/**
+ * A published chunk, shared by all writes of it.
+ */
+typedef struct broadcast_payload_s {
+	uint32_t refs;
+	size_t len;
+	char data[];
+} broadcast_payload_t;
+
+static void payload_release(broadcast_payload_t *payload) {
+	if (--payload->refs == 0)
+		free(payload);
+}
+
+int broadcast_policy_by_name(const char *name, broadcast_policy_t *policy) {
+	if (!strcmp(name, "drop"))
+		*policy = BROADCAST_DROP;
+	else if (!strcmp(name, "disconnect"))
+		*policy = BROADCAST_DISCONNECT;
+	else
+		return -1;
+	return 0;
+}
+
+int broadcast_init(broadcast_t *broadcast, broadcast_policy_t policy,
+		size_t max_queued_bytes, broadcast_disconnect_cb disconnect_cb) {
+	memset(broadcast, 0, sizeof(*broadcast));
+	broadcast->policy = policy;
+	broadcast->max_queued_bytes = max_queued_bytes;
+	broadcast->disconnect_cb = disconnect_cb;
+	QUEUE_INIT(&broadcast->subs);
+	return broadcast_write_pool_init(&broadcast->writes, WRITE_POOL_CHUNK, WRITE_POOL_CHUNK);
+}
+
+void broadcast_join(broadcast_t *broadcast, broadcast_sub_t *sub, uv_stream_t *stream) {
+	sub->stream = stream;
+	sub->queued_bytes = 0;
+	sub->dropped = 0;
+	sub->leaving = 0;
+	QUEUE_INSERT_TAIL(&broadcast->subs, &sub->queue);
+	broadcast->subscribers++;
+}
+
+void broadcast_leave(broadcast_t *broadcast, broadcast_sub_t *sub) {
+	QUEUE_REMOVE(&sub->queue);
+	broadcast->subscribers--;
+}
+
+static void write_cb(uv_write_t *req, int status) {
+	broadcast_write_t *write = (broadcast_write_t *) req;
+	broadcast_t *broadcast = (broadcast_t *) req->data;
+
+	// cancelled writes of a closing subscriber end up here too
+	write->sub->queued_bytes -= write->payload->len;
+	if (status == 0)
+		broadcast->delivered++;
+	payload_release(write->payload);
+	broadcast_write_pool_put(&broadcast->writes, write);
+}
+
+/**
+ * @return 1 if sub is over its limit, after applying the policy
+ */
+static int over_limit(broadcast_t *broadcast, broadcast_sub_t *sub, size_t len) {
+	// a chunk larger than the limit still goes to an idle subscriber
+	if (sub->queued_bytes == 0 || sub->queued_bytes + len <= broadcast->max_queued_bytes)
+		return 0;
+
+	if (broadcast->policy == BROADCAST_DROP) {
+		sub->dropped++;
+		broadcast->dropped++;
+	} else {
+		sub->leaving = 1;
+		broadcast->disconnected++;
+		broadcast->disconnect_cb(sub);
+	}
+	return 1;
+}
+
+int broadcast_publish(broadcast_t *broadcast, broadcast_sub_t *from,
+		const char *data, size_t len) {
+	broadcast_payload_t *payload = (broadcast_payload_t *) malloc(sizeof(*payload) + len);
+	QUEUE *q;
+
+	if (payload == NULL)
+		return -1;
+	payload->refs = 1; // ours, until every write took one
+	payload->len = len;
+	memcpy(payload->data, data, len);
+	broadcast->published++;
+
+	QUEUE_FOREACH(q, &broadcast->subs) {
+		broadcast_sub_t *sub = QUEUE_DATA(q, broadcast_sub_t, queue);
+		if (sub == from || sub->leaving || over_limit(broadcast, sub, len))
+			continue;
+
+		broadcast_write_t *write = broadcast_write_pool_get(&broadcast->writes);
+		if (write == NULL) {
+			// the pool could not grow, this subscriber misses the chunk
+			sub->dropped++;
+			broadcast->dropped++;
+			continue;
+		}
+		uv_buf_t buf = uv_buf_init(payload->data, len);
+		write->req.data = broadcast;
+		write->sub = sub;
+		write->payload = payload;
+		if (uv_write(&write->req, sub->stream, &buf, 1, write_cb)) {
+			broadcast_write_pool_put(&broadcast->writes, write);
+			continue;
+		}
+		payload->refs++;
+		sub->queued_bytes += len;
+	}
+
+	payload_release(payload);
+	return 0;
+}
+
+void broadcast_print(const broadcast_t *broadcast, FILE *out) {
+	fprintf(out, "broadcast: subscribers %zu, published %llu, delivered %llu, "
+			"dropped %llu, disconnected %llu, writes in flight %zu\n",
+			broadcast->subscribers, (unsigned long long) broadcast->published,
+			(unsigned long long) broadcast->delivered, (unsigned long long) broadcast->dropped,
+			(unsigned long long) broadcast->disconnected, broadcast->writes.stats.in_use);
+}
+
+void broadcast_destroy(broadcast_t *broadcast) {
+	broadcast_write_pool_destroy(&broadcast->writes);
+}
@@ -0,0 +1,111 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <uv.h>
+#include <stdio.h>
+#include "../internal/queue.h"
+#include "../internal/pool.h"
+
+/**
+ * Pub/sub fan-out for tcp_echo_server -m broadcast: whatever one
+ * subscriber sends is written to all the others. Data is forwarded in
+ * the chunks it was read in, without framing.
+ *
+ * A published chunk is copied once into a refcounted payload, which all
+ * the uv_writes to the subscribers share; it is freed when the last of
+ * them finished. Writes not finished yet count against a per-subscriber
+ * limit, past which the subscriber is disconnected (BROADCAST_DISCONNECT)
+ * or misses chunks (BROADCAST_DROP). Chunks are not messages, so a
+ * subscriber that missed one sees the rest misaligned; only use
+ * BROADCAST_DROP when the payload tolerates that.
+ */
+
+typedef enum {
+	BROADCAST_DROP,
+	BROADCAST_DISCONNECT
+} broadcast_policy_t;
+
+typedef struct broadcast_s broadcast_t;
+
+typedef struct {
+	void *data;
+	uv_stream_t *stream;
+	size_t queued_bytes; // written, not finished yet
+	uint64_t dropped; // chunks missed while over the limit or out of pool
+	// private
+	QUEUE queue;
+	int leaving; // disconnected, waiting for broadcast_leave
+} broadcast_sub_t;
+
+/**
+ * Asked to close a subscriber over the limit with BROADCAST_DISCONNECT,
+ * the close callback of its stream has to call broadcast_leave.
+ */
+typedef void (*broadcast_disconnect_cb)(broadcast_sub_t *sub);
+
+/**
+ * One write of a payload to one subscriber.
+ */
+typedef struct {
+	uv_write_t req;
+	broadcast_sub_t *sub;
+	struct broadcast_payload_s *payload;
+} broadcast_write_t;
+
+POOL_DEFINE(broadcast_write_pool, broadcast_write_t)
+
+struct broadcast_s {
+	broadcast_policy_t policy;
+	size_t max_queued_bytes; // per subscriber
+	size_t subscribers;
+	uint64_t published; // chunks
+	uint64_t delivered; // writes finished
+	uint64_t dropped; // writes skipped: over the limit, or no write request left
+	uint64_t disconnected;
+	// private
+	QUEUE subs;
+	broadcast_disconnect_cb disconnect_cb;
+	broadcast_write_pool_t writes;
+};
+
+/**
+ * Looks up a policy by name ("drop", "disconnect").
+ * @return 0 if success
+ */
+int broadcast_policy_by_name(const char *name, broadcast_policy_t *policy);
+
+/**
+ * @param broadcast Must be allocated in caller.
+ * @param max_queued_bytes Unfinished writes per subscriber before policy applies.
+ * @return 0 if success
+ */
+int broadcast_init(broadcast_t *broadcast, broadcast_policy_t policy,
+		size_t max_queued_bytes, broadcast_disconnect_cb disconnect_cb);
+
+/**
+ * @param sub Must be allocated in caller, lives until broadcast_leave.
+ */
+void broadcast_join(broadcast_t *broadcast, broadcast_sub_t *sub, uv_stream_t *stream);
+
+/**
+ * Call it from the close callback of the subscriber's stream, after libuv
+ * cancelled its writes.
+ */
+void broadcast_leave(broadcast_t *broadcast, broadcast_sub_t *sub);
+
+/**
+ * Writes len bytes of data to every subscriber but from.
+ * @param from NULL sends to all.
+ * @return 0 if success
+ */
+int broadcast_publish(broadcast_t *broadcast, broadcast_sub_t *from,
+		const char *data, size_t len);
+
+void broadcast_print(const broadcast_t *broadcast, FILE *out);
+
+/**
+ * Call it after the loop stopped.
+ */
+void broadcast_destroy(broadcast_t *broadcast);
+
+#endif
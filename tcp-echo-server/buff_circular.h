@@ -0,0 +1,47 @@
+#ifndef BUFF_CIRCULAR_H
+#define BUFF_CIRCULAR_H
+
+#include <uv.h>
+
+/**
+ * Fixed number of buffers in FIFO order, ring mode queues the messages
+ * of all clients in here. Buffers are moved in and out, not copied.
+ */
+typedef struct uv_buff_circular {
+	uv_buf_t *buffs; // array of buffers
+	size_t max_size; // number of elements in buffs
+	int size; // current size
+	// private
+	uv_buf_t *current_element; // last element
+} uv_buff_circular;
+
+/**
+ * @param circular_buff Must be allocated in caller.
+ * @param nbufs Number of buffers
+ */
+void buff_circular_init(uv_buff_circular *circular_buff, size_t nbufs);
+
+/**
+ * Move data from @param buff to @param circular_buff
+ * @param circular_buff Initialized by caller (buff_circular_init).
+ * @param buff Initialized by caller. Clean in this function (.base = NULL, .len=0).
+ * @return 0 if success
+ */
+int buff_circular_push(uv_buff_circular * const circular_buff, uv_buf_t * const buff);
+
+/**
+ * Move data from @param circular_buff to @param buff
+ * @param circular_buff Initialized by caller (buff_circular_init).
+ * @param buff Out pointer. Must be empty (.base = NULL, .len=0).
+ * @return 0 if success
+ */
+int buff_circular_pop(uv_buff_circular *circular_buff, uv_buf_t * const buff);
+
+/**
+ * Call free() for evry element.
+ * Deallocate internal array.
+ * Instance of struct 'circular_buff' will be not deallocate.
+ */
+void buff_circular_deinit(uv_buff_circular * const circular_buff);
+
+#endif
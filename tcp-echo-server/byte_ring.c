@@ -0,0 +1,70 @@
+#include "byte_ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/**
+ * An anonymous file to back the pages: memfd on Linux, elsewhere an
+ * unlinked temporary file.
+ */
+static int backing_fd() {
+#if defined(__linux__) && defined(SYS_memfd_create)
+	int fd = syscall(SYS_memfd_create, "byte_ring", 0);
+	if (fd != -1)
+		return fd;
+#endif
+	char path[] = "/tmp/byte_ring.XXXXXX";
+	int tmp = mkstemp(path);
+	if (tmp != -1)
+		unlink(path);
+	return tmp;
+}
+
+int byte_ring_init(byte_ring_t *ring, size_t size) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t rounded = page;
+
+	while (rounded < size)
+		rounded *= 2;
+	memset(ring, 0, sizeof(*ring));
+
+	int fd = backing_fd();
+	if (fd == -1)
+		return -1;
+	if (ftruncate(fd, rounded)) {
+		close(fd);
+		return -1;
+	}
+
+	/* reserve both halves at once, then put the file over each */
+	char *base = (char *) mmap(NULL, 2 * rounded, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	if (mmap(base, rounded, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+			|| mmap(base + rounded, rounded, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(base, 2 * rounded);
+		close(fd);
+		return -1;
+	}
+	close(fd); // the mappings keep the pages
+
+	ring->base = base;
+	ring->size = rounded;
+	return 0;
+}
+
+void byte_ring_destroy(byte_ring_t *ring) {
+	if (ring->base != NULL)
+		munmap(ring->base, 2 * ring->size);
+	ring->base = NULL;
+	ring->size = 0;
+	ring->head = ring->tail = 0;
+}
@@ -0,0 +1,74 @@
+#ifndef BYTE_RING_H
+#define BYTE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Contiguous byte ring. The same pages are mapped twice back to back, so
+ * the free and the filled region are always one span even when they
+ * wrap around the end: a read can go straight into byte_ring_write_ptr()
+ * and a write can be sent straight from byte_ring_read_ptr().
+ *
+ *   byte_ring_init(&ring, 1 << 20);
+ *   memcpy(byte_ring_write_ptr(&ring), data, n); // n <= byte_ring_free()
+ *   byte_ring_produce(&ring, n);
+ *   send(fd, byte_ring_read_ptr(&ring), byte_ring_used(&ring), 0);
+ *   byte_ring_consume(&ring, sent);
+ *
+ * Not thread safe, meant for data owned by one loop.
+ */
+
+typedef struct {
+	char *base; // size bytes, mapped again at base + size
+	size_t size; // power of two, at least a page
+	uint64_t head; // bytes consumed so far
+	uint64_t tail; // bytes produced so far
+} byte_ring_t;
+
+/**
+ * @param size rounded up to a power of two of at least one page
+ * @return 0 if success
+ */
+int byte_ring_init(byte_ring_t *ring, size_t size);
+
+void byte_ring_destroy(byte_ring_t *ring);
+
+static inline size_t byte_ring_used(const byte_ring_t *ring) {
+	return (size_t) (ring->tail - ring->head);
+}
+
+static inline size_t byte_ring_free(const byte_ring_t *ring) {
+	return ring->size - byte_ring_used(ring);
+}
+
+/**
+ * @return start of the byte_ring_free() bytes that can be filled
+ */
+static inline char *byte_ring_write_ptr(const byte_ring_t *ring) {
+	return ring->base + (ring->tail & (ring->size - 1));
+}
+
+/**
+ * @return start of the byte_ring_used() bytes that can be taken
+ */
+static inline char *byte_ring_read_ptr(const byte_ring_t *ring) {
+	return ring->base + (ring->head & (ring->size - 1));
+}
+
+/**
+ * @return 1 if p points into the ring's mapping
+ */
+static inline int byte_ring_contains(const byte_ring_t *ring, const char *p) {
+	return p >= ring->base && p < ring->base + 2 * ring->size;
+}
+
+static inline void byte_ring_produce(byte_ring_t *ring, size_t n) {
+	ring->tail += n;
+}
+
+static inline void byte_ring_consume(byte_ring_t *ring, size_t n) {
+	ring->head += n;
+}
+
+#endif
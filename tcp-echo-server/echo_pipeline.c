@@ -0,0 +1,244 @@
+#include "echo_pipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/**
+ * One message on its way through the threadpool and back to the socket.
+ */
+typedef struct echo_msg_s {
+	uv_work_t work;
+	uv_write_t write;
+	echo_pipeline_t *pipeline;
+	uint64_t seq;
+	uv_buf_t buf;
+} echo_msg_t;
+
+/////////////////////////////////////////////////////////////////////
+// transforms
+
+static uint32_t crc32_table[256];
+
+static void crc32_init_table() {
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; ++k)
+			c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		crc32_table[i] = c;
+	}
+}
+
+/**
+ * Checksums the message rounds times, the payload is echoed unchanged.
+ */
+static void transform_crc32(char *buf, size_t len, int rounds) {
+	volatile uint32_t result;
+	for (int r = 0; r < rounds; ++r) {
+		uint32_t crc = 0xFFFFFFFFu;
+		for (size_t i = 0; i < len; ++i)
+			crc = crc32_table[(crc ^ (unsigned char)buf[i]) & 0xFF] ^ (crc >> 8);
+		result = crc ^ 0xFFFFFFFFu;
+	}
+	(void)result;
+}
+
+/**
+ * XORs the message with a xorshift keystream rounds times, a stand-in for
+ * a stream cipher. An even number of rounds gives the input back.
+ */
+static void transform_xor(char *buf, size_t len, int rounds) {
+	for (int r = 0; r < rounds; ++r) {
+		uint32_t x = 2463534242u;
+		for (size_t i = 0; i < len; ++i) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			buf[i] ^= (char)x;
+		}
+	}
+}
+
+echo_transform_fn echo_transform_by_name(const char *name) {
+	if (crc32_table[1] == 0)
+		crc32_init_table();
+
+	if (!strcmp(name, "crc32"))
+		return transform_crc32;
+	if (!strcmp(name, "xor"))
+		return transform_xor;
+	return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+
+static void msg_free(echo_msg_t *msg) {
+	free(msg->buf.base);
+	free(msg);
+}
+
+/**
+ * Drops one in-flight message and releases the pipeline after the last.
+ */
+static void msg_finished(echo_pipeline_t *pipeline) {
+	pipeline->inflight--;
+
+	if (pipeline->closing) {
+		if (pipeline->inflight == 0) {
+			free(pipeline->done);
+			pipeline->done = NULL;
+			pipeline->release_cb(pipeline);
+		}
+		return;
+	}
+
+	// resume reading once there is room again, unless the stream is being
+	// closed and cancels its pending writes
+	if (!pipeline->reading && pipeline->inflight < pipeline->max_inflight
+			&& !uv_is_closing((uv_handle_t *)pipeline->stream)) {
+		pipeline->reading = 1;
+		uv_read_start(pipeline->stream, pipeline->alloc_cb, pipeline->read_cb);
+	}
+}
+
+static void write_cb(uv_write_t *req, int status) {
+	echo_msg_t *msg = (echo_msg_t *)req->data;
+	echo_pipeline_t *pipeline = msg->pipeline;
+
+	msg_free(msg);
+	msg_finished(pipeline);
+}
+
+static void work_cb(uv_work_t *req) {
+	echo_msg_t *msg = (echo_msg_t *)req->data;
+	echo_pipeline_t *pipeline = msg->pipeline;
+
+	pipeline->transform(msg->buf.base, msg->buf.len, pipeline->rounds);
+}
+
+/**
+ * Writes every finished message that is next in line.
+ */
+static void flush_in_order(echo_pipeline_t *pipeline) {
+	for (;;) {
+		echo_msg_t **slot = &pipeline->done[pipeline->write_seq % pipeline->max_inflight];
+		echo_msg_t *msg = *slot;
+
+		if (msg == NULL || msg->seq != pipeline->write_seq)
+			return;
+
+		*slot = NULL;
+		pipeline->write_seq++;
+
+		// closed, but its close callback did not run yet
+		if (uv_is_closing((uv_handle_t *)pipeline->stream)) {
+			msg_free(msg);
+			msg_finished(pipeline);
+			continue;
+		}
+		pipeline->messages++;
+
+		msg->write.data = msg;
+		if (uv_write(&msg->write, pipeline->stream, &msg->buf, 1, write_cb)) {
+			fprintf(stderr, "Error on writing client stream: %s.\n",
+					uv_strerror(uv_last_error(pipeline->stream->loop)));
+			msg_free(msg);
+			msg_finished(pipeline);
+		}
+	}
+}
+
+static void after_work_cb(uv_work_t *req, int status) {
+	echo_msg_t *msg = (echo_msg_t *)req->data;
+	echo_pipeline_t *pipeline = msg->pipeline;
+
+	if (pipeline->closing) {
+		msg_free(msg);
+		msg_finished(pipeline);
+		return;
+	}
+
+	// park it until everything submitted before it was written
+	assert(pipeline->done[msg->seq % pipeline->max_inflight] == NULL);
+	pipeline->done[msg->seq % pipeline->max_inflight] = msg;
+	flush_in_order(pipeline);
+}
+
+int echo_pipeline_init(echo_pipeline_t *pipeline, uv_stream_t *stream,
+		uv_alloc_cb alloc_cb, uv_read_cb read_cb,
+		echo_transform_fn transform, int rounds, int max_inflight) {
+	if (pipeline == NULL || stream == NULL || transform == NULL) {
+		return 1;
+	}
+	if (max_inflight < 1) {
+		return 2;
+	}
+
+	pipeline->stream = stream;
+	pipeline->alloc_cb = alloc_cb;
+	pipeline->read_cb = read_cb;
+	pipeline->transform = transform;
+	pipeline->rounds = rounds;
+	pipeline->messages = 0;
+	pipeline->max_inflight = max_inflight;
+	pipeline->inflight = 0;
+	pipeline->next_seq = 0;
+	pipeline->write_seq = 0;
+	pipeline->reading = 1;
+	pipeline->closing = 0;
+	pipeline->release_cb = NULL;
+	pipeline->done = (echo_msg_t **)calloc(max_inflight, sizeof(echo_msg_t *));
+
+	return pipeline->done == NULL ? 3 : 0;
+}
+
+int echo_pipeline_submit(echo_pipeline_t *pipeline, const char *data, size_t len) {
+	echo_msg_t *msg = (echo_msg_t *)malloc(sizeof(echo_msg_t));
+	if (msg == NULL) {
+		return 1;
+	}
+
+	msg->buf = uv_buf_init((char *)malloc(len), len);
+	if (msg->buf.base == NULL) {
+		free(msg);
+		return 1;
+	}
+	memcpy(msg->buf.base, data, len);
+	msg->pipeline = pipeline;
+	msg->seq = pipeline->next_seq++;
+	msg->work.data = msg;
+	pipeline->inflight++;
+
+	if (uv_queue_work(pipeline->stream->loop, &msg->work, work_cb, after_work_cb)) {
+		// keep the sequence gap-free, the message goes out untransformed
+		after_work_cb(&msg->work, -1);
+	}
+
+	// backpressure: stop reading until some messages were written
+	if (pipeline->inflight >= pipeline->max_inflight && pipeline->reading) {
+		pipeline->reading = 0;
+		uv_read_stop(pipeline->stream);
+	}
+
+	return 0;
+}
+
+void echo_pipeline_close(echo_pipeline_t *pipeline, echo_pipeline_release_cb release_cb) {
+	pipeline->closing = 1;
+	pipeline->release_cb = release_cb;
+
+	// finished messages waiting for their turn are never written now
+	for (int i = 0; i < pipeline->max_inflight; ++i) {
+		if (pipeline->done[i] != NULL) {
+			msg_free(pipeline->done[i]);
+			pipeline->done[i] = NULL;
+			pipeline->inflight--;
+		}
+	}
+
+	if (pipeline->inflight == 0) {
+		free(pipeline->done);
+		pipeline->done = NULL;
+		release_cb(pipeline);
+	}
+}
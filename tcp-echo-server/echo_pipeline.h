@@ -0,0 +1,69 @@
+#ifndef ECHO_PIPELINE_H
+#define ECHO_PIPELINE_H
+
+#include <uv.h>
+
+/**
+ * CPU heavy per-message transform, runs in the threadpool.
+ * Works in place on buf, len bytes, repeated rounds times.
+ */
+typedef void (*echo_transform_fn)(char *buf, size_t len, int rounds);
+
+typedef struct echo_pipeline_s echo_pipeline_t;
+
+/**
+ * Called once the pipeline was closed and nothing is in flight anymore.
+ */
+typedef void (*echo_pipeline_release_cb)(echo_pipeline_t *pipeline);
+
+struct echo_pipeline_s {
+	void *data;
+	uv_stream_t *stream; // where results are written, in submit order
+	uv_alloc_cb alloc_cb; // to resume reading after backpressure
+	uv_read_cb read_cb;
+	echo_transform_fn transform;
+	int rounds;
+	uint64_t messages; // messages written back
+	// private
+	int max_inflight;
+	int inflight; // submitted, write not finished yet
+	uint64_t next_seq; // seq of the next submitted message
+	uint64_t write_seq; // seq of the next message to write
+	struct echo_msg_s **done; // finished messages by seq % max_inflight
+	int reading; // 0 while reads are paused for backpressure
+	int closing;
+	echo_pipeline_release_cb release_cb;
+};
+
+/**
+ * Looks up a transform by name ("crc32", "xor").
+ * @return NULL if unknown
+ */
+echo_transform_fn echo_transform_by_name(const char *name);
+
+/**
+ * @param pipeline Must be allocated in caller.
+ * @param stream Connection the results are written to.
+ * @param alloc_cb, read_cb Used to restart reading after backpressure.
+ * @param max_inflight Messages per connection in the threadpool or being
+ *                     written. Reading stops while the limit is reached.
+ * @return 0 if success
+ */
+int echo_pipeline_init(echo_pipeline_t *pipeline, uv_stream_t *stream,
+		uv_alloc_cb alloc_cb, uv_read_cb read_cb,
+		echo_transform_fn transform, int rounds, int max_inflight);
+
+/**
+ * Copies len bytes of data and queues them for the transform.
+ * @return 0 if success
+ */
+int echo_pipeline_submit(echo_pipeline_t *pipeline, const char *data, size_t len);
+
+/**
+ * Drops results that were not written yet. release_cb runs once all work
+ * and writes of the pipeline finished, which may be right away.
+ * Call it from the close callback of stream.
+ */
+void echo_pipeline_close(echo_pipeline_t *pipeline, echo_pipeline_release_cb release_cb);
+
+#endif
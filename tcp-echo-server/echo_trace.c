@@ -0,0 +1,129 @@
+#include "echo_trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define QUEUED_INITIAL 64
+#define TRACE_FILE_BUFFER (256 * 1024)
+
+static const char *stage_names[ECHO_TRACE_STAGES] = {
+	"queue", "submit", "send", "total"
+};
+
+static void writer_closed_cb(fs_writer_t *writer) {
+	echo_trace_t *trace = (echo_trace_t *) writer->data;
+
+	trace->close_cb(trace);
+}
+
+int echo_trace_init(echo_trace_t *trace, uv_loop_t *loop, const char *path,
+		uint32_t sample_every) {
+	memset(trace, 0, sizeof(*trace));
+	for (int i = 0; i < ECHO_TRACE_STAGES; ++i)
+		hist_init(&trace->stages[i]);
+	trace->sample_every = sample_every ? sample_every : 1;
+	trace->countdown = trace->sample_every;
+
+	if (path == NULL)
+		return 0;
+	// records are small, the writer batches them into few large writes
+	if (fs_writer_open(loop, &trace->writer, path, TRACE_FILE_BUFFER)) {
+		fprintf(stderr, "Error on opening trace file %s: %s.\n", path,
+				uv_strerror(uv_last_error(loop)));
+		return -1;
+	}
+	trace->writer.data = trace;
+	trace->tracing = 1;
+
+	// the header goes out with the first records
+	echo_trace_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ECHO_TRACE_MAGIC, sizeof(header.magic));
+	header.record_size = sizeof(echo_trace_record_t);
+	header.sample_every = trace->sample_every;
+	memcpy(fs_writer_reserve(&trace->writer, sizeof(header)), &header, sizeof(header));
+	return 0;
+}
+
+int echo_trace_queued(echo_trace_t *trace, uint64_t read) {
+	if (trace->queued_count == trace->queued_size) {
+		size_t size = trace->queued_size ? trace->queued_size * 2 : QUEUED_INITIAL;
+		uint64_t *queued = (uint64_t *) malloc(size * sizeof(uint64_t));
+		if (queued == NULL)
+			return -1;
+		// unwrap, the oldest stamp moves to index 0
+		for (size_t i = 0; i < trace->queued_count; ++i)
+			queued[i] = trace->queued[(trace->queued_head + i) % trace->queued_size];
+		free(trace->queued);
+		trace->queued = queued;
+		trace->queued_head = 0;
+		trace->queued_size = size;
+	}
+	trace->queued[(trace->queued_head + trace->queued_count++) % trace->queued_size] = read;
+	return 0;
+}
+
+uint64_t echo_trace_dequeued(echo_trace_t *trace) {
+	if (trace->queued_count == 0)
+		return 0;
+	uint64_t read = trace->queued[trace->queued_head];
+	trace->queued_head = (trace->queued_head + 1) % trace->queued_size;
+	trace->queued_count--;
+	return read;
+}
+
+void echo_trace_done(echo_trace_t *trace, const echo_stamps_t *stamps, size_t len) {
+	hist_record(&trace->stages[ECHO_TRACE_QUEUE], stamps->dequeue - stamps->read);
+	hist_record(&trace->stages[ECHO_TRACE_SUBMIT], stamps->submit - stamps->dequeue);
+	hist_record(&trace->stages[ECHO_TRACE_SEND], stamps->done - stamps->submit);
+	hist_record(&trace->stages[ECHO_TRACE_TOTAL], stamps->done - stamps->read);
+
+	// messages can still finish while the loop drains the trace file
+	if (!trace->tracing || trace->close_cb != NULL || trace->writer.failed
+			|| --trace->countdown)
+		return;
+	trace->countdown = trace->sample_every;
+
+	echo_trace_record_t record;
+	char *out = fs_writer_reserve(&trace->writer, sizeof(record));
+	if (out == NULL) {
+		trace->dropped++;
+		return;
+	}
+	record.stamps = *stamps;
+	record.len = len;
+	memcpy(out, &record, sizeof(record));
+	trace->sampled++;
+	fs_writer_flush(&trace->writer);
+}
+
+void echo_trace_print(echo_trace_t *trace, FILE *out) {
+	for (int i = 0; i < ECHO_TRACE_STAGES; ++i) {
+		const histogram_t *h = &trace->stages[i];
+		fprintf(out, "latency %-6s count %llu, mean %.1f us, p50 %.1f us, "
+				"p99 %.1f us, p999 %.1f us, max %.1f us\n", stage_names[i],
+				(unsigned long long) hist_count(h), hist_mean(h) / 1e3,
+				hist_percentile(h, 0.5) / 1e3, hist_percentile(h, 0.99) / 1e3,
+				hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+	}
+	if (trace->tracing) {
+		fprintf(out, "trace file: %llu records sampled, %llu dropped, %llu bytes written\n",
+				(unsigned long long) trace->sampled, (unsigned long long) trace->dropped,
+				(unsigned long long) trace->writer.bytes);
+	}
+}
+
+void echo_trace_close(echo_trace_t *trace, echo_trace_close_cb close_cb) {
+	if (!trace->tracing) {
+		close_cb(trace);
+		return;
+	}
+	trace->close_cb = close_cb;
+	fs_writer_close(&trace->writer, writer_closed_cb);
+}
+
+void echo_trace_deinit(echo_trace_t *trace) {
+	free(trace->queued);
+	trace->queued = NULL;
+	trace->queued_count = 0;
+	trace->queued_size = 0;
+}
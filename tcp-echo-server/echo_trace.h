@@ -0,0 +1,114 @@
+#ifndef ECHO_TRACE_H
+#define ECHO_TRACE_H
+
+#include <stdio.h>
+#include <uv.h>
+#include "../internal/histogram.h"
+#include "fs_writer.h"
+
+/**
+ * Per-message latency from read_cb to the write callback.
+ *
+ * Every echoed message carries four uv_hrtime() stamps, the stage
+ * latencies between them go into histograms and one message in
+ * sample_every is appended to a binary trace file, through an fs_writer
+ * so the loop never waits for the disk. The server only calls
+ * into this when built with -DECHO_TRACE (make TRACE=1), otherwise the
+ * stamps and the calls are compiled out.
+ */
+
+typedef struct {
+	uint64_t read; // read_cb got the data
+	uint64_t dequeue; // taken out of buff_circular, same as read in echo mode
+	uint64_t submit; // uv_write returned
+	uint64_t done; // write callback ran
+} echo_stamps_t;
+
+enum {
+	ECHO_TRACE_QUEUE, // dequeue - read, waiting in the ring or spill log
+	ECHO_TRACE_SUBMIT, // submit - dequeue, uv_write including a direct send
+	ECHO_TRACE_SEND, // done - submit, kernel send buffer and the write queue
+	ECHO_TRACE_TOTAL, // done - read
+	ECHO_TRACE_STAGES
+};
+
+/**
+ * Trace file layout: one header, then sampled records in completion order.
+ */
+#define ECHO_TRACE_MAGIC "ECHOTRC1"
+
+typedef struct {
+	char magic[8];
+	uint32_t record_size; // sizeof(echo_trace_record_t)
+	uint32_t sample_every;
+} echo_trace_header_t;
+
+typedef struct {
+	echo_stamps_t stamps;
+	uint64_t len; // bytes written
+} echo_trace_record_t;
+
+typedef struct echo_trace_s echo_trace_t;
+
+typedef void (*echo_trace_close_cb)(echo_trace_t *trace);
+
+struct echo_trace_s {
+	histogram_t stages[ECHO_TRACE_STAGES];
+	uint64_t sampled;
+	uint64_t dropped; // sampled records that found both buffers full
+	// private
+	int tracing; // the trace file is open
+	fs_writer_t writer;
+	echo_trace_close_cb close_cb;
+	uint32_t sample_every;
+	uint32_t countdown;
+	uint64_t *queued; // read stamps of messages in the ring, oldest first
+	size_t queued_head;
+	size_t queued_count;
+	size_t queued_size;
+};
+
+/**
+ * @param path trace file, NULL for histograms only. Blocks while opening,
+ *             must stay valid until the trace is closed.
+ * @param sample_every write one record per this many messages
+ * @return 0 if success
+ */
+int echo_trace_init(echo_trace_t *trace, uv_loop_t *loop, const char *path,
+		uint32_t sample_every);
+
+/**
+ * Ring mode keeps plain uv_buf_t, the read stamps travel next to them:
+ * both the ring and the spill log are FIFO, so the n-th message dequeued
+ * is the n-th one queued.
+ * @return 0 if success
+ */
+int echo_trace_queued(echo_trace_t *trace, uint64_t read);
+
+/**
+ * @return read stamp of the oldest queued message, 0 if none
+ */
+uint64_t echo_trace_dequeued(echo_trace_t *trace);
+
+/**
+ * Records a finished message, stamps->done must be set.
+ */
+void echo_trace_done(echo_trace_t *trace, const echo_stamps_t *stamps, size_t len);
+
+/**
+ * Writes count, mean, p50, p99, p999 and max per stage, in microseconds.
+ */
+void echo_trace_print(echo_trace_t *trace, FILE *out);
+
+/**
+ * Writes the sampled records still buffered and closes the trace file,
+ * then calls close_cb; right away without one. Needs the loop to run.
+ */
+void echo_trace_close(echo_trace_t *trace, echo_trace_close_cb close_cb);
+
+/**
+ * Call it after echo_trace_close finished.
+ */
+void echo_trace_deinit(echo_trace_t *trace);
+
+#endif
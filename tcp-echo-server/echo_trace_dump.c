@@ -0,0 +1,49 @@
+/**
+ * Prints a trace file of tcp_echo_server -T as CSV, one sampled message
+ * per line: when it was read (relative to the first record) and the
+ * nanoseconds it spent in each stage.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "echo_trace.h"
+
+int main(int argc, char **argv) {
+	echo_trace_header_t header;
+	echo_trace_record_t record;
+	uint64_t first = 0;
+	uint64_t records = 0;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s trace file\n", argv[0]);
+		return 1;
+	}
+	FILE *f = fopen(argv[1], "rb");
+	if (f == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (fread(&header, sizeof(header), 1, f) != 1
+			|| memcmp(header.magic, ECHO_TRACE_MAGIC, sizeof(header.magic))
+			|| header.record_size != sizeof(record)) {
+		fprintf(stderr, "%s: not a trace file of this version\n", argv[1]);
+		fclose(f);
+		return 1;
+	}
+
+	printf("# sample_every=%u\n", header.sample_every);
+	printf("read_ns,queue_ns,submit_ns,send_ns,total_ns,len\n");
+	while (fread(&record, sizeof(record), 1, f) == 1) {
+		const echo_stamps_t *s = &record.stamps;
+		if (records++ == 0)
+			first = s->read;
+		printf("%llu,%llu,%llu,%llu,%llu,%llu\n",
+				(unsigned long long) (s->read - first),
+				(unsigned long long) (s->dequeue - s->read),
+				(unsigned long long) (s->submit - s->dequeue),
+				(unsigned long long) (s->done - s->submit),
+				(unsigned long long) (s->done - s->read),
+				(unsigned long long) record.len);
+	}
+	fclose(f);
+	return 0;
+}
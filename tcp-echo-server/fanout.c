@@ -0,0 +1,239 @@
+/**
+ * Load generator for tcp_echo_server -m broadcast.
+ *
+ * Connects a number of subscribers, then one publisher that sends
+ * messages at a fixed rate, each starting with its send time. Every
+ * subscriber should get every message; reports deliveries per second and
+ * the delay from publish to delivery.
+ *
+ * The server forwards bytes, not messages: once it dropped data for a
+ * slow subscriber (-D drop) that subscriber's messages are misaligned,
+ * so keep the server's default -D disconnect for latency numbers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <uv.h>
+
+#define MAX_SAMPLES (1 << 20) // latest delays kept for percentiles
+#define TICK_MS 1
+
+typedef struct {
+	uv_tcp_t handle;
+	uv_connect_t connect_req;
+	size_t partial; // bytes of the current message received so far
+	char stamp[sizeof(uint64_t)]; // start of the current message
+} sub_t;
+
+uv_loop_t *loop;
+uv_timer_t publish_timer;
+uv_timer_t stop_timer;
+sub_t *subs;
+uv_tcp_t publisher;
+uv_connect_t publisher_req;
+char *payload;
+
+const char *host = "127.0.0.1";
+int port = 3000;
+int subscribers = 1000;
+size_t msg_size = 64;
+int rate = 1000; // messages per second
+int seconds = 5;
+
+int connected = 0;
+int failed = 0;
+int stopping = 0;
+double due = 0; // messages to publish, carried between ticks
+uint64_t published = 0;
+uint64_t delivered = 0;
+uint64_t start_time;
+uint64_t *samples;
+uint64_t sample_count = 0;
+
+/**
+ * Messages are copied to the write and freed with it.
+ */
+void publish_write_cb(uv_write_t *req, int status) {
+	free(req->data);
+	free(req);
+}
+
+void publish_cb(uv_timer_t *handle, int status) {
+	due += rate * TICK_MS / 1000.0;
+	for (; due >= 1; due -= 1) {
+		uv_write_t *req = (uv_write_t *) malloc(sizeof(uv_write_t));
+		char *msg = (char *) malloc(msg_size);
+		uint64_t now = uv_hrtime();
+		memcpy(msg, payload, msg_size);
+		memcpy(msg, &now, sizeof(now));
+		uv_buf_t buf = uv_buf_init(msg, msg_size);
+		req->data = msg;
+		if (uv_write(req, (uv_stream_t *) &publisher, &buf, 1, publish_write_cb)) {
+			fprintf(stderr, "publish error: %s\n", uv_strerror(uv_last_error(loop)));
+			free(msg);
+			free(req);
+			return;
+		}
+		published++;
+	}
+}
+
+uv_buf_t alloc_buffer(uv_handle_t *handle, size_t size) {
+	return uv_buf_init((char *) malloc(size), size);
+}
+
+void read_cb(uv_stream_t *stream, ssize_t nread, uv_buf_t buf) {
+	sub_t *sub = (sub_t *) stream;
+
+	if (nread == -1) {
+		if (!stopping) {
+			fprintf(stderr, "subscriber lost: %s\n",
+					uv_strerror(uv_last_error(loop)));
+		}
+		uv_close((uv_handle_t *) stream, NULL);
+		free(buf.base);
+		return;
+	}
+
+	for (ssize_t i = 0; i < nread; ) {
+		size_t n = msg_size - sub->partial;
+		if (n > (size_t) (nread - i))
+			n = nread - i;
+		if (sub->partial < sizeof(sub->stamp)) {
+			size_t m = sizeof(sub->stamp) - sub->partial;
+			memcpy(sub->stamp + sub->partial, buf.base + i, m < n ? m : n);
+		}
+		sub->partial += n;
+		i += n;
+		if (sub->partial == msg_size) {
+			uint64_t sent_at;
+			memcpy(&sent_at, sub->stamp, sizeof(sent_at));
+			samples[sample_count++ % MAX_SAMPLES] = uv_hrtime() - sent_at;
+			delivered++;
+			sub->partial = 0;
+		}
+	}
+	free(buf.base);
+}
+
+void stop_cb(uv_timer_t *handle, int status);
+
+void publisher_connect_cb(uv_connect_t *req, int status) {
+	if (status == -1) {
+		fprintf(stderr, "publisher connect error: %s\n",
+				uv_strerror(uv_last_error(loop)));
+		uv_close((uv_handle_t *) &publisher, NULL);
+		return;
+	}
+	uv_timer_start(&publish_timer, publish_cb, TICK_MS, TICK_MS);
+	uv_timer_start(&stop_timer, stop_cb, seconds * 1000, 0);
+	start_time = uv_hrtime();
+}
+
+/**
+ * The publisher starts once every subscriber is connected or failed.
+ */
+void connect_cb(uv_connect_t *req, int status) {
+	sub_t *sub = (sub_t *) req->data;
+
+	if (status == -1) {
+		fprintf(stderr, "connect error: %s\n",
+				uv_strerror(uv_last_error(loop)));
+		uv_close((uv_handle_t *) &sub->handle, NULL);
+		failed++;
+	} else {
+		uv_read_start((uv_stream_t *) &sub->handle, alloc_buffer, read_cb);
+		connected++;
+	}
+	if (connected + failed == subscribers) {
+		printf("%d subscribers connected, %d failed\n", connected, failed);
+		uv_tcp_connect(&publisher_req, &publisher, uv_ip4_addr(host, port), publisher_connect_cb);
+	}
+}
+
+int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+double percentile_us(uint64_t n, double p) {
+	return n ? samples[(uint64_t) (p * (n - 1))] / 1e3 : 0;
+}
+
+void stop_cb(uv_timer_t *handle, int status) {
+	double elapsed = (uv_hrtime() - start_time) / 1e9;
+	uint64_t n = sample_count < MAX_SAMPLES ? sample_count : MAX_SAMPLES;
+	uint64_t expected = published * connected;
+
+	stopping = 1;
+	qsort(samples, n, sizeof(*samples), compare_u64);
+	printf("subscribers=%d size=%zu rate=%d seconds=%.2f published=%llu "
+			"deliveries/s=%.0f delivered=%.1f%% p50_us=%.1f p99_us=%.1f p999_us=%.1f\n",
+			connected, msg_size, rate, elapsed, (unsigned long long) published,
+			delivered / elapsed, expected ? 100.0 * delivered / expected : 0,
+			percentile_us(n, 0.5), percentile_us(n, 0.99), percentile_us(n, 0.999));
+
+	for (int i = 0; i < subscribers; ++i) {
+		uv_handle_t *h = (uv_handle_t *) &subs[i].handle;
+		if (!uv_is_closing(h))
+			uv_close(h, NULL);
+	}
+	uv_close((uv_handle_t *) &publisher, NULL);
+	uv_close((uv_handle_t *) &publish_timer, NULL);
+	uv_close((uv_handle_t *) &stop_timer, NULL);
+}
+
+void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-h host] [-p port] [-c subscribers] "
+			"[-s message size] [-r messages/s] [-t seconds]\n"
+			"  -s  at least %zu bytes, the send time goes first\n", name, sizeof(uint64_t));
+}
+
+int main(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "h:p:c:s:r:t:")) != -1) {
+		switch (opt) {
+			case 'h': host = optarg; break;
+			case 'p': port = atoi(optarg); break;
+			case 'c': subscribers = atoi(optarg); break;
+			case 's': msg_size = strtoul(optarg, NULL, 10); break;
+			case 'r': rate = atoi(optarg); break;
+			case 't': seconds = atoi(optarg); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (subscribers < 1 || msg_size < sizeof(uint64_t) || rate < 1 || seconds < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	loop = uv_default_loop();
+	payload = (char *) malloc(msg_size);
+	samples = (uint64_t *) malloc(MAX_SAMPLES * sizeof(*samples));
+	for (size_t i = 0; i < msg_size; ++i)
+		payload[i] = 'a' + i % 26;
+
+	uv_timer_init(loop, &publish_timer);
+	uv_timer_init(loop, &stop_timer);
+	uv_tcp_init(loop, &publisher);
+
+	struct sockaddr_in addr = uv_ip4_addr(host, port);
+	subs = (sub_t *) calloc(subscribers, sizeof(sub_t));
+	for (int i = 0; i < subscribers; ++i) {
+		uv_tcp_init(loop, &subs[i].handle);
+		subs[i].connect_req.data = &subs[i];
+		if (uv_tcp_connect(&subs[i].connect_req, &subs[i].handle, addr, connect_cb)) {
+			fprintf(stderr, "connect error: %s\n",
+					uv_strerror(uv_last_error(loop)));
+			return 1;
+		}
+	}
+
+	uv_run(loop, UV_RUN_DEFAULT);
+	free(subs);
+	free(payload);
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include "fs_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+static void start_write(fs_writer_t *writer);
+
+static void close_cb(uv_fs_t *req) {
+	fs_writer_t *writer = (fs_writer_t *) req->data;
+
+	uv_fs_req_cleanup(req);
+	free(writer->buffers[0].base);
+	free(writer->buffers[1].base);
+	writer->buffers[0].base = NULL;
+	writer->buffers[1].base = NULL;
+	writer->close_cb(writer);
+}
+
+static void write_cb(uv_fs_t *req);
+
+static void write_rest(fs_writer_t *writer) {
+	fs_writer_buffer_t *buffer = writer->writing;
+
+	if (uv_fs_write(writer->loop, &writer->fs_req, writer->fd,
+				buffer->base + writer->written, buffer->len - writer->written,
+				writer->offset + writer->written, write_cb)) {
+		writer->failed = 1;
+		writer->busy = 0;
+		start_write(writer);
+	}
+}
+
+static void write_cb(uv_fs_t *req) {
+	fs_writer_t *writer = (fs_writer_t *) req->data;
+	fs_writer_buffer_t *buffer = writer->writing;
+	int result = req->result;
+
+	uv_fs_req_cleanup(req);
+	if (result < 0) {
+		fprintf(stderr, "Error on writing %s: %s, writing to it stopped.\n",
+				writer->path, uv_strerror(uv_last_error(writer->loop)));
+		writer->failed = 1;
+		writer->busy = 0;
+		start_write(writer);
+		return;
+	}
+
+	writer->written += result;
+	if (writer->written < buffer->len) {
+		write_rest(writer);
+		return;
+	}
+	writer->offset += buffer->len;
+	writer->bytes += buffer->len;
+	buffer->len = 0;
+	writer->busy = 0;
+	start_write(writer);
+}
+
+/**
+ * Swaps the buffers and writes the full one, or closes the file once
+ * everything is out and fs_writer_close was called.
+ */
+static void start_write(fs_writer_t *writer) {
+	if (writer->busy)
+		return;
+
+	if (writer->failed)
+		writer->pending->len = 0;
+	if (writer->pending->len == 0) {
+		// close_cb frees the buffers and reports either way
+		if (writer->close_cb != NULL
+				&& uv_fs_close(writer->loop, &writer->fs_req, writer->fd, close_cb))
+			close_cb(&writer->fs_req);
+		return;
+	}
+
+	fs_writer_buffer_t *full = writer->pending;
+	writer->pending = writer->writing;
+	writer->writing = full;
+	writer->written = 0;
+	writer->busy = 1;
+	write_rest(writer);
+}
+
+int fs_writer_open(uv_loop_t *loop, fs_writer_t *writer, const char *path,
+		size_t buffer_size) {
+	uv_fs_t req;
+
+	writer->loop = loop;
+	writer->path = path;
+	writer->bytes = 0;
+	writer->failed = 0;
+	writer->offset = 0;
+	writer->written = 0;
+	writer->buffer_size = buffer_size;
+	writer->busy = 0;
+	writer->fs_req.data = writer;
+	writer->buffers[0].len = 0;
+	writer->buffers[1].len = 0;
+	writer->pending = &writer->buffers[0];
+	writer->writing = &writer->buffers[1];
+	writer->close_cb = NULL;
+
+	writer->fd = uv_fs_open(loop, &req, path, O_WRONLY | O_CREAT | O_TRUNC, 0644, NULL);
+	uv_fs_req_cleanup(&req);
+	if (writer->fd < 0)
+		return -1;
+
+	writer->buffers[0].base = (char *) malloc(buffer_size);
+	writer->buffers[1].base = (char *) malloc(buffer_size);
+	if (writer->buffers[0].base == NULL || writer->buffers[1].base == NULL) {
+		free(writer->buffers[0].base);
+		free(writer->buffers[1].base);
+		uv_fs_close(loop, &req, writer->fd, NULL);
+		uv_fs_req_cleanup(&req);
+		return -1;
+	}
+	return 0;
+}
+
+char *fs_writer_reserve(fs_writer_t *writer, size_t len) {
+	fs_writer_buffer_t *pending = writer->pending;
+
+	if (writer->failed || writer->close_cb != NULL
+			|| pending->len + len > writer->buffer_size)
+		return NULL;
+	pending->len += len;
+	return pending->base + pending->len - len;
+}
+
+void fs_writer_flush(fs_writer_t *writer) {
+	start_write(writer);
+}
+
+void fs_writer_close(fs_writer_t *writer, fs_writer_close_cb close_cb) {
+	writer->close_cb = close_cb;
+	start_write(writer);
+}
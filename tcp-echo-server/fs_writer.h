@@ -0,0 +1,70 @@
+#ifndef FS_WRITER_H
+#define FS_WRITER_H
+
+#include <uv.h>
+
+/**
+ * Appends to a file without blocking the loop.
+ *
+ * Data is copied into a buffer and written with uv_fs_write in the
+ * threadpool. While one buffer is being written the next one fills, so
+ * the loop never waits for the disk. If both are full the caller is told
+ * and drops what it wanted to write, memory never grows without bound.
+ */
+
+typedef struct fs_writer_s fs_writer_t;
+
+typedef void (*fs_writer_close_cb)(fs_writer_t *writer);
+
+typedef struct {
+	char *base;
+	size_t len;
+} fs_writer_buffer_t;
+
+struct fs_writer_s {
+	void *data;
+	uint64_t bytes; // written to the file
+	int failed; // a write failed, nothing more is written
+	// private
+	uv_loop_t *loop;
+	const char *path; // for error messages
+	uv_file fd;
+	uv_fs_t fs_req;
+	int64_t offset; // end of the file
+	size_t written; // bytes of the writing buffer done
+	size_t buffer_size;
+	int busy; // a write is in the threadpool
+	fs_writer_buffer_t buffers[2];
+	fs_writer_buffer_t *pending; // gathers new data
+	fs_writer_buffer_t *writing; // in flight
+	fs_writer_close_cb close_cb;
+};
+
+/**
+ * Creates (or truncates) path. Blocks while opening.
+ * @param path Must stay valid until the writer is closed.
+ * @param buffer_size bytes per buffer, bounds the writer's memory
+ * @return 0 if success
+ */
+int fs_writer_open(uv_loop_t *loop, fs_writer_t *writer, const char *path,
+		size_t buffer_size);
+
+/**
+ * Reserves len bytes at the end of the file, fill them in and call
+ * fs_writer_flush.
+ * @return NULL if they do not fit now, or the writer failed or is closing
+ */
+char *fs_writer_reserve(fs_writer_t *writer, size_t len);
+
+/**
+ * Starts writing what was reserved, unless a write is in flight already:
+ * its callback picks the rest up.
+ */
+void fs_writer_flush(fs_writer_t *writer);
+
+/**
+ * Writes what is buffered, closes the file and then calls close_cb.
+ */
+void fs_writer_close(fs_writer_t *writer, fs_writer_close_cb close_cb);
+
+#endif
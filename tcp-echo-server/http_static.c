@@ -0,0 +1,270 @@
+#include "http_static.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/////////////////////////////////////////////////////////////////////
+// parsing
+
+void http_parser_init(http_parser_t *parser) {
+	memset(parser, 0, sizeof(*parser));
+}
+
+/**
+ * Forgets the headers seen so far, keeps flags and the body to skip.
+ */
+static void request_reset(http_parser_t *parser) {
+	parser->line_len = 0;
+	parser->lines = 0;
+	parser->header_bytes = 0;
+	parser->http10 = 0;
+	parser->head = 0;
+	parser->close = 0;
+	parser->keep_alive = 0;
+	parser->chunked = 0;
+}
+
+static int lower(int c) {
+	return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c;
+}
+
+/**
+ * @param name Lower case, with the colon.
+ * @return length of name if line starts with it, ignoring case, else 0
+ */
+static size_t header_name(const char *line, size_t len, const char *name) {
+	size_t n = strlen(name);
+	if (len < n)
+		return 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (lower(line[i]) != name[i])
+			return 0;
+	}
+	return n;
+}
+
+/**
+ * @param token Lower case.
+ * @return 1 if value contains token, ignoring case
+ */
+static int has_token(const char *value, size_t len, const char *token) {
+	size_t n = strlen(token);
+	for (size_t i = 0; i + n <= len; ++i) {
+		if (header_name(value + i, len - i, token))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * METHOD SP target SP HTTP/1.x, the target is not looked at.
+ */
+static int request_line(http_parser_t *parser, const char *line, size_t len) {
+	if (len < 14 || memcmp(line + len - 9, " HTTP/1.", 8))
+		return -1;
+	if (line[len - 1] == '0')
+		parser->http10 = 1;
+	else if (line[len - 1] != '1')
+		return -1;
+	parser->head = !memcmp(line, "HEAD ", 5);
+	return 0;
+}
+
+/**
+ * @param len Bytes of the line kept, a prefix if it was long.
+ */
+static int header_line(http_parser_t *parser, const char *line, size_t len) {
+	size_t n;
+
+	if ((n = header_name(line, len, "connection:"))) {
+		parser->close |= has_token(line + n, len - n, "close");
+		parser->keep_alive |= has_token(line + n, len - n, "keep-alive");
+	} else if ((n = header_name(line, len, "content-length:"))) {
+		uint64_t length = 0;
+		while (n < len && (line[n] == ' ' || line[n] == '\t'))
+			++n;
+		if (n == len || line[n] < '0' || line[n] > '9')
+			return -1;
+		for (; n < len && line[n] >= '0' && line[n] <= '9'; ++n)
+			length = length * 10 + (line[n] - '0');
+		parser->body_left = length;
+	} else if (header_name(line, len, "transfer-encoding:")) {
+		parser->chunked = 1;
+	}
+	return 0;
+}
+
+static int headers_done(http_parser_t *parser) {
+	int flags = parser->head ? HTTP_HEAD : 0;
+
+	if (parser->chunked)
+		return -1;
+	if (parser->http10) {
+		// HTTP/1.0 closes unless the client asked otherwise
+		flags |= parser->keep_alive && !parser->close ? HTTP_KEEP_ALIVE : HTTP_CLOSE;
+	} else if (parser->close) {
+		flags |= HTTP_CLOSE;
+	}
+	parser->flags = flags;
+	request_reset(parser);
+	return 0;
+}
+
+int http_parse(http_parser_t *parser, const char **data, size_t *len) {
+	while (*len > 0) {
+		if (parser->in_body) {
+			size_t n = *len < parser->body_left ? *len : parser->body_left;
+			*data += n;
+			*len -= n;
+			parser->body_left -= n;
+			if (parser->body_left > 0)
+				break;
+			parser->in_body = 0;
+			parser->requests++;
+			return HTTP_REQUEST;
+		}
+
+		const char *nl = (const char *) memchr(*data, '\n', *len);
+		size_t n = nl != NULL ? (size_t) (nl - *data) + 1 : *len;
+		if (parser->line_len < HTTP_LINE_MAX) {
+			size_t keep = HTTP_LINE_MAX - parser->line_len;
+			memcpy(parser->line + parser->line_len, *data, n < keep ? n : keep);
+		}
+		parser->line_len += n;
+		parser->header_bytes += n;
+		*data += n;
+		*len -= n;
+		if (parser->header_bytes > HTTP_HEADERS_MAX)
+			return HTTP_BAD_REQUEST;
+		if (nl == NULL)
+			break;
+
+		// a whole line, without its CRLF unless it was cut
+		size_t line_len = parser->line_len;
+		size_t kept = line_len;
+		if (line_len > HTTP_LINE_MAX) {
+			kept = HTTP_LINE_MAX;
+		} else {
+			kept = line_len - 1;
+			if (kept > 0 && parser->line[kept - 1] == '\r')
+				kept--;
+		}
+		parser->line_len = 0;
+
+		if (kept == 0 && line_len <= 2) {
+			if (parser->lines == 0) {
+				parser->header_bytes = 0; // CRLF between requests
+				continue;
+			}
+			if (headers_done(parser))
+				return HTTP_BAD_REQUEST;
+			if (parser->body_left > 0) {
+				parser->in_body = 1;
+				continue;
+			}
+			parser->requests++;
+			return HTTP_REQUEST;
+		}
+
+		if (parser->lines++ == 0) {
+			if (line_len > HTTP_LINE_MAX || request_line(parser, parser->line, kept))
+				return HTTP_BAD_REQUEST;
+		} else if (header_line(parser, parser->line, kept)) {
+			return HTTP_BAD_REQUEST;
+		}
+	}
+	return HTTP_NEED_MORE;
+}
+
+/////////////////////////////////////////////////////////////////////
+// responses
+
+static int response_build(http_response_t *response, const char *head, size_t head_len,
+		const char *body, size_t body_len, int close) {
+	size_t copies = close ? 1 : HTTP_RESPONSE_REPEAT;
+
+	response->len = head_len + body_len;
+	response->close = close;
+	response->block = (char *) malloc(response->len * copies);
+	if (response->block == NULL)
+		return -1;
+	for (size_t i = 0; i < copies; ++i) {
+		char *p = response->block + i * response->len;
+		memcpy(p, head, head_len);
+		memcpy(p + head_len, body, body_len);
+	}
+	return 0;
+}
+
+int http_responses_init(http_responses_t *responses, const char *body, size_t body_len) {
+	static const char bad_request[] = "HTTP/1.1 400 Bad Request\r\n"
+			"Content-Length: 0\r\nConnection: close\r\n\r\n";
+	char head[256];
+
+	memset(responses, 0, sizeof(*responses));
+	for (int flags = 0; flags < 8; ++flags) {
+		if ((flags & HTTP_CLOSE) && (flags & HTTP_KEEP_ALIVE))
+			continue; // never asked for
+		int n = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n"
+				"Server: tcp_echo_server\r\n"
+				"Content-Type: text/plain\r\n"
+				"Content-Length: %zu\r\n"
+				"%s\r\n", body_len,
+				flags & HTTP_CLOSE ? "Connection: close\r\n"
+				: flags & HTTP_KEEP_ALIVE ? "Connection: keep-alive\r\n" : "");
+		if (response_build(&responses->ok[flags], head, n,
+				body, flags & HTTP_HEAD ? 0 : body_len, flags & HTTP_CLOSE)) {
+			http_responses_destroy(responses);
+			return -1;
+		}
+	}
+	if (response_build(&responses->bad_request, bad_request, sizeof(bad_request) - 1,
+			"", 0, 1)) {
+		http_responses_destroy(responses);
+		return -1;
+	}
+	return 0;
+}
+
+void http_responses_destroy(http_responses_t *responses) {
+	for (int flags = 0; flags < 8; ++flags) {
+		free(responses->ok[flags].block);
+		responses->ok[flags].block = NULL;
+	}
+	free(responses->bad_request.block);
+	responses->bad_request.block = NULL;
+}
+
+const http_response_t *http_response_for(const http_responses_t *responses,
+		const http_parser_t *parser, int result) {
+	if (result == HTTP_BAD_REQUEST)
+		return &responses->bad_request;
+	return &responses->ok[parser->flags];
+}
+
+/////////////////////////////////////////////////////////////////////
+// batching
+
+void http_batch_init(http_batch_t *batch) {
+	batch->nbufs = 0;
+	batch->close = 0;
+}
+
+int http_batch_add(http_batch_t *batch, const http_response_t *response) {
+	size_t copies = response->close ? 1 : HTTP_RESPONSE_REPEAT;
+
+	// runs of the same response become one buffer over its copies
+	if (batch->nbufs > 0) {
+		uv_buf_t *last = &batch->bufs[batch->nbufs - 1];
+		if (last->base == response->block && last->len + response->len <= response->len * copies) {
+			last->len += response->len;
+			batch->close = response->close;
+			return 0;
+		}
+	}
+	if (batch->nbufs == HTTP_BATCH_BUFS)
+		return -1;
+	batch->bufs[batch->nbufs++] = uv_buf_init(response->block, response->len);
+	batch->close = response->close;
+	return 0;
+}
@@ -0,0 +1,114 @@
+#ifndef HTTP_STATIC_H
+#define HTTP_STATIC_H
+
+#include <uv.h>
+#include <stdint.h>
+
+/**
+ * Minimal HTTP/1.1 for tcp_echo_server -m http: every request gets the
+ * same static response. Requests are parsed incrementally, so they may
+ * be split over reads, and several may come in one read (pipelining).
+ * Responses are serialized once at startup; all responses to one read
+ * are gathered into a batch and written with a single uv_write.
+ *
+ *   while ((r = http_parse(&parser, &data, &len)) != HTTP_NEED_MORE)
+ *       if (http_batch_add(&batch, http_response_for(&responses, &parser, r)))
+ *           ...batch full, write it and start a new one
+ *
+ * Request bodies with Content-Length are skipped, chunked bodies are
+ * refused with 400 Bad Request, as are request lines longer than
+ * HTTP_LINE_MAX.
+ */
+
+#define HTTP_LINE_MAX 256 // whole request line, prefix of header lines
+#define HTTP_HEADERS_MAX 8192 // request line and headers together
+#define HTTP_RESPONSE_REPEAT 64 // copies of each response, back to back
+#define HTTP_BATCH_BUFS 16
+
+typedef enum {
+	HTTP_NEED_MORE = 0, // all data consumed, request incomplete
+	HTTP_REQUEST = 1, // a complete request, flags are set
+	HTTP_BAD_REQUEST = -1 // answer 400 and close
+} http_parse_result_t;
+
+/**
+ * Response flags, also index the response table.
+ */
+#define HTTP_HEAD 1 // no body
+#define HTTP_CLOSE 2 // Connection: close, the last request served
+#define HTTP_KEEP_ALIVE 4 // Connection: keep-alive, for HTTP/1.0 clients
+
+typedef struct {
+	int flags; // HTTP_* of the last complete request
+	uint64_t requests;
+	// private
+	char line[HTTP_LINE_MAX];
+	size_t line_len; // of the current line, may be more than kept
+	int lines; // of the current request
+	size_t header_bytes;
+	int http10;
+	int head;
+	int close;
+	int keep_alive;
+	uint64_t body_left;
+	int in_body;
+	int chunked;
+} http_parser_t;
+
+typedef struct {
+	char *block; // each response HTTP_RESPONSE_REPEAT times
+	size_t len; // of one response
+	int close; // the connection is closed after it
+} http_response_t;
+
+/**
+ * Pre-serialized responses, one per combination of flags.
+ */
+typedef struct {
+	http_response_t ok[8];
+	http_response_t bad_request;
+} http_responses_t;
+
+/**
+ * Responses to one read, waiting to be written.
+ */
+typedef struct {
+	uv_buf_t bufs[HTTP_BATCH_BUFS];
+	int nbufs;
+	int close; // the last response closes the connection
+} http_batch_t;
+
+void http_parser_init(http_parser_t *parser);
+
+/**
+ * Consumes data up to the end of the next request.
+ * @param data, len Advanced past the consumed bytes.
+ * @return HTTP_REQUEST with parser->flags set, HTTP_NEED_MORE once len
+ *         is 0, HTTP_BAD_REQUEST after which the parser must not be fed
+ */
+int http_parse(http_parser_t *parser, const char **data, size_t *len);
+
+/**
+ * @param body Sent with every 200 OK.
+ * @return 0 if success
+ */
+int http_responses_init(http_responses_t *responses, const char *body, size_t body_len);
+
+void http_responses_destroy(http_responses_t *responses);
+
+/**
+ * @param result Of http_parse, HTTP_REQUEST or HTTP_BAD_REQUEST.
+ */
+const http_response_t *http_response_for(const http_responses_t *responses,
+		const http_parser_t *parser, int result);
+
+void http_batch_init(http_batch_t *batch);
+
+/**
+ * Appends a response, extending the last buffer when it is the previous
+ * copy of the same response.
+ * @return 0 if success, -1 if the batch is full and has to be written
+ */
+int http_batch_add(http_batch_t *batch, const http_response_t *response);
+
+#endif
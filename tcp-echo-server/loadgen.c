@@ -0,0 +1,384 @@
+/**
+ * Load generator for tcp_echo_server -m echo.
+ *
+ * Opens a number of connections, keeps depth messages in flight on each and
+ * counts the echoed bytes. The transform changes the payload, so only the
+ * amount of data coming back is checked, not its content.
+ *
+ * With -I the connections are mostly idle instead: each one sends a single
+ * message every idle interval, spread evenly over the interval.
+ *
+ * With -H it loads tcp_echo_server -m http instead: messages are GET
+ * requests, pipelined depth deep, and a message is done when its
+ * response was read. Requests replacing the answered ones go out in one
+ * write.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <uv.h>
+#include "socket_profile.h"
+
+#define MAX_DEPTH 1024
+#define MAX_SAMPLES (1 << 20) // latest latencies kept for percentiles
+#define TRICKLE_MS 10 // idle mode sends a slice of the connections this often
+
+typedef struct {
+	uv_tcp_t handle;
+	uv_connect_t connect_req;
+	size_t pending; // bytes sent and not yet echoed
+	size_t partial; // bytes of the current message received so far
+	uint64_t sent_at[MAX_DEPTH]; // send times of messages in flight, FIFO
+	int sent_head;
+	int sent_count;
+	// -H: the response being read
+	char line[64]; // prefix of the current header line
+	size_t line_len;
+	size_t content_length;
+	size_t body_left;
+	int in_body;
+} client_t;
+
+uv_loop_t *loop;
+uv_timer_t stop_timer;
+uv_timer_t trickle_timer;
+client_t *clients;
+char *payload;
+
+const char *host = "127.0.0.1";
+int port = 3000;
+int connections = 8;
+size_t msg_size = 4096;
+int depth = 4;
+int seconds = 5;
+int idle_ms = 0; // -I, 0 keeps depth messages in flight all the time
+int bind_addresses = 0; // -B, local addresses 127.0.0.2 and up
+const char *http_path = NULL; // -H, payload is MAX_DEPTH requests for it
+int trickle_next = 0;
+socket_profile_t profile;
+
+uint64_t messages = 0;
+uint64_t bytes = 0;
+uint64_t start_time;
+int stopping = 0;
+uint64_t *samples;
+uint64_t sample_count = 0;
+
+void write_cb(uv_write_t *req, int status) {
+	free(req);
+}
+
+int send_message(client_t *client) {
+	uv_write_t *req = (uv_write_t *) malloc(sizeof(uv_write_t));
+	uv_buf_t buf = uv_buf_init(payload, msg_size);
+
+	if (uv_write(req, (uv_stream_t *) &client->handle, &buf, 1, write_cb)) {
+		free(req);
+		return -1;
+	}
+	client->pending += msg_size;
+	client->sent_at[(client->sent_head + client->sent_count++) % MAX_DEPTH] = uv_hrtime();
+	return 0;
+}
+
+/**
+ * -H: n requests in a single write.
+ */
+int send_requests(client_t *client, int n) {
+	uv_write_t *req = (uv_write_t *) malloc(sizeof(uv_write_t));
+	uv_buf_t buf = uv_buf_init(payload, n * msg_size);
+	uint64_t now = uv_hrtime();
+
+	if (uv_write(req, (uv_stream_t *) &client->handle, &buf, 1, write_cb)) {
+		free(req);
+		return -1;
+	}
+	for (int i = 0; i < n; ++i)
+		client->sent_at[(client->sent_head + client->sent_count++) % MAX_DEPTH] = now;
+	return 0;
+}
+
+int send_messages(client_t *client, int n) {
+	if (http_path != NULL)
+		return send_requests(client, n);
+	for (int i = 0; i < n; ++i) {
+		if (send_message(client))
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Counts the oldest message in flight as answered.
+ */
+void message_done(client_t *client) {
+	messages++;
+	// the server answers in order, so this answers the oldest message
+	samples[sample_count++ % MAX_SAMPLES] = uv_hrtime() - client->sent_at[client->sent_head];
+	client->sent_head = (client->sent_head + 1) % MAX_DEPTH;
+	client->sent_count--;
+}
+
+/**
+ * -H: finds the ends of responses in data, a response ends after its
+ * headers and Content-Length bytes of body.
+ * @return responses completed
+ */
+int read_responses(client_t *client, const char *data, size_t len) {
+	int done = 0;
+
+	while (len > 0) {
+		if (client->in_body) {
+			size_t n = len < client->body_left ? len : client->body_left;
+			data += n;
+			len -= n;
+			client->body_left -= n;
+			if (client->body_left == 0) {
+				client->in_body = 0;
+				done++;
+			}
+			continue;
+		}
+
+		const char *nl = (const char *) memchr(data, '\n', len);
+		size_t n = nl != NULL ? (size_t) (nl - data) + 1 : len;
+		if (client->line_len < sizeof(client->line)) {
+			size_t keep = sizeof(client->line) - client->line_len;
+			memcpy(client->line + client->line_len, data, n < keep ? n : keep);
+		}
+		client->line_len += n;
+		data += n;
+		len -= n;
+		if (nl == NULL)
+			break;
+
+		size_t line_len = client->line_len;
+		client->line_len = 0;
+		if (line_len <= 2) {
+			// end of the headers
+			client->body_left = client->content_length;
+			client->content_length = 0;
+			if (client->body_left > 0)
+				client->in_body = 1;
+			else
+				done++;
+		} else if (line_len > 15 && !strncasecmp(client->line, "content-length:", 15)) {
+			client->content_length = strtoul(client->line + 15, NULL, 10);
+		}
+	}
+	return done;
+}
+
+uv_buf_t alloc_buffer(uv_handle_t *handle, size_t size) {
+	return uv_buf_init((char *) malloc(size), size);
+}
+
+void read_cb(uv_stream_t *stream, ssize_t nread, uv_buf_t buf) {
+	client_t *client = (client_t *) stream;
+
+	if (http_path != NULL && nread > 0) {
+		int done = read_responses(client, buf.base, nread);
+		free(buf.base);
+		bytes += nread;
+		for (int i = 0; i < done; ++i)
+			message_done(client);
+		if (!stopping && !idle_ms && done > 0)
+			send_requests(client, done);
+		return;
+	}
+
+	free(buf.base);
+	if (nread == -1) {
+		if (!stopping) {
+			fprintf(stderr, "connection lost: %s\n",
+					uv_strerror(uv_last_error(loop)));
+		}
+		uv_close((uv_handle_t *) stream, NULL);
+		return;
+	}
+
+	bytes += nread;
+	client->pending -= nread;
+	client->partial += nread;
+	while (client->partial >= msg_size) {
+		client->partial -= msg_size;
+		message_done(client);
+		if (!stopping && !idle_ms)
+			send_message(client);
+	}
+}
+
+void connect_cb(uv_connect_t *req, int status) {
+	client_t *client = (client_t *) req->data;
+
+	if (status == -1) {
+		fprintf(stderr, "connect error: %s\n",
+				uv_strerror(uv_last_error(loop)));
+		uv_close((uv_handle_t *) &client->handle, NULL);
+		return;
+	}
+
+	socket_profile_apply_client(&profile, &client->handle);
+	uv_read_start((uv_stream_t *) &client->handle, alloc_buffer, read_cb);
+	if (idle_ms)
+		return;
+	send_messages(client, depth);
+}
+
+/**
+ * Idle mode: one message to the next slice of connections, skipping those
+ * still waiting for the previous echo.
+ */
+void trickle_cb(uv_timer_t *handle, int status) {
+	int slice = (int) ((uint64_t) connections * TRICKLE_MS / idle_ms);
+
+	if (slice < 1)
+		slice = 1;
+	for (int i = 0; i < slice; ++i) {
+		client_t *client = &clients[trickle_next];
+		trickle_next = (trickle_next + 1) % connections;
+		uv_stream_t *stream = (uv_stream_t *) &client->handle;
+		if (client->sent_count == 0 && uv_is_readable(stream)
+				&& !uv_is_closing((uv_handle_t *) stream))
+			send_messages(client, 1);
+	}
+}
+
+int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+double percentile_us(uint64_t n, double p) {
+	return n ? samples[(uint64_t) (p * (n - 1))] / 1e3 : 0;
+}
+
+void stop_cb(uv_timer_t *handle, int status) {
+	double elapsed = (uv_hrtime() - start_time) / 1e9;
+	uint64_t n = sample_count < MAX_SAMPLES ? sample_count : MAX_SAMPLES;
+
+	stopping = 1;
+	if (idle_ms)
+		uv_close((uv_handle_t *) &trickle_timer, NULL);
+	qsort(samples, n, sizeof(*samples), compare_u64);
+	printf("%s connections=%d size=%zu depth=%d seconds=%.2f "
+			"msgs/s=%.0f MB/s=%.2f p50_us=%.1f p99_us=%.1f p999_us=%.1f\n",
+			profile.name, connections, msg_size, depth, elapsed,
+			messages / elapsed, bytes / elapsed / (1024 * 1024),
+			percentile_us(n, 0.5), percentile_us(n, 0.99), percentile_us(n, 0.999));
+
+	for (int i = 0; i < connections; ++i) {
+		uv_handle_t *handle = (uv_handle_t *) &clients[i].handle;
+		if (!uv_is_closing(handle))
+			uv_close(handle, NULL);
+	}
+	uv_close((uv_handle_t *) &stop_timer, NULL);
+}
+
+void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-h host] [-p port] [-c connections] "
+			"[-s message size] [-d depth] [-t seconds]\n"
+			"          [-P profile] [-O key=value,...] [-I idle ms] [-B addresses]\n"
+			"          [-H path]\n"
+			"  -P, -O  client side socket options, like tcp_echo_server\n"
+			"  -I  mostly idle connections, each sends one message every idle ms\n"
+			"  -B  spread connections over local addresses 127.0.0.2 and up, each\n"
+			"      address has its own ephemeral ports\n"
+			"  -H  pipeline HTTP/1.1 GET requests for path instead of echo messages,\n"
+			"      for tcp_echo_server -m http; -s is ignored\n", name);
+}
+
+int main(int argc, char **argv) {
+	const char *profile_options = NULL;
+	const socket_profile_t *found;
+	int opt;
+	profile = *socket_profile_find("default");
+	while ((opt = getopt(argc, argv, "h:p:c:s:d:t:P:O:I:B:H:")) != -1) {
+		switch (opt) {
+			case 'h': host = optarg; break;
+			case 'p': port = atoi(optarg); break;
+			case 'c': connections = atoi(optarg); break;
+			case 's': msg_size = strtoul(optarg, NULL, 10); break;
+			case 'd': depth = atoi(optarg); break;
+			case 't': seconds = atoi(optarg); break;
+			case 'P':
+				if ((found = socket_profile_find(optarg)) == NULL) {
+					usage(argv[0]);
+					return 1;
+				}
+				profile = *found;
+				break;
+			case 'O': profile_options = optarg; break;
+			case 'I': idle_ms = atoi(optarg); break;
+			case 'B': bind_addresses = atoi(optarg); break;
+			case 'H': http_path = optarg; break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (profile_options != NULL && socket_profile_parse(&profile, profile_options)) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (connections < 1 || msg_size < 1 || depth < 1 || depth > MAX_DEPTH || seconds < 1
+			|| idle_ms < 0 || bind_addresses < 0 || bind_addresses > 250) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	loop = uv_default_loop();
+	samples = (uint64_t *) malloc(MAX_SAMPLES * sizeof(*samples));
+	if (http_path != NULL) {
+		char request[1024];
+		msg_size = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s:%d\r\n\r\n",
+				http_path, host, port);
+		if (msg_size >= sizeof(request)) {
+			usage(argv[0]);
+			return 1;
+		}
+		payload = (char *) malloc(MAX_DEPTH * msg_size);
+		for (int i = 0; i < MAX_DEPTH; ++i)
+			memcpy(payload + i * msg_size, request, msg_size);
+	} else {
+		payload = (char *) malloc(msg_size);
+		for (size_t i = 0; i < msg_size; ++i)
+			payload[i] = 'a' + i % 26;
+	}
+
+	struct sockaddr_in addr = uv_ip4_addr(host, port);
+	clients = (client_t *) calloc(connections, sizeof(client_t));
+	for (int i = 0; i < connections; ++i) {
+		uv_tcp_init(loop, &clients[i].handle);
+		clients[i].connect_req.data = &clients[i];
+		if (bind_addresses) {
+			char local[16];
+			snprintf(local, sizeof(local), "127.0.0.%d", 2 + i % bind_addresses);
+			if (uv_tcp_bind(&clients[i].handle, uv_ip4_addr(local, 0))) {
+				fprintf(stderr, "bind error: %s\n",
+						uv_strerror(uv_last_error(loop)));
+				return 1;
+			}
+		}
+		if (uv_tcp_connect(&clients[i].connect_req, &clients[i].handle, addr, connect_cb)) {
+			fprintf(stderr, "connect error: %s\n",
+					uv_strerror(uv_last_error(loop)));
+			return 1;
+		}
+	}
+
+	uv_timer_init(loop, &stop_timer);
+	uv_timer_start(&stop_timer, stop_cb, seconds * 1000, 0);
+	if (idle_ms) {
+		uv_timer_init(loop, &trickle_timer);
+		uv_timer_start(&trickle_timer, trickle_cb, TRICKLE_MS, TRICKLE_MS);
+	}
+	start_time = uv_hrtime();
+
+	uv_run(loop, UV_RUN_DEFAULT);
+	free(clients);
+	free(payload);
+	free(samples);
+	return 0;
+}
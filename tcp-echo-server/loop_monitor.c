@@ -0,0 +1,147 @@
+#include "loop_monitor.h"
+#include <string.h>
+
+#define NS_PER_MS 1000000ULL
+
+static const char *handle_type_name(uv_handle_type type) {
+	switch (type) {
+#define XX(uc, lc) case UV_##uc: return #lc;
+		UV_HANDLE_TYPE_MAP(XX)
+#undef XX
+		default: return "unknown";
+	}
+}
+
+static void start_interval(loop_monitor_t *monitor, uint64_t now) {
+	monitor->interval_start = now;
+	monitor->poll_ns = 0;
+	monitor->poll_callback_ns = 0;
+	monitor->callback_ns = 0;
+	monitor->blocked = 0;
+	hist_init(&monitor->lag);
+}
+
+static void report(loop_monitor_t *monitor, uint64_t now) {
+	loop_monitor_stats_t stats;
+	const histogram_t *lag = &monitor->lag;
+
+	stats.interval_ns = now - monitor->interval_start;
+	stats.ticks = hist_count(lag);
+	stats.lag_p50 = hist_percentile(lag, 0.5);
+	stats.lag_p99 = hist_percentile(lag, 0.99);
+	stats.lag_p999 = hist_percentile(lag, 0.999);
+	stats.lag_max = lag->max;
+	stats.wait_ns = monitor->poll_ns > monitor->poll_callback_ns
+			? monitor->poll_ns - monitor->poll_callback_ns : 0;
+	stats.callback_ns = monitor->callback_ns;
+	stats.blocked = monitor->blocked;
+	start_interval(monitor, now);
+	if (monitor->report_cb != NULL)
+		monitor->report_cb(monitor, &stats);
+}
+
+static void tick_cb(uv_timer_t *handle, int status) {
+	loop_monitor_t *monitor = (loop_monitor_t *) handle->data;
+	uint64_t now = uv_hrtime();
+	uint64_t expected = monitor->last_tick + monitor->tick_ns;
+	uint64_t lag = now > expected ? now - expected : 0;
+
+	hist_record(&monitor->lag, lag);
+	monitor->last_tick = now;
+
+	// late, and no wrapped callback owned up to it: name the phase instead
+	if (monitor->block_ns && lag > monitor->block_ns && monitor->blamed_at < expected) {
+		fprintf(stderr, "loop monitor: timer ran %.1f ms late, the loop was blocked "
+				"outside wrapped callbacks\n", lag / 1e6);
+	}
+
+	if (now - monitor->interval_start >= monitor->report_ns)
+		report(monitor, now);
+}
+
+static void prepare_cb(uv_prepare_t *handle, int status) {
+	loop_monitor_t *monitor = (loop_monitor_t *) handle->data;
+
+	monitor->prepare_at = uv_hrtime();
+	monitor->in_poll = 1;
+}
+
+static void check_cb(uv_check_t *handle, int status) {
+	loop_monitor_t *monitor = (loop_monitor_t *) handle->data;
+
+	if (monitor->in_poll)
+		monitor->poll_ns += uv_hrtime() - monitor->prepare_at;
+	monitor->in_poll = 0;
+}
+
+void loop_monitor_leave_slow(loop_monitor_t *monitor) {
+	uint64_t now = uv_hrtime();
+	uint64_t elapsed = now - monitor->entered_at;
+
+	monitor->callback_ns += elapsed;
+	if (monitor->in_poll)
+		monitor->poll_callback_ns += elapsed;
+
+	if (monitor->block_ns && elapsed > monitor->block_ns) {
+		monitor->blocked++;
+		monitor->blamed_at = now;
+		fprintf(stderr, "loop monitor: %s blocked the loop for %.1f ms (%s handle %p)\n",
+				monitor->current_what, elapsed / 1e6,
+				handle_type_name(monitor->current->type), (void *) monitor->current);
+	}
+	monitor->current = NULL;
+}
+
+int loop_monitor_start(loop_monitor_t *monitor, uv_loop_t *loop, uint64_t tick_ms,
+		uint64_t report_ms, uint64_t block_ms, loop_monitor_report_cb report_cb) {
+	void *data = monitor->data;
+
+	memset(monitor, 0, sizeof(*monitor));
+	monitor->data = data;
+	monitor->loop = loop;
+	monitor->tick_ns = tick_ms * NS_PER_MS;
+	monitor->report_ns = report_ms * NS_PER_MS;
+	monitor->block_ns = block_ms * NS_PER_MS;
+	monitor->report_cb = report_cb;
+
+	if (uv_timer_init(loop, &monitor->tick)
+			|| uv_prepare_init(loop, &monitor->prepare)
+			|| uv_check_init(loop, &monitor->check))
+		return -1;
+	monitor->tick.data = monitor;
+	monitor->prepare.data = monitor;
+	monitor->check.data = monitor;
+
+	uv_timer_start(&monitor->tick, tick_cb, tick_ms, tick_ms);
+	uv_prepare_start(&monitor->prepare, prepare_cb);
+	uv_check_start(&monitor->check, check_cb);
+	uv_unref((uv_handle_t *) &monitor->tick);
+	uv_unref((uv_handle_t *) &monitor->prepare);
+	uv_unref((uv_handle_t *) &monitor->check);
+
+	monitor->last_tick = uv_hrtime();
+	start_interval(monitor, monitor->last_tick);
+	monitor->active = 1;
+	return 0;
+}
+
+void loop_monitor_stop(loop_monitor_t *monitor) {
+	if (!monitor->active)
+		return;
+	monitor->active = 0;
+	uv_close((uv_handle_t *) &monitor->tick, NULL);
+	uv_close((uv_handle_t *) &monitor->prepare, NULL);
+	uv_close((uv_handle_t *) &monitor->check, NULL);
+}
+
+void loop_monitor_print(const loop_monitor_stats_t *stats, FILE *out) {
+	double interval = stats->interval_ns ? (double) stats->interval_ns : 1;
+
+	fprintf(out, "loop lag over %.1f s: %llu ticks, p50 %.2f ms, p99 %.2f ms, "
+			"p999 %.2f ms, max %.2f ms; waiting %.1f%%, callbacks %.1f%%, "
+			"%llu blocking callbacks\n", stats->interval_ns / 1e9,
+			(unsigned long long) stats->ticks, stats->lag_p50 / 1e6,
+			stats->lag_p99 / 1e6, stats->lag_p999 / 1e6, stats->lag_max / 1e6,
+			100.0 * stats->wait_ns / interval, 100.0 * stats->callback_ns / interval,
+			(unsigned long long) stats->blocked);
+}
@@ -0,0 +1,104 @@
+#ifndef LOOP_MONITOR_H
+#define LOOP_MONITOR_H
+
+#include <stdio.h>
+#include <uv.h>
+#include "../internal/histogram.h"
+
+/**
+ * Loop health: how late timers run and where the loop spends its time.
+ *
+ * A repeating tick timer measures how much later than expected it fires,
+ * a prepare and a check handle bracket the poll phase. Callbacks wrapped
+ * in loop_monitor_enter/leave are timed as well, the poll phase minus
+ * the callbacks run inside it is time spent waiting in the kernel. Every
+ * report interval the collected stats go to report_cb and start over.
+ *
+ * The monitor's handles are unreferenced, they do not keep the loop alive.
+ */
+
+typedef struct loop_monitor_s loop_monitor_t;
+
+typedef struct {
+	uint64_t interval_ns; // length of this report interval
+	uint64_t ticks; // lag samples
+	uint64_t lag_p50; // ns the tick timer ran late
+	uint64_t lag_p99;
+	uint64_t lag_p999;
+	uint64_t lag_max;
+	uint64_t wait_ns; // blocked in the kernel waiting for events
+	uint64_t callback_ns; // in wrapped callbacks
+	uint64_t blocked; // wrapped callbacks that ran over block_ns
+} loop_monitor_stats_t;
+
+typedef void (*loop_monitor_report_cb)(loop_monitor_t *monitor,
+		const loop_monitor_stats_t *stats);
+
+struct loop_monitor_s {
+	void *data;
+	uint64_t block_ns; // warn about callbacks running longer than this
+	// private
+	uv_loop_t *loop;
+	uv_timer_t tick;
+	uv_prepare_t prepare;
+	uv_check_t check;
+	loop_monitor_report_cb report_cb;
+	uint64_t tick_ns;
+	uint64_t report_ns;
+	uint64_t interval_start;
+	uint64_t last_tick;
+	uint64_t prepare_at; // last poll phase started
+	uint64_t poll_ns; // prepare to check, this interval
+	uint64_t poll_callback_ns; // wrapped callbacks inside the poll phase
+	uint64_t callback_ns;
+	uint64_t blocked;
+	int in_poll;
+	int active;
+	int depth; // nested enter calls, only the outermost is timed
+	uint64_t entered_at;
+	uv_handle_t *current;
+	const char *current_what;
+	uint64_t blamed_at; // last time a callback got a warning
+	histogram_t lag;
+};
+
+/**
+ * Starts the tick, prepare and check handles.
+ * @param tick_ms how often the lag is sampled
+ * @param report_ms how often report_cb gets the stats
+ * @param block_ms warn on stderr when a wrapped callback takes longer, 0
+ *        for no warnings
+ * @return 0 if success
+ */
+int loop_monitor_start(loop_monitor_t *monitor, uv_loop_t *loop, uint64_t tick_ms,
+		uint64_t report_ms, uint64_t block_ms, loop_monitor_report_cb report_cb);
+
+/**
+ * Closes the monitor's handles, the memory must stay valid until the
+ * loop ran their close callbacks.
+ */
+void loop_monitor_stop(loop_monitor_t *monitor);
+
+void loop_monitor_print(const loop_monitor_stats_t *stats, FILE *out);
+
+void loop_monitor_leave_slow(loop_monitor_t *monitor);
+
+/**
+ * Brackets a callback: what names it in warnings, next to the type of
+ * handle. Nothing but a flag check while the monitor is not started.
+ */
+static inline void loop_monitor_enter(loop_monitor_t *monitor, uv_handle_t *handle,
+		const char *what) {
+	if (!monitor->active || monitor->depth++)
+		return;
+	monitor->current = handle;
+	monitor->current_what = what;
+	monitor->entered_at = uv_hrtime();
+}
+
+static inline void loop_monitor_leave(loop_monitor_t *monitor) {
+	if (monitor->active && --monitor->depth == 0)
+		loop_monitor_leave_slow(monitor);
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include "read_buffers.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * In front of every block, keeps the data 16 byte aligned.
+ */
+typedef union {
+	struct {
+		void *next; // free list link while in the pool
+		uint32_t cls;
+	} h;
+	char align[16];
+} block_header_t;
+
+#define CHUNK_BYTES (64 * 1024)
+
+/////////////////////////////////////////////////////////////////////
+// sizing
+
+void read_sizer_init(read_sizer_t *sizer) {
+	sizer->avg = 0;
+}
+
+size_t read_sizer_next(const read_sizer_t *sizer, size_t suggested) {
+	size_t size = READ_BUFFER_MIN;
+	while (size < sizer->avg && size < READ_BUFFER_MAX)
+		size *= 4;
+	return size < suggested ? size : suggested;
+}
+
+void read_sizer_update(read_sizer_t *sizer, ssize_t nread, size_t len) {
+	if (nread <= 0)
+		return;
+
+	if ((size_t)nread >= len) {
+		// the buffer was too small, skip a class
+		size_t avg = len * 16;
+		sizer->avg = avg < READ_BUFFER_MAX ? avg : READ_BUFFER_MAX;
+	} else if ((uint32_t)nread > sizer->avg) {
+		sizer->avg += ((uint32_t)nread - sizer->avg) / 2;
+	} else {
+		sizer->avg -= (sizer->avg - (uint32_t)nread) / 16;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// pooled buffers
+
+static int class_grow(read_buffer_class_t *c, uint32_t cls) {
+	size_t block = sizeof(block_header_t) + c->size;
+	size_t n = CHUNK_BYTES / block;
+	if (n == 0)
+		n = 1;
+
+	// the first header of a chunk links the chunks
+	char *chunk = (char *)malloc(sizeof(block_header_t) + n * block);
+	if (chunk == NULL) {
+		return -1;
+	}
+	((block_header_t *)chunk)->h.next = c->chunks;
+	c->chunks = chunk;
+
+	for (size_t i = 0; i < n; ++i) {
+		block_header_t *header = (block_header_t *)(chunk + sizeof(block_header_t) + i * block);
+		header->h.cls = cls;
+		header->h.next = c->free;
+		c->free = header;
+	}
+	c->stats.capacity += n;
+	c->stats.grows++;
+	return 0;
+}
+
+void read_buffers_init(read_buffers_t *buffers) {
+	size_t size = READ_BUFFER_MIN;
+
+	memset(buffers, 0, sizeof(*buffers));
+	for (int i = 0; i < READ_BUFFER_CLASSES; ++i) {
+		buffers->classes[i].size = size;
+		size *= 4;
+	}
+}
+
+uv_buf_t read_buffers_get(read_buffers_t *buffers, size_t size) {
+	uint32_t cls = 0;
+	while (cls < READ_BUFFER_CLASSES - 1 && buffers->classes[cls].size < size)
+		cls++;
+
+	read_buffer_class_t *c = &buffers->classes[cls];
+	if (c->free == NULL && class_grow(c, cls)) {
+		return uv_buf_init(NULL, 0);
+	}
+
+	block_header_t *header = (block_header_t *)c->free;
+	c->free = header->h.next;
+	c->stats.gets++;
+	if (++c->stats.in_use > c->stats.high_water)
+		c->stats.high_water = c->stats.in_use;
+
+	return uv_buf_init((char *)(header + 1), c->size);
+}
+
+void read_buffers_put(read_buffers_t *buffers, char *base) {
+	if (base == NULL)
+		return;
+
+	block_header_t *header = (block_header_t *)base - 1;
+	read_buffer_class_t *c = &buffers->classes[header->h.cls];
+
+	header->h.next = c->free;
+	c->free = header;
+	c->stats.puts++;
+	c->stats.in_use--;
+}
+
+void read_buffers_print(const read_buffers_t *buffers, FILE *out) {
+	for (int i = 0; i < READ_BUFFER_CLASSES; ++i) {
+		const read_buffer_class_t *c = &buffers->classes[i];
+		fprintf(out, "read buffers %6zu: in use %zu, high water %zu, capacity %zu, gets %llu\n",
+				c->size, c->stats.in_use, c->stats.high_water, c->stats.capacity,
+				(unsigned long long)c->stats.gets);
+	}
+}
+
+void read_buffers_destroy(read_buffers_t *buffers) {
+	for (int i = 0; i < READ_BUFFER_CLASSES; ++i) {
+		read_buffer_class_t *c = &buffers->classes[i];
+		while (c->chunks != NULL) {
+			void *next = ((block_header_t *)c->chunks)->h.next;
+			free(c->chunks);
+			c->chunks = next;
+		}
+		c->free = NULL;
+		c->stats.capacity = 0;
+	}
+}
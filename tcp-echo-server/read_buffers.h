@@ -0,0 +1,69 @@
+#ifndef READ_BUFFERS_H
+#define READ_BUFFERS_H
+
+#include <stdio.h>
+#include <uv.h>
+#include "../internal/pool.h"
+
+/**
+ * Size classes for read buffers, the largest is what libuv suggests.
+ */
+#define READ_BUFFER_CLASSES 5
+#define READ_BUFFER_MIN 256
+#define READ_BUFFER_MAX (64 * 1024)
+
+/**
+ * Recent read sizes of one connection, an exponential moving average of
+ * nread. Grows fast: a read that filled its buffer jumps two classes up,
+ * larger reads pull the average halfway. Shrinks slowly, by 1/16 of the
+ * difference per read.
+ */
+typedef struct {
+	uint32_t avg;
+} read_sizer_t;
+
+void read_sizer_init(read_sizer_t *sizer);
+
+/**
+ * @return buffer size for the next read, at most suggested
+ */
+size_t read_sizer_next(const read_sizer_t *sizer, size_t suggested);
+
+/**
+ * Feed back a read of nread bytes into a buffer of len bytes.
+ */
+void read_sizer_update(read_sizer_t *sizer, ssize_t nread, size_t len);
+
+/**
+ * One free list per size class, blocks are allocated in chunks of about
+ * 64 KiB and kept until read_buffers_destroy.
+ */
+typedef struct {
+	size_t size; // usable bytes per block
+	void *free;
+	void *chunks;
+	pool_stats_t stats;
+} read_buffer_class_t;
+
+typedef struct {
+	read_buffer_class_t classes[READ_BUFFER_CLASSES];
+} read_buffers_t;
+
+void read_buffers_init(read_buffers_t *buffers);
+
+/**
+ * @return a buffer of the smallest class holding size bytes (clamped to
+ *         READ_BUFFER_MAX), .base is NULL if out of memory
+ */
+uv_buf_t read_buffers_get(read_buffers_t *buffers, size_t size);
+
+/**
+ * Gives back a .base from read_buffers_get, NULL is ignored.
+ */
+void read_buffers_put(read_buffers_t *buffers, char *base);
+
+void read_buffers_print(const read_buffers_t *buffers, FILE *out);
+
+void read_buffers_destroy(read_buffers_t *buffers);
+
+#endif
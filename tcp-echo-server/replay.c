@@ -0,0 +1,312 @@
+/**
+ * Sends a traffic capture of tcp_echo_server -C to a server again.
+ *
+ * Every captured connection is opened, fed and closed in the captured
+ * order. With -x 1 (default) records go out at their captured times, with
+ * -x N N times faster, with -x 0 as fast as the server takes them. Echoes
+ * are counted, not checked. Payloads are written straight from the
+ * mapped capture file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <uv.h>
+#include "traffic_capture.h"
+
+#define MAX_INFLIGHT (8 * 1024 * 1024) // -x 0: written bytes not yet sent
+#define READ_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+	uv_tcp_t handle;
+	uv_connect_t connect_req;
+	uv_shutdown_t shutdown_req;
+	int connected;
+	int close_pending; // closed in the capture before the connect finished
+	int closed;
+} replay_conn_t;
+
+typedef struct {
+	uv_write_t req;
+	size_t len;
+} write_req_t;
+
+uv_loop_t *loop;
+uv_timer_t send_timer;
+uv_timer_t drain_timer;
+struct sockaddr_in addr;
+
+const char *host = "127.0.0.1";
+int port = 3000;
+double speed = 1;
+int drain_ms = 1000;
+
+const char *capture;
+size_t capture_size;
+size_t mapped_size;
+size_t pos; // next record in capture
+replay_conn_t **conns; // by captured connection id
+uint32_t conn_count;
+char read_buffer[READ_BUFFER_SIZE]; // echoes are dropped right away
+
+uint64_t start_time;
+uint64_t last_record_time;
+uint64_t records = 0;
+uint64_t sent_bytes = 0;
+uint64_t echoed_bytes = 0;
+uint64_t inflight_bytes = 0;
+uint64_t max_late = 0; // ns a record went out after its scheduled time
+uint32_t opened = 0;
+int done = 0;
+
+void pump();
+
+uv_buf_t alloc_buffer(uv_handle_t *handle, size_t size) {
+	return uv_buf_init(read_buffer, sizeof(read_buffer));
+}
+
+void close_cb(uv_handle_t *handle) {
+	((replay_conn_t *) handle)->closed = 1;
+}
+
+void close_conn(replay_conn_t *conn) {
+	if (!uv_is_closing((uv_handle_t *) &conn->handle))
+		uv_close((uv_handle_t *) &conn->handle, close_cb);
+}
+
+void read_cb(uv_stream_t *stream, ssize_t nread, uv_buf_t buf) {
+	if (nread == -1) {
+		close_conn((replay_conn_t *) stream);
+		return;
+	}
+	echoed_bytes += nread;
+}
+
+void shutdown_cb(uv_shutdown_t *req, int status) {
+	/* the server closes on EOF, read_cb closes our side then */
+	if (status == -1)
+		close_conn((replay_conn_t *) req->handle);
+}
+
+void shutdown_conn(replay_conn_t *conn) {
+	if (uv_shutdown(&conn->shutdown_req, (uv_stream_t *) &conn->handle, shutdown_cb))
+		close_conn(conn);
+}
+
+void connect_cb(uv_connect_t *req, int status) {
+	replay_conn_t *conn = (replay_conn_t *) req->handle;
+
+	if (status == -1) {
+		fprintf(stderr, "connect error: %s\n", uv_strerror(uv_last_error(loop)));
+		close_conn(conn);
+		return;
+	}
+	conn->connected = 1;
+	uv_read_start((uv_stream_t *) &conn->handle, alloc_buffer, read_cb);
+	if (conn->close_pending)
+		shutdown_conn(conn);
+}
+
+/**
+ * @return the connection for a captured id, connecting on first use
+ */
+replay_conn_t *get_conn(uint32_t id) {
+	if (conns[id] != NULL)
+		return conns[id];
+
+	replay_conn_t *conn = (replay_conn_t *) calloc(1, sizeof(replay_conn_t));
+	conns[id] = conn;
+	uv_tcp_init(loop, &conn->handle);
+	if (uv_tcp_connect(&conn->connect_req, &conn->handle, addr, connect_cb)) {
+		fprintf(stderr, "connect error: %s\n", uv_strerror(uv_last_error(loop)));
+		close_conn(conn);
+	}
+	opened++;
+	return conn;
+}
+
+void write_cb(uv_write_t *req, int status) {
+	write_req_t *wr = (write_req_t *) req;
+
+	inflight_bytes -= wr->len;
+	free(wr);
+	if (speed == 0 && !done)
+		pump();
+}
+
+void replay_record(const traffic_record_t *record, const char *payload) {
+	replay_conn_t *conn = get_conn(record->conn);
+
+	records++;
+	if (uv_is_closing((uv_handle_t *) &conn->handle))
+		return;
+
+	if (record->len == TRAFFIC_OPEN)
+		return;
+	if (record->len == TRAFFIC_CLOSE) {
+		if (conn->connected)
+			shutdown_conn(conn);
+		else
+			conn->close_pending = 1;
+		return;
+	}
+
+	/* written before the connect finished, libuv queues it */
+	write_req_t *wr = (write_req_t *) malloc(sizeof(write_req_t));
+	uv_buf_t buf = uv_buf_init((char *) payload, record->len);
+	wr->len = record->len;
+	if (uv_write(&wr->req, (uv_stream_t *) &conn->handle, &buf, 1, write_cb)) {
+		free(wr);
+		return;
+	}
+	inflight_bytes += record->len;
+	sent_bytes += record->len;
+}
+
+void drain_cb(uv_timer_t *handle, int status) {
+	for (uint32_t i = 0; i < conn_count; ++i) {
+		if (conns[i] != NULL)
+			close_conn(conns[i]);
+	}
+	uv_close((uv_handle_t *) &send_timer, NULL);
+	uv_close((uv_handle_t *) &drain_timer, NULL);
+}
+
+void send_timer_cb(uv_timer_t *handle, int status) {
+	pump();
+}
+
+/**
+ * Sends every record that is due, then sleeps until the next one.
+ */
+void pump() {
+	uint64_t now = uv_hrtime() - start_time;
+
+	while (pos < capture_size) {
+		traffic_record_t record;
+		memcpy(&record, capture + pos, sizeof(record));
+
+		if (speed > 0) {
+			uint64_t due = (uint64_t) (record.time / speed);
+			if (due > now) {
+				uv_timer_start(&send_timer, send_timer_cb, (due - now + 999999) / 1000000, 0);
+				return;
+			}
+			if (now - due > max_late)
+				max_late = now - due;
+		} else if (inflight_bytes > MAX_INFLIGHT) {
+			return; // write_cb picks up again
+		}
+
+		replay_record(&record, capture + pos + sizeof(record));
+		pos += sizeof(record);
+		if (record.len != TRAFFIC_OPEN && record.len != TRAFFIC_CLOSE)
+			pos += record.len;
+	}
+
+	done = 1;
+	uv_timer_start(&drain_timer, drain_cb, drain_ms, 0);
+}
+
+/**
+ * Checks the records and finds the highest connection id.
+ * @return 0 if success
+ */
+int scan_capture() {
+	traffic_header_t header;
+	size_t at = sizeof(header);
+
+	if (capture_size < sizeof(header))
+		return -1;
+	memcpy(&header, capture, sizeof(header));
+	if (memcmp(header.magic, TRAFFIC_MAGIC, sizeof(header.magic))
+			|| header.record_size != sizeof(traffic_record_t))
+		return -1;
+
+	pos = at;
+	while (at + sizeof(traffic_record_t) <= capture_size) {
+		traffic_record_t record;
+		memcpy(&record, capture + at, sizeof(record));
+		at += sizeof(record);
+		if (record.len != TRAFFIC_OPEN && record.len != TRAFFIC_CLOSE)
+			at += record.len;
+		if (at > capture_size)
+			break; // cut off while the server was killed
+		if (record.conn >= conn_count)
+			conn_count = record.conn + 1;
+		last_record_time = record.time;
+		pos = at;
+	}
+	capture_size = pos; // replay the complete records only
+	pos = sizeof(header);
+	return 0;
+}
+
+void usage(const char *name) {
+	fprintf(stderr, "usage: %s -f capture file [-h host] [-p port] [-x speed] "
+			"[-d drain ms]\n"
+			"  -x  1 sends at the captured pace (default), N N times faster,\n"
+			"      0 as fast as possible\n"
+			"  -d  wait this long for echoes after the last record (default 1000)\n",
+			name);
+}
+
+int main(int argc, char **argv) {
+	const char *path = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "f:h:p:x:d:")) != -1) {
+		switch (opt) {
+			case 'f': path = optarg; break;
+			case 'h': host = optarg; break;
+			case 'p': port = atoi(optarg); break;
+			case 'x': speed = atof(optarg); break;
+			case 'd': drain_ms = atoi(optarg); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (path == NULL || speed < 0 || drain_ms < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(path);
+		return 1;
+	}
+	capture_size = mapped_size = st.st_size;
+	capture = capture_size ? mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (capture == MAP_FAILED || scan_capture()) {
+		fprintf(stderr, "%s: not a traffic capture\n", path);
+		return 1;
+	}
+	madvise((void *) capture, capture_size, MADV_SEQUENTIAL);
+
+	loop = uv_default_loop();
+	addr = uv_ip4_addr(host, port);
+	conns = (replay_conn_t **) calloc(conn_count ? conn_count : 1, sizeof(replay_conn_t *));
+	uv_timer_init(loop, &send_timer);
+	uv_timer_init(loop, &drain_timer);
+
+	start_time = uv_hrtime();
+	pump();
+	uv_run(loop, UV_RUN_DEFAULT);
+
+	double elapsed = (uv_hrtime() - start_time) / 1e9 - drain_ms / 1e3;
+	printf("replayed %llu records on %u connections: captured %.2f s, replayed in %.2f s, "
+			"sent %llu bytes, echoed %llu bytes, at most %.2f ms behind schedule\n",
+			(unsigned long long) records, opened, last_record_time / 1e9, elapsed,
+			(unsigned long long) sent_bytes, (unsigned long long) echoed_bytes,
+			max_late / 1e6);
+
+	for (uint32_t i = 0; i < conn_count; ++i)
+		free(conns[i]);
+	free(conns);
+	munmap((void *) capture, mapped_size);
+	return 0;
+}
@@ -0,0 +1,133 @@
+#include "socket_profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+static const socket_profile_t profiles[] = {
+	// what the server always did: backlog 128, no options
+	{ "default",    0, 0,  0,           0,           128,  -1, 0 },
+	// small request/response, answer as soon as possible
+	{ "latency",    1, 60, 0,           0,           128,  -1, 50 },
+	// bulk transfer, large windows, let Nagle merge small writes
+	{ "throughput", 0, 60, 4 << 20,     4 << 20,     1024, -1, 0 },
+	// lots of mostly idle clients, small buffers, deep accept queue
+	{ "many",       1, 30, 64 << 10,    64 << 10,    4096, 1,  0 },
+};
+
+#define PROFILE_COUNT (sizeof(profiles) / sizeof(profiles[0]))
+
+const socket_profile_t *socket_profile_find(const char *name) {
+	for (size_t i = 0; i < PROFILE_COUNT; ++i) {
+		if (!strcmp(profiles[i].name, name))
+			return &profiles[i];
+	}
+	return NULL;
+}
+
+void socket_profile_list(FILE *out) {
+	for (size_t i = 0; i < PROFILE_COUNT; ++i)
+		fprintf(out, "%s%s", i ? " " : "", profiles[i].name);
+}
+
+int socket_profile_parse(socket_profile_t *profile, const char *options) {
+	char *copy = strdup(options);
+	char *save = NULL;
+	int error = 0;
+
+	for (char *item = strtok_r(copy, ",", &save); item != NULL && !error;
+			item = strtok_r(NULL, ",", &save)) {
+		char *value = strchr(item, '=');
+		if (value == NULL) {
+			error = 1;
+			break;
+		}
+		*value++ = '\0';
+
+		char *end;
+		long v = strtol(value, &end, 10);
+		if (*end != '\0') {
+			error = 2;
+		} else if (!strcmp(item, "nodelay")) {
+			profile->nodelay = v;
+		} else if (!strcmp(item, "keepalive")) {
+			profile->keepalive = v;
+		} else if (!strcmp(item, "rcvbuf")) {
+			profile->rcvbuf = v;
+		} else if (!strcmp(item, "sndbuf")) {
+			profile->sndbuf = v;
+		} else if (!strcmp(item, "backlog")) {
+			profile->backlog = v;
+		} else if (!strcmp(item, "simultaneous_accepts")) {
+			profile->simultaneous_accepts = v;
+		} else if (!strcmp(item, "busy_poll")) {
+			profile->busy_poll = v;
+		} else {
+			error = 3;
+		}
+	}
+
+	free(copy);
+	if (!error && profile->backlog < 1)
+		error = 4;
+	return error;
+}
+
+/**
+ * There is no uv_fileno, the descriptor lives in the stream's io watcher.
+ */
+static int tcp_fd(uv_tcp_t *handle) {
+	return handle->io_watcher.fd;
+}
+
+static int set_int(int fd, int level, int name, int value, const char *what) {
+	if (setsockopt(fd, level, name, &value, sizeof(value))) {
+		fprintf(stderr, "Error on setting %s: %s.\n", what, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int apply_buffers(const socket_profile_t *profile, int fd) {
+	int error = 0;
+
+	if (profile->rcvbuf)
+		error |= set_int(fd, SOL_SOCKET, SO_RCVBUF, profile->rcvbuf, "SO_RCVBUF");
+	if (profile->sndbuf)
+		error |= set_int(fd, SOL_SOCKET, SO_SNDBUF, profile->sndbuf, "SO_SNDBUF");
+	return error;
+}
+
+int socket_profile_apply_listener(const socket_profile_t *profile, uv_tcp_t *server) {
+	int error = apply_buffers(profile, tcp_fd(server));
+
+	if (profile->simultaneous_accepts >= 0)
+		error |= uv_tcp_simultaneous_accepts(server, profile->simultaneous_accepts);
+	return error;
+}
+
+int socket_profile_apply_client(const socket_profile_t *profile, uv_tcp_t *client) {
+	int error = apply_buffers(profile, tcp_fd(client));
+
+	if (profile->nodelay)
+		error |= uv_tcp_nodelay(client, 1);
+	if (profile->keepalive)
+		error |= uv_tcp_keepalive(client, 1, profile->keepalive);
+	if (profile->busy_poll) {
+#ifdef SO_BUSY_POLL
+		error |= set_int(tcp_fd(client), SOL_SOCKET, SO_BUSY_POLL,
+				profile->busy_poll, "SO_BUSY_POLL");
+#else
+		fprintf(stderr, "SO_BUSY_POLL is not supported here, ignored.\n");
+#endif
+	}
+	return error;
+}
+
+void socket_profile_print(const socket_profile_t *profile, FILE *out) {
+	fprintf(out, "profile=%s nodelay=%d keepalive=%u rcvbuf=%d sndbuf=%d "
+			"backlog=%d simultaneous_accepts=%d busy_poll=%d",
+			profile->name, profile->nodelay, profile->keepalive,
+			profile->rcvbuf, profile->sndbuf, profile->backlog,
+			profile->simultaneous_accepts, profile->busy_poll);
+}
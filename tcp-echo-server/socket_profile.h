@@ -0,0 +1,54 @@
+#ifndef SOCKET_PROFILE_H
+#define SOCKET_PROFILE_H
+
+#include <stdio.h>
+#include <uv.h>
+
+/**
+ * Socket options applied to a listener and to every accepted (or
+ * connected) client. 0 leaves the kernel default in place.
+ */
+typedef struct {
+	const char *name;
+	int nodelay; // TCP_NODELAY via uv_tcp_nodelay
+	unsigned int keepalive; // keepalive delay in seconds via uv_tcp_keepalive
+	int rcvbuf; // SO_RCVBUF bytes
+	int sndbuf; // SO_SNDBUF bytes
+	int backlog; // uv_listen backlog, must not be 0
+	int simultaneous_accepts; // uv_tcp_simultaneous_accepts, -1 to leave it
+	int busy_poll; // SO_BUSY_POLL microseconds, Linux only
+} socket_profile_t;
+
+/**
+ * Looks up a builtin profile: default, latency, throughput, many.
+ * @return NULL if unknown
+ */
+const socket_profile_t *socket_profile_find(const char *name);
+
+/**
+ * Writes the builtin profile names, separated by spaces.
+ */
+void socket_profile_list(FILE *out);
+
+/**
+ * Overrides fields from "key=value,key=value", keys are the field names.
+ * @return 0 if success
+ */
+int socket_profile_parse(socket_profile_t *profile, const char *options);
+
+/**
+ * Call after uv_tcp_bind and before uv_listen, the receive buffer size is
+ * inherited by accepted sockets and sets the window scale.
+ * @return 0 if success
+ */
+int socket_profile_apply_listener(const socket_profile_t *profile, uv_tcp_t *server);
+
+/**
+ * Call after uv_accept or once connected.
+ * @return 0 if success
+ */
+int socket_profile_apply_client(const socket_profile_t *profile, uv_tcp_t *client);
+
+void socket_profile_print(const socket_profile_t *profile, FILE *out);
+
+#endif
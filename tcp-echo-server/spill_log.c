@@ -0,0 +1,403 @@
+#include "spill_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/**
+ * Drained segments kept for reuse, more are unmapped and closed.
+ */
+#define SPILL_SPARE_SEGMENTS 2
+
+/**
+ * Records copied back into memory per read job.
+ */
+#define SPILL_READ_AHEAD 64
+
+/**
+ * Records in a segment are a uint32_t length followed by the data,
+ * padded to 8 bytes.
+ */
+#define RECORD_SIZE(len) ((sizeof(uint32_t) + (len) + 7) & ~(size_t)7)
+
+enum {
+	JOB_WRITE,
+	JOB_READ
+};
+
+typedef struct {
+	QUEUE queue;
+	uv_buf_t buf;
+} spill_record_t;
+
+static void kick(spill_log_t *spill);
+
+/**
+ * Records are on their way to a segment, but not counted in disk_records
+ * yet. Decided from loop thread state only, writing belongs to the job.
+ */
+static int write_in_flight(const spill_log_t *spill) {
+	return spill->busy && spill->job == JOB_WRITE;
+}
+
+/////////////////////////////////////////////////////////////////////
+// segments, only touched by the running job or while no job runs
+
+static void segment_destroy(spill_log_t *spill, spill_segment_t *seg) {
+	munmap(seg->base, spill->segment_size);
+	close(seg->fd);
+	free(seg);
+}
+
+static spill_segment_t *segment_create(spill_log_t *spill) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/echo-spill-XXXXXX", spill->dir);
+
+	int fd = mkstemp(path);
+	if (fd == -1) {
+		return NULL;
+	}
+	unlink(path); // nothing to clean up after a crash
+
+	if (posix_fallocate(fd, 0, spill->segment_size)) {
+		close(fd);
+		return NULL;
+	}
+
+	char *base = (char *)mmap(NULL, spill->segment_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	madvise(base, spill->segment_size, MADV_SEQUENTIAL);
+
+	spill_segment_t *seg = (spill_segment_t *)malloc(sizeof(spill_segment_t));
+	seg->fd = fd;
+	seg->base = base;
+	spill->segments_created++;
+	return seg;
+}
+
+/**
+ * Appends an empty segment, a recycled one if possible.
+ */
+static spill_segment_t *segment_add(spill_log_t *spill) {
+	spill_segment_t *seg;
+
+	if (!QUEUE_EMPTY(&spill->free_segments)) {
+		QUEUE *q = QUEUE_HEAD(&spill->free_segments);
+		QUEUE_REMOVE(q);
+		spill->free_count--;
+		spill->segments_recycled++;
+		seg = QUEUE_DATA(q, spill_segment_t, queue);
+	} else {
+		seg = segment_create(spill);
+		if (seg == NULL) {
+			return NULL;
+		}
+	}
+
+	seg->write_pos = 0;
+	seg->read_pos = 0;
+	QUEUE_INSERT_TAIL(&spill->segments, &seg->queue);
+	return seg;
+}
+
+static void segment_release(spill_log_t *spill, spill_segment_t *seg) {
+	QUEUE_REMOVE(&seg->queue);
+	if (spill->free_count < SPILL_SPARE_SEGMENTS) {
+		QUEUE_INSERT_TAIL(&spill->free_segments, &seg->queue);
+		spill->free_count++;
+	} else {
+		segment_destroy(spill, seg);
+	}
+}
+
+static void check_resume(spill_log_t *spill) {
+	if (spill->paused && spill->staged_bytes < spill->max_staged / 2) {
+		spill->paused = 0;
+		if (spill->resume_cb != NULL)
+			spill->resume_cb(spill);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// jobs
+
+static void write_work(uv_work_t *req) {
+	spill_log_t *spill = (spill_log_t *)req->data;
+
+	spill->job_records = 0;
+	spill->job_bytes = 0;
+	spill->job_error = 0;
+	while (!QUEUE_EMPTY(&spill->writing)) {
+		QUEUE *q = QUEUE_HEAD(&spill->writing);
+		spill_record_t *rec = QUEUE_DATA(q, spill_record_t, queue);
+		size_t size = RECORD_SIZE(rec->buf.len);
+		spill_segment_t *seg = NULL;
+
+		if (!QUEUE_EMPTY(&spill->segments)) {
+			seg = QUEUE_DATA(QUEUE_PREV(&spill->segments), spill_segment_t, queue);
+			if (seg->write_pos + size > spill->segment_size)
+				seg = NULL;
+		}
+		if (seg == NULL && (seg = segment_add(spill)) == NULL) {
+			spill->job_error = 1; // the rest stays in memory
+			return;
+		}
+
+		uint32_t len = rec->buf.len;
+		memcpy(seg->base + seg->write_pos, &len, sizeof(len));
+		memcpy(seg->base + seg->write_pos + sizeof(len), rec->buf.base, len);
+		seg->write_pos += size;
+
+		QUEUE_REMOVE(q);
+		spill->job_records++;
+		spill->job_bytes += len;
+		free(rec->buf.base);
+		free(rec);
+	}
+}
+
+static void read_work(uv_work_t *req) {
+	spill_log_t *spill = (spill_log_t *)req->data;
+
+	spill->job_records = 0;
+	while (spill->job_records < spill->read_ahead && !QUEUE_EMPTY(&spill->segments)) {
+		QUEUE *q = QUEUE_HEAD(&spill->segments);
+		spill_segment_t *seg = QUEUE_DATA(q, spill_segment_t, queue);
+
+		if (seg->read_pos == seg->write_pos) {
+			if (QUEUE_NEXT(q) == &spill->segments) {
+				// the only segment, keep writing into it from the start
+				seg->read_pos = seg->write_pos = 0;
+				return;
+			}
+			segment_release(spill, seg);
+			continue;
+		}
+
+		uint32_t len;
+		memcpy(&len, seg->base + seg->read_pos, sizeof(len));
+
+		spill_record_t *rec = (spill_record_t *)malloc(sizeof(spill_record_t));
+		rec->buf = uv_buf_init((char *)malloc(len), len);
+		memcpy(rec->buf.base, seg->base + seg->read_pos + sizeof(len), len);
+		seg->read_pos += RECORD_SIZE(len);
+
+		QUEUE_INSERT_TAIL(&spill->reading, &rec->queue);
+		spill->job_records++;
+	}
+}
+
+static void after_work(uv_work_t *req, int status) {
+	spill_log_t *spill = (spill_log_t *)req->data;
+
+	spill->busy = 0;
+	if (spill->job == JOB_WRITE) {
+		spill->disk_records += spill->job_records;
+		spill->spilled += spill->job_records;
+		spill->staged_bytes -= spill->job_bytes;
+		spill->error = spill->job_error;
+
+		if (!QUEUE_EMPTY(&spill->writing)) {
+			// no segment, put the rest back in front of newer records
+			fprintf(stderr, "spill: no segment in %s, keeping %llu bytes in memory\n",
+					spill->dir, (unsigned long long)spill->staged_bytes);
+			QUEUE_ADD(&spill->writing, &spill->staged);
+			QUEUE_INIT(&spill->staged);
+			QUEUE_ADD(&spill->staged, &spill->writing);
+			QUEUE_INIT(&spill->writing);
+		}
+	} else {
+		QUEUE_ADD(&spill->ready, &spill->reading);
+		QUEUE_INIT(&spill->reading);
+		spill->ready_count += spill->job_records;
+		spill->disk_records -= spill->job_records;
+		spill->restored += spill->job_records;
+	}
+
+	check_resume(spill);
+
+	// after a failed write wait for the next push or pop to retry
+	if (!spill->error)
+		kick(spill);
+}
+
+/**
+ * Starts a job unless one is running. Reads ahead while few records are
+ * ready, writes whatever is staged, alternating when both are due.
+ */
+static void kick(spill_log_t *spill) {
+	if (spill->busy || spill->closing)
+		return;
+
+	int want_read = spill->disk_records > 0 && spill->ready_count < spill->read_ahead;
+	int want_write = !QUEUE_EMPTY(&spill->staged);
+	uv_after_work_cb after_cb = after_work;
+	uv_work_cb work_cb;
+
+	if (want_read && (!want_write || spill->job == JOB_WRITE)) {
+		spill->job = JOB_READ;
+		work_cb = read_work;
+	} else if (want_write) {
+		spill->job = JOB_WRITE;
+		QUEUE_ADD(&spill->writing, &spill->staged);
+		QUEUE_INIT(&spill->staged);
+		work_cb = write_work;
+	} else {
+		return;
+	}
+
+	spill->busy = 1;
+	if (uv_queue_work(spill->loop, &spill->work, work_cb, after_cb)) {
+		spill->busy = 0;
+		if (spill->job == JOB_WRITE) {
+			QUEUE_ADD(&spill->writing, &spill->staged);
+			QUEUE_INIT(&spill->staged);
+			QUEUE_ADD(&spill->staged, &spill->writing);
+			QUEUE_INIT(&spill->writing);
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+
+int spill_log_init(spill_log_t *spill, uv_loop_t *loop, const char *dir,
+		size_t segment_size, size_t max_staged, spill_resume_cb resume_cb) {
+	if (spill == NULL || dir == NULL) {
+		return 1;
+	}
+	if (segment_size < RECORD_SIZE(1)) {
+		return 2;
+	}
+
+	spill->loop = loop;
+	spill->dir = strdup(dir);
+	spill->segment_size = segment_size;
+	spill->max_staged = max_staged;
+	spill->read_ahead = SPILL_READ_AHEAD;
+	spill->resume_cb = resume_cb;
+	spill->staged_bytes = 0;
+	spill->spilled = 0;
+	spill->restored = 0;
+	spill->segments_created = 0;
+	spill->segments_recycled = 0;
+	QUEUE_INIT(&spill->staged);
+	QUEUE_INIT(&spill->writing);
+	QUEUE_INIT(&spill->ready);
+	QUEUE_INIT(&spill->reading);
+	QUEUE_INIT(&spill->segments);
+	QUEUE_INIT(&spill->free_segments);
+	spill->free_count = 0;
+	spill->ready_count = 0;
+	spill->disk_records = 0;
+	spill->job_records = 0;
+	spill->job_bytes = 0;
+	spill->busy = 0;
+	spill->job = JOB_READ;
+	spill->job_error = 0;
+	spill->error = 0;
+	spill->paused = 0;
+	spill->closing = 0;
+	spill->work.data = spill;
+
+	return 0;
+}
+
+int spill_log_push(spill_log_t *spill, uv_buf_t * const buff) {
+	if (RECORD_SIZE(buff->len) > spill->segment_size) {
+		return 1;
+	}
+
+	spill_record_t *rec = (spill_record_t *)malloc(sizeof(spill_record_t));
+	rec->buf = *buff;
+	buff->base = NULL;
+	buff->len = 0;
+
+	QUEUE_INSERT_TAIL(&spill->staged, &rec->queue);
+	spill->staged_bytes += rec->buf.len;
+	// a running write job reports its own outcome in after_work
+	if (!spill->busy)
+		spill->error = 0;
+	kick(spill);
+	return 0;
+}
+
+int spill_log_pop(spill_log_t *spill, uv_buf_t * const buff) {
+	spill_record_t *rec;
+	QUEUE *q;
+
+	if (!QUEUE_EMPTY(&spill->ready)) {
+		q = QUEUE_HEAD(&spill->ready);
+		rec = QUEUE_DATA(q, spill_record_t, queue);
+		spill->ready_count--;
+	} else if (spill->disk_records == 0 && !write_in_flight(spill)
+			&& !QUEUE_EMPTY(&spill->staged)) {
+		// nothing older on disk or on its way there, skip the round trip
+		q = QUEUE_HEAD(&spill->staged);
+		rec = QUEUE_DATA(q, spill_record_t, queue);
+		spill->staged_bytes -= rec->buf.len;
+		check_resume(spill);
+	} else {
+		kick(spill);
+		return 1;
+	}
+
+	QUEUE_REMOVE(q);
+	*buff = rec->buf;
+	free(rec);
+
+	kick(spill);
+	return 0;
+}
+
+int spill_log_empty(spill_log_t *spill) {
+	return QUEUE_EMPTY(&spill->staged) && !write_in_flight(spill)
+			&& spill->ready_count == 0 && spill->disk_records == 0;
+}
+
+int spill_log_full(spill_log_t *spill) {
+	if (spill->staged_bytes >= spill->max_staged) {
+		spill->paused = 1;
+		return 1;
+	}
+	return 0;
+}
+
+static void free_records(QUEUE *list) {
+	while (!QUEUE_EMPTY(list)) {
+		QUEUE *q = QUEUE_HEAD(list);
+		spill_record_t *rec = QUEUE_DATA(q, spill_record_t, queue);
+
+		QUEUE_REMOVE(q);
+		free(rec->buf.base);
+		free(rec);
+	}
+}
+
+void spill_log_deinit(spill_log_t *spill) {
+	spill->closing = 1;
+	while (spill->busy)
+		uv_run(spill->loop, UV_RUN_ONCE);
+
+	free_records(&spill->staged);
+	free_records(&spill->writing);
+	free_records(&spill->ready);
+	free_records(&spill->reading);
+
+	QUEUE *lists[2] = { &spill->segments, &spill->free_segments };
+	for (int i = 0; i < 2; ++i) {
+		while (!QUEUE_EMPTY(lists[i])) {
+			QUEUE *q = QUEUE_HEAD(lists[i]);
+			QUEUE_REMOVE(q);
+			segment_destroy(spill, QUEUE_DATA(q, spill_segment_t, queue));
+		}
+	}
+	free(spill->dir);
+	spill->dir = NULL;
+}
@@ -0,0 +1,106 @@
+#ifndef SPILL_LOG_H
+#define SPILL_LOG_H
+
+#include <uv.h>
+#include "../internal/queue.h"
+
+/**
+ * Overflow tier behind buff_circular: buffers that do not fit into the
+ * ring are appended to memory-mapped segment files and read back in FIFO
+ * order once the consumer catches up.
+ *
+ * Copies into and out of the mappings run in the threadpool, so page
+ * faults and writeback never block the loop thread. One job runs at a
+ * time, either writing staged buffers or reading ahead.
+ */
+
+typedef struct spill_log_s spill_log_t;
+
+/**
+ * Called when staged data fell below max_staged again after
+ * spill_log_full() returned 1.
+ */
+typedef void (*spill_resume_cb)(spill_log_t *spill);
+
+typedef struct spill_segment_s {
+	QUEUE queue;
+	int fd; // unlinked right after creation
+	char *base;
+	size_t write_pos;
+	size_t read_pos;
+} spill_segment_t;
+
+struct spill_log_s {
+	void *data;
+	uv_loop_t *loop;
+	size_t staged_bytes; // pushed, not yet in a segment
+	uint64_t spilled; // records written to segments
+	uint64_t restored; // records read back from segments
+	uint64_t segments_created;
+	uint64_t segments_recycled;
+	// private
+	char *dir;
+	size_t segment_size;
+	size_t max_staged;
+	size_t read_ahead; // records per read job
+	QUEUE staged; // pushed, oldest first
+	QUEUE writing; // owned by the write job
+	QUEUE ready; // read back, oldest first
+	QUEUE reading; // filled by the read job
+	QUEUE segments; // holding data, oldest first
+	QUEUE free_segments; // drained, ready for reuse
+	size_t free_count;
+	size_t ready_count;
+	uint64_t disk_records; // in segments, not read back
+	uint64_t job_records; // records the job wrote or read
+	int busy; // a job is in the threadpool
+	int job; // kind of the running or last job
+	int error; // last write job failed to get a segment, loop thread only
+	int job_error; // set by the write job, read in after_work
+	int paused; // spill_log_full() returned 1
+	int closing; // no new jobs
+	size_t job_bytes; // bytes the write job moved to segments
+	uv_work_t work;
+	spill_resume_cb resume_cb;
+};
+
+/**
+ * @param spill Must be allocated in caller.
+ * @param dir Directory for segment files, should be on disk, not tmpfs.
+ * @param segment_size Bytes per segment file, preallocated.
+ * @param max_staged Bytes kept in memory while waiting for the disk
+ *                   before spill_log_full() returns 1.
+ * @return 0 if success
+ */
+int spill_log_init(spill_log_t *spill, uv_loop_t *loop, const char *dir,
+		size_t segment_size, size_t max_staged, spill_resume_cb resume_cb);
+
+/**
+ * Move data from @param buff to the end of the log, like buff_circular_push.
+ * @return 0 if success, 1 if the buffer is larger than a segment
+ */
+int spill_log_push(spill_log_t *spill, uv_buf_t * const buff);
+
+/**
+ * Move the oldest buffer to @param buff, like buff_circular_pop.
+ * @return 0 if success, 1 if nothing is in memory yet; a read is
+ *         started then and a later call succeeds
+ */
+int spill_log_pop(spill_log_t *spill, uv_buf_t * const buff);
+
+/**
+ * @return 1 if nothing is staged, in segments or read back
+ */
+int spill_log_empty(spill_log_t *spill);
+
+/**
+ * @return 1 if producers should pause, resume_cb tells when to go on
+ */
+int spill_log_full(spill_log_t *spill);
+
+/**
+ * Waits for a running job, then frees all buffers and segments.
+ */
+void spill_log_deinit(spill_log_t *spill);
+
+#endif
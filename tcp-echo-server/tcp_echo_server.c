@@ -3,263 +3,467 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <signal.h>
+#include "echo_pipeline.h"
+#include "spill_log.h"
+#include "../internal/pool.h"
+#include "socket_profile.h"
+#include "read_buffers.h"
+#include "echo_trace.h"
+#include "loop_monitor.h"
+#include "traffic_capture.h"
+#include "buff_circular.h"
+#include "byte_ring.h"
+#include "http_static.h"
+#include "udp_echo.h"
+#include "broadcast.h"
 
 /**
  * Our tcp server object.
  */
 uv_tcp_t server;
-uv_tcp_t *client;
 uv_stream_t *g_stream;
 uv_timer_t gc_req;
 
 /**
- * Shared reference to our event loop.
+ * One accepted client.
  */
-uv_loop_t * loop;
+typedef struct conn_s {
+	uv_tcp_t handle; // first member, so uv_stream_t * casts to conn_t *
+	echo_pipeline_t pipeline; // used with -x
+	int paused; // reading stopped until the spill log caught up
+	QUEUE paused_queue;
+	read_sizer_t sizer; // picks the read buffer size
+	uint32_t id; // names the connection in a traffic capture
+	http_parser_t http; // used with -m http
+	uv_shutdown_t shutdown_req;
+	broadcast_sub_t sub; // used with -m broadcast, stream is NULL until joined
+} conn_t;
 
 /**
- * Function declarations.
+ * A write request together with the buffer it sends.
  */
-uv_buf_t alloc_buffer(uv_handle_t * handle, size_t size);
-void connection_cb(uv_stream_t * server, int status);
-void read_cb(uv_stream_t * stream, ssize_t nread, uv_buf_t buf);
-void timer_cb(uv_timer_t* handle);
-
-/////////////////////////////////////////////////////////////////////
-typedef struct uv_buff_circular {
-	uv_buf_t *buffs; // array of buffers
-	size_t max_size; // number of elements in buffs
-	int size; // current size
-	// private
-	uv_buf_t *current_element; // last element
-} uv_buff_circular;
-
-//private functions
+typedef struct {
+	uv_write_t req;
+	uv_buf_t buf;
+	int read_buffer; // buf came from read_buffers, not malloc
+	size_t ring_bytes; // > 0: buf lives in byte_ring, this many bytes to consume
+	int ring_done; // written, waiting for older ring writes
+	QUEUE ring_queue;
+#ifdef ECHO_TRACE
+	echo_stamps_t stamps;
+#endif
+} write_req_t;
 
 /**
- * Call free for single uv_buf_t
+ * Clients and write requests come from pools, preallocated at startup
+ * and growing in chunks, so accepts and write requests do not go to the
+ * heap; with -m echo neither does the data (echo_alloc_test.c). Ring mode
+ * still copies every message into a malloc'd buffer in read_data, and
+ * echo_pipeline_submit does with -x.
  */
-static void free_buff(uv_buf_t *buff) {
-	assert(buff != NULL);
-	free(buff->base);
-	buff->base = NULL;
-	buff->len = 0;
-}
+#define CONN_POOL_SIZE 64
+#define WRITE_REQ_POOL_SIZE 256
+
+POOL_DEFINE(conn_pool, conn_t)
+POOL_DEFINE(write_req_pool, write_req_t)
+
+conn_pool_t conn_pool;
+write_req_pool_t write_req_pool;
 
 /**
- * Move current_element pointer to next element
+ * What the server does with incoming data.
  */
-static void move_internal_pointer(uv_buff_circular * const circular_buff) {
-	assert(circular_buff != NULL);
-	// Move 'current_element' pointer
-	// check if current_element == last element
-	if (circular_buff->current_element == &circular_buff->buffs[circular_buff->max_size -1]) {
-		circular_buff->current_element = &circular_buff->buffs[0];
-	}
-	else {
-		circular_buff->current_element++;
-	}
-}
+typedef enum {
+	MODE_RING, // queue in buff_circular, timer_cb writes one message per tick
+	MODE_ECHO, // write back right away, optionally through a transform
+	MODE_HTTP, // answer HTTP/1.1 requests with a static response
+	MODE_BROADCAST // write what one client sends to all the others
+} server_mode_t;
 
-// public functions
+server_mode_t mode = MODE_RING;
+echo_transform_fn transform = NULL; // -x, NULL echoes without threadpool work
+int transform_rounds = 1; // -r
+int max_inflight = 16; // -i, per connection
+const char *spill_dir = "."; // -s
+size_t spill_segment_mb = 64; // -S
+socket_profile_t profile; // -P, -O
+int adaptive_reads = 1; // -F turns it off, every read gets the suggested size
+int report_interval = 0; // -R, seconds
 
 /**
- * @param circular_buff Must be allocated in caller.
- * @param nbufs Number of buffers
+ * Read buffers by size class, shared by all connections.
  */
-void buff_circular_init(uv_buff_circular *circular_buff, size_t nbufs) {
-	assert(circular_buff != NULL);
-	circular_buff->buffs = (uv_buf_t *)malloc(sizeof(uv_buf_t) * nbufs);
-	for (int i = 0; i < nbufs; ++i) {
-		circular_buff->buffs[i].base = NULL;
-		circular_buff->buffs[i].len = 0;
-	}
-	circular_buff->max_size = nbufs;
-	circular_buff->current_element = &circular_buff->buffs[nbufs -1];
-	circular_buff->size = 0;
-}
+read_buffers_t read_buffers;
+uv_timer_t report_timer;
 
 /**
- * Move data from @param buff to @param circular_buff
- * @param circular_buff Initialized by caller (buff_circular_init).
- * @param buff Initialized by caller. Clean in this function (.base = NULL, .len=0).
- * @return 0 if success
+ * Loop lag and blocking callbacks, started with -M.
  */
-int buff_circular_push(uv_buff_circular * const circular_buff, uv_buf_t * const buff) {
-	if (circular_buff == NULL) {
-		return 1;
-	}
-	if (buff == NULL) {
-		return 2;
-	}
+loop_monitor_t monitor;
+int block_ms = 0; // -M
+#define MONITOR_TICK_MS 10
+#define MONITOR_REPORT_MS 5000 // unless -R is given
 
-	assert(circular_buff->size <= circular_buff->max_size);
-	if (circular_buff->size == circular_buff->max_size) { // buffer if full
-		return 3;
-	}
+/**
+ * Client traffic recorded with -C, for replay.o. SIGINT and SIGTERM
+ * write out what is buffered and stop the loop.
+ */
+traffic_capture_t capture;
+const char *capture_path = NULL; // -C
+uint32_t next_conn_id = 0;
+uv_signal_t sigint_handle;
+uv_signal_t sigterm_handle;
+#define CAPTURE_BUFFER_SIZE (4 * 1024 * 1024)
 
-	// move 'current_element' pointer to next slot
-	move_internal_pointer(circular_buff);
+#ifdef ECHO_TRACE
+/**
+ * Latency of every echoed message, built with make TRACE=1.
+ */
+echo_trace_t trace;
+const char *trace_path = NULL; // -T
+uint32_t trace_sample_every = 1000; // -N
+int trace_closed = 0;
+#define TRACE_OPTIONS "T:N:"
+#else
+#define TRACE_OPTIONS ""
+#endif
 
-	// move element
-	circular_buff->current_element->len = buff->len;
-	buff->len = 0;
-	circular_buff->current_element->base = buff->base;
-	buff->base = NULL;
+/**
+ * Ring mode overflow, takes buffers while buff_circular is full.
+ */
+spill_log_t spill;
+QUEUE paused_conns; // conn_t stopped by spill_log_full or a full byte ring
 
-	// increment size
-	if (circular_buff->size < circular_buff->max_size) {
-		circular_buff->size++;
-	}
-	return 0;
-}
+/**
+ * Ring mode with -b: messages are read straight into a mirrored byte
+ * ring, each behind a RING_HEADER byte length, and written straight from
+ * it. Replaces buff_circular and the spill log, connections pause while
+ * less than ring_low_water bytes are free.
+ */
+byte_ring_t byte_ring;
+size_t byte_ring_kb = 0; // -b, 0 uses buff_circular
+size_t ring_low_water;
+uint64_t ring_sent; // ring position of the next record to write
+uint64_t ring_dropped; // reads that did not fit, shown by -R
+QUEUE ring_writes; // write_req_t from the ring in submit order
+#define RING_HEADER sizeof(uint32_t)
 
 /**
- * Move data from @param circular_buff to @param buff
- * @param circular_buff Initialized by caller (buff_circular_init).
- * @param buff Out pointer. Must be empty (.base = NULL, .len=0).
- * @return 0 if success
+ * HTTP mode: the response to every request, serialized at startup.
  */
-int buff_circular_pop(uv_buff_circular *circular_buff, uv_buf_t * const buff) {
-	if (circular_buff == NULL) {
-		return 1;
-	}
-	if (buff == NULL) {
-		return 2;
-	}
+http_responses_t http_responses;
+#define HTTP_BODY "Hello, World!\n"
 
-	assert(buff->base == NULL);
-	assert(buff->len == 0);
+/**
+ * Broadcast mode: every connection is a subscriber.
+ */
+broadcast_t broadcast;
+size_t broadcast_limit_kb = 1024; // -L
+broadcast_policy_t broadcast_policy = BROADCAST_DISCONNECT; // -D
 
-	size_t pop_element_index = circular_buff->max_size;
-	size_t last_element_index = circular_buff->current_element - circular_buff->buffs;
+/**
+ * UDP echo on the same address, started with -U.
+ */
+udp_echo_t udp_echo;
+int udp_enabled = 0;
+udp_echo_kind_t udp_kind; // -U
 
-	uv_buf_t *pop_ptr = circular_buff->current_element;
-	for (int i = 0; i < circular_buff->size - 1; ++i) {
-		if (pop_ptr == &circular_buff->buffs[0]) {
-			pop_ptr += circular_buff->max_size - 1; // last element in array
-		}
-		else {
-			pop_ptr--;
-		}
-	}
+/**
+ * Shared reference to our event loop.
+ */
+uv_loop_t * loop;
 
-	assert(pop_element_index <= circular_buff->max_size);
+/**
+ * Function declarations.
+ */
+uv_buf_t alloc_buffer(uv_handle_t * handle, size_t size);
+void connection_cb(uv_stream_t * server, int status);
+void accept_connection(uv_stream_t * server, int status);
+void read_cb(uv_stream_t * stream, ssize_t nread, uv_buf_t buf);
+void read_data(uv_stream_t * stream, ssize_t nread, uv_buf_t buf);
+void timer_cb(uv_timer_t* handle);
+void release_ring_writes();
+void write_ring(uv_timer_t* handle);
+void write_byte_ring();
+int queue_byte_ring(uv_stream_t * stream, ssize_t nread, uv_buf_t buf);
+void report_cb(uv_timer_t *handle);
+void close_cb(uv_handle_t * handle);
+void conn_release_cb(uv_handle_t *handle);
+void resume_paused_cb(spill_log_t *spill);
+void http_data(uv_stream_t *stream, ssize_t nread, uv_buf_t buf);
+void http_shutdown(uv_stream_t *stream);
+void broadcast_disconnect(broadcast_sub_t *sub);
 
-	// move buffer
-	buff->base = pop_ptr->base;
-	pop_ptr->base = NULL;
-	buff->len = pop_ptr->len;
-	pop_ptr->len = 0;
 
-	circular_buff->size--;
+uv_buff_circular buff_circular;
 
-	return 0;
-}
 
 /**
- * Call free() for evry element.
- * Deallocate internal array.
- * Instance of struct 'circular_buff' will be not deallocate.
+ * Resident set size of this process in KiB, 0 if unknown.
  */
-void buff_circular_deinit(uv_buff_circular * const circular_buff) {
-	if (circular_buff == NULL) {
-		return;
+size_t resident_kb() {
+	unsigned long size, resident;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL) {
+		return 0;
 	}
+	int n = fscanf(f, "%lu %lu", &size, &resident);
+	fclose(f);
+	return n == 2 ? resident * (sysconf(_SC_PAGESIZE) / 1024) : 0;
+}
 
-	for (int i = 0; i < circular_buff->max_size; ++i) {
-		if (circular_buff->buffs[i].base != NULL)
-			free_buff(&circular_buff->buffs[i]);
-	}
-	free(circular_buff->buffs);
-	circular_buff->current_element = NULL;
-	circular_buff->buffs = NULL;
-	circular_buff->max_size = 0;
-	circular_buff->size = 0;
+void capture_closed_cb(traffic_capture_t *capture) {
+	printf("traffic capture: %llu records, %llu bytes, %llu dropped\n",
+			(unsigned long long) capture->records, (unsigned long long) capture->bytes,
+			(unsigned long long) capture->dropped);
+	uv_stop(loop);
 }
 
-/////////////////////////////////////////////////////////////////////
-
-void test_buff_circular() {
-	printf ("test_buff_circular\n");
-	uv_buff_circular circular_buff;
-	const size_t buff_size = 5;
-	const size_t number_of_buffs = 10;
-	buff_circular_init(&circular_buff, number_of_buffs);
-
-	for (int i = 0; i < number_of_buffs; ++i) {
-		uv_buf_t buff;
-		buff.base = (char*)malloc(sizeof(char) * buff_size);
-		buff.len = buff_size;
-		for (int j = 0; j < buff_size; ++j) {
-			buff.base[j] = 'a';
-		}
-		buff_circular_push(&circular_buff, &buff);
-		free(buff.base);
-	}
-
-	for (int i = 0; i < circular_buff.max_size; ++i) {
-		uv_buf_t buff2;
-		buff2.base = NULL;
-		buff2.len = 0;
-		buff_circular_pop(&circular_buff, &buff2);
-		printf("pop buffer %d\n", i);
-		for (int j = 0; j < buff2.len; ++j) {
-			printf("%c", buff2.base[j]);
-		}
-		printf("\n");
-		free(buff2.base);
-	}
+#ifdef ECHO_TRACE
+void trace_closed_cb(echo_trace_t *trace) {
+	trace_closed = 1;
+}
+#endif
 
+void signal_cb(uv_signal_t *handle, int signum) {
+	uv_signal_stop(&sigint_handle);
+	uv_signal_stop(&sigterm_handle);
+	traffic_capture_close(&capture, capture_closed_cb);
+}
 
-	for (int i = 0; i < number_of_buffs; ++i) {
-		uv_buf_t buff;
-		buff.base = (char*)malloc(sizeof(char) * buff_size);
-		buff.len = buff_size;
-		for (int j = 0; j < buff_size; ++j) {
-			buff.base[j] = 'b';
-		}
-		buff_circular_push(&circular_buff, &buff);
-		free(buff.base);
-	}
-
-	for (int i = 0; i < circular_buff.max_size; ++i) {
-		uv_buf_t buff2;
-		buff2.base = NULL;
-		buff2.len = 0;
-		buff_circular_pop(&circular_buff, &buff2);
-		printf("pop buffer %d\n", i);
-		for (int j = 0; j < buff2.len; ++j) {
-			printf("%c", buff2.base[j]);
-		}
-		printf("\n");
-		free(buff2.base);
-	}
+void monitor_report_cb(loop_monitor_t *monitor, const loop_monitor_stats_t *stats) {
+	loop_monitor_print(stats, stdout);
+	fflush(stdout);
+}
 
-	buff_circular_deinit(&circular_buff);
-	printf ("end of test\n");
+void report_cb(uv_timer_t *handle) {
+	loop_monitor_enter(&monitor, (uv_handle_t *) handle, "report_cb");
+	printf("connections %zu, resident %zu KiB, %s read buffers\n",
+			conn_pool.stats.in_use, resident_kb(), adaptive_reads ? "adaptive" : "fixed");
+	read_buffers_print(&read_buffers, stdout);
+	if (byte_ring.base != NULL)
+		printf("byte ring: %zu of %zu bytes used, %llu messages dropped\n",
+				byte_ring_used(&byte_ring), byte_ring.size,
+				(unsigned long long)ring_dropped);
+	else if (mode == MODE_RING)
+		printf("spill log: %llu bytes staged, %llu records spilled, %llu restored\n",
+				(unsigned long long)spill.staged_bytes,
+				(unsigned long long)spill.spilled,
+				(unsigned long long)spill.restored);
+	if (udp_enabled)
+		udp_echo_print(&udp_echo, stdout);
+	if (mode == MODE_BROADCAST)
+		broadcast_print(&broadcast, stdout);
+#ifdef ECHO_TRACE
+	echo_trace_print(&trace, stdout);
+#endif
+	fflush(stdout);
+	loop_monitor_leave(&monitor);
 }
 
-uv_buff_circular buff_circular;
+void print_pool_stats(const char *name, const pool_stats_t *stats) {
+	printf("%s: capacity %zu, in use %zu, high water %zu, gets %llu, grows %llu\n",
+			name, stats->capacity, stats->in_use, stats->high_water,
+			(unsigned long long)stats->gets, (unsigned long long)stats->grows);
+}
 
+void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-m ring|echo|http|broadcast] [-x crc32|xor] [-r rounds] [-i inflight]\n"
+			"          [-s spill dir] [-S segment MiB] [-P profile] [-O key=value,...]\n"
+			"          [-F] [-R seconds] [-M ms] [-C capture file] [-b KiB] [-U uv|mmsg]\n"
+			"          [-L KiB] [-D drop|disconnect]\n"
+			"  -m  ring: queue messages and echo one per timer tick (default)\n"
+			"      echo: echo every message right away\n"
+			"      http: answer HTTP/1.1 requests with a static response, keep-alive\n"
+			"      and pipelining supported\n"
+			"      broadcast: write what one client sends to all other clients\n"
+			"  -x  echo mode: run this transform in the threadpool first\n"
+			"  -r  transform repetitions per message (default 1)\n"
+			"  -i  transformed messages in flight per connection (default 16)\n"
+			"  -s  ring mode: directory for spill segments once the ring is full (default .)\n"
+			"  -S  ring mode: spill segment size in MiB (default 64)\n"
+			"  -P  socket tuning profile: ", name);
+	socket_profile_list(stderr);
+	fprintf(stderr, " (default: default)\n"
+			"  -O  override profile fields: nodelay, keepalive, rcvbuf, sndbuf,\n"
+			"      backlog, simultaneous_accepts, busy_poll\n"
+			"  -F  fixed read buffers of the suggested size instead of sizing them\n"
+			"      from each connection's recent reads\n"
+			"  -R  print connections, resident memory, read buffers and the ring mode\n"
+			"      queue every N seconds\n"
+			"  -M  monitor loop lag and warn about callbacks blocking the loop longer\n"
+			"      than this, reports every -R seconds (default 5)\n"
+			"  -C  record client traffic into this file until SIGINT or SIGTERM,\n"
+			"      replay.o sends it again\n"
+			"  -b  ring mode: queue messages in a mirrored byte ring of this size\n"
+			"      instead of buff_circular and the spill log\n"
+			"  -U  also echo UDP datagrams on the same address, uv: one datagram per\n"
+			"      callback, mmsg: batches with recvmmsg and sendmmsg (Linux)\n"
+			"  -L  broadcast mode: unfinished writes per subscriber before -D applies\n"
+			"      (default 1024)\n"
+			"  -D  broadcast mode: disconnect a slow subscriber (default), or drop\n"
+			"      what it cannot take, which cuts its stream mid-message\n");
+#ifdef ECHO_TRACE
+	fprintf(stderr, "  -T  append every N-th message's stage timestamps to this trace file,\n"
+			"      echo_trace_dump.o prints it as CSV\n"
+			"  -N  trace file sampling, 1 in N messages (default 1000)\n");
+#endif
+}
 
-int main() {
+int main(int argc, char **argv) {
+
+	const char *profile_options = NULL;
+	int opt;
+	profile = *socket_profile_find("default");
+	while ((opt = getopt(argc, argv, "m:x:r:i:s:S:P:O:FR:M:C:b:U:L:D:" TRACE_OPTIONS)) != -1) {
+		switch (opt) {
+			case 'm':
+				if (!strcmp(optarg, "ring")) mode = MODE_RING;
+				else if (!strcmp(optarg, "echo")) mode = MODE_ECHO;
+				else if (!strcmp(optarg, "http")) mode = MODE_HTTP;
+				else if (!strcmp(optarg, "broadcast")) mode = MODE_BROADCAST;
+				else { usage(argv[0]); return 1; }
+				break;
+			case 'x':
+				transform = echo_transform_by_name(optarg);
+				if (transform == NULL) { usage(argv[0]); return 1; }
+				break;
+			case 'r':
+				transform_rounds = atoi(optarg);
+				break;
+			case 'i':
+				max_inflight = atoi(optarg);
+				break;
+			case 's':
+				spill_dir = optarg;
+				break;
+			case 'S':
+				spill_segment_mb = strtoul(optarg, NULL, 10);
+				break;
+			case 'P': {
+				const socket_profile_t *found = socket_profile_find(optarg);
+				if (found == NULL) { usage(argv[0]); return 1; }
+				profile = *found;
+				break;
+			}
+			case 'O':
+				profile_options = optarg;
+				break;
+			case 'F':
+				adaptive_reads = 0;
+				break;
+			case 'R':
+				report_interval = atoi(optarg);
+				break;
+			case 'M':
+				block_ms = atoi(optarg);
+				break;
+			case 'C':
+				capture_path = optarg;
+				break;
+			case 'b':
+				byte_ring_kb = strtoul(optarg, NULL, 10);
+				break;
+			case 'U':
+				if (udp_echo_kind_by_name(optarg, &udp_kind)) { usage(argv[0]); return 1; }
+				udp_enabled = 1;
+				break;
+			case 'L':
+				broadcast_limit_kb = strtoul(optarg, NULL, 10);
+				break;
+			case 'D':
+				if (broadcast_policy_by_name(optarg, &broadcast_policy)) { usage(argv[0]); return 1; }
+				break;
+#ifdef ECHO_TRACE
+			case 'T':
+				trace_path = optarg;
+				break;
+			case 'N':
+				trace_sample_every = strtoul(optarg, NULL, 10);
+				break;
+#endif
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	// overrides apply on top of whichever profile was picked
+	if (profile_options != NULL && socket_profile_parse(&profile, profile_options)) {
+		usage(argv[0]);
+		return 1;
+	}
 
-	//test_buff_circular();
-	//return 0;
 	g_stream = NULL;
 	const int port = 3000;
 	const char *host = "127.0.0.1";
 	printf("Starting the test echo server. Connect to me, host %s on port %d\n" , host, port);
 
-	/* dynamically allocate a new client stream object on conn */
-	client = (uv_tcp_t*)malloc(sizeof(uv_tcp_t));
-
     loop = uv_default_loop();
 
 	buff_circular_init(&buff_circular, 5);
-	uv_timer_init(loop, &gc_req);
-	uv_timer_start(&gc_req, (uv_timer_cb)timer_cb, 0, 2000);
+	conn_pool_init(&conn_pool, CONN_POOL_SIZE, CONN_POOL_SIZE);
+	write_req_pool_init(&write_req_pool, WRITE_REQ_POOL_SIZE, WRITE_REQ_POOL_SIZE);
+	read_buffers_init(&read_buffers);
+#ifdef ECHO_TRACE
+	if (echo_trace_init(&trace, loop, trace_path, trace_sample_every))
+		return 1;
+#endif
+	if (report_interval > 0) {
+		uv_timer_init(loop, &report_timer);
+		uv_timer_start(&report_timer, (uv_timer_cb)report_cb,
+				report_interval * 1000, report_interval * 1000);
+	}
+	if (block_ms > 0 && loop_monitor_start(&monitor, loop, MONITOR_TICK_MS,
+			report_interval > 0 ? report_interval * 1000 : MONITOR_REPORT_MS,
+			block_ms, monitor_report_cb)) {
+		fprintf(stderr, "Error on starting the loop monitor.\n");
+		return 1;
+	}
+	if (capture_path != NULL) {
+		if (traffic_capture_open(loop, &capture, capture_path, CAPTURE_BUFFER_SIZE)) {
+			fprintf(stderr, "Error on creating traffic capture %s.\n", capture_path);
+			return 1;
+		}
+		uv_signal_init(loop, &sigint_handle);
+		uv_signal_init(loop, &sigterm_handle);
+		uv_signal_start(&sigint_handle, signal_cb, SIGINT);
+		uv_signal_start(&sigterm_handle, signal_cb, SIGTERM);
+		uv_unref((uv_handle_t *) &sigint_handle);
+		uv_unref((uv_handle_t *) &sigterm_handle);
+	}
+	QUEUE_INIT(&paused_conns);
+	QUEUE_INIT(&ring_writes);
+	if (mode == MODE_RING && byte_ring_kb > 0) {
+		if (byte_ring_init(&byte_ring, byte_ring_kb * 1024)) {
+			fprintf(stderr, "Error on mapping a byte ring of %zu KiB.\n", byte_ring_kb);
+			return 1;
+		}
+		ring_low_water = 64 * 1024 + RING_HEADER;
+		if (ring_low_water > byte_ring.size / 2)
+			ring_low_water = byte_ring.size / 2;
+	}
+	if (mode == MODE_HTTP
+			&& http_responses_init(&http_responses, HTTP_BODY, sizeof(HTTP_BODY) - 1)) {
+		fprintf(stderr, "Error on serializing the HTTP responses.\n");
+		return 1;
+	}
+	if (mode == MODE_BROADCAST && broadcast_init(&broadcast, broadcast_policy,
+			broadcast_limit_kb * 1024, broadcast_disconnect)) {
+		fprintf(stderr, "Error on creating the broadcast.\n");
+		return 1;
+	}
+	if (mode == MODE_RING) {
+		if (spill_log_init(&spill, loop, spill_dir, spill_segment_mb << 20,
+				4 * (spill_segment_mb << 20), resume_paused_cb)) {
+			fprintf(stderr, "Error on creating spill log in %s.\n", spill_dir);
+			return 1;
+		}
+		uv_timer_init(loop, &gc_req);
+		uv_timer_start(&gc_req, (uv_timer_cb)timer_cb, 0, 2000);
+	}
 
     /* convert a humanreadable ip address to a c struct */
     struct sockaddr_in addr = uv_ip4_addr(host, port);
@@ -268,20 +472,58 @@ int main() {
     uv_tcp_init(loop, &server);
     /* bind the server to the address above */
     uv_tcp_bind(&server, addr);
+    socket_profile_apply_listener(&profile, &server);
+    socket_profile_print(&profile, stdout);
+    printf("\n");
     
     /* let the server listen on the address for new connections */
-    int r = uv_listen((uv_stream_t *) &server, 128, connection_cb);
+    int r = uv_listen((uv_stream_t *) &server, profile.backlog, connection_cb);
 
     if (r) {
         return fprintf(stderr, "Error on listening: %s.\n", 
                 uv_strerror(uv_last_error(loop)));
     }
 
+    if (udp_enabled && udp_echo_start(&udp_echo, loop, udp_kind, addr)) {
+        fprintf(stderr, "Error on starting the UDP echo.\n");
+        return 1;
+    }
+
     /* execute all tasks in queue */
     uv_run(loop, UV_RUN_DEFAULT);
+	// a no-op unless -M started it
+	loop_monitor_stop(&monitor);
+#ifdef ECHO_TRACE
+	// the loop stopped, run it again until the trace file is written out,
+	// before anything its handles point to is freed
+	echo_trace_close(&trace, trace_closed_cb);
+	while (!trace_closed)
+		uv_run(loop, UV_RUN_ONCE);
+#endif
+	if (mode == MODE_RING)
+		spill_log_deinit(&spill);
 	buff_circular_deinit(&buff_circular);
-	if (client != NULL)
-		free(client);
+	byte_ring_destroy(&byte_ring);
+	if (mode == MODE_HTTP)
+		http_responses_destroy(&http_responses);
+	print_pool_stats("conn_pool", &conn_pool.stats);
+	print_pool_stats("write_req_pool", &write_req_pool.stats);
+	conn_pool_destroy(&conn_pool);
+	write_req_pool_destroy(&write_req_pool);
+	read_buffers_print(&read_buffers, stdout);
+	read_buffers_destroy(&read_buffers);
+	if (udp_enabled) {
+		udp_echo_print(&udp_echo, stdout);
+		udp_echo_destroy(&udp_echo);
+	}
+	if (mode == MODE_BROADCAST) {
+		broadcast_print(&broadcast, stdout);
+		broadcast_destroy(&broadcast);
+	}
+#ifdef ECHO_TRACE
+	echo_trace_print(&trace, stdout);
+	echo_trace_deinit(&trace);
+#endif
 	return 0;
 }
 
@@ -289,17 +531,59 @@ int main() {
  * Callback which is executed on each new connection.
  */
 void connection_cb(uv_stream_t * server, int status) {
+	loop_monitor_enter(&monitor, (uv_handle_t *) server, "connection_cb");
+	accept_connection(server, status);
+	loop_monitor_leave(&monitor);
+}
+
+void accept_connection(uv_stream_t * server, int status) {
     /* if status not zero there was an error */
     if (status == -1) {
         fprintf(stderr, "Error on listening: %s.\n", 
             uv_strerror(uv_last_error(loop)));
+        return;
+    }
+
+    /* dynamically allocate a new client stream object on conn */
+    conn_t *conn = conn_pool_get(&conn_pool);
+    if (conn == NULL) {
+        fprintf(stderr, "Error on allocating a client.\n");
+        return;
     }
+    uv_tcp_t *client = &conn->handle;
+    conn->paused = 0;
+    read_sizer_init(&conn->sizer);
+    conn->id = next_conn_id++;
+    if (mode == MODE_HTTP)
+        http_parser_init(&conn->http);
+    conn->sub.stream = NULL;
+    conn->sub.data = conn;
 
     /* initialize the new client */
     uv_tcp_init(loop, client);
 
+    if (mode == MODE_ECHO && transform != NULL) {
+        if (echo_pipeline_init(&conn->pipeline, (uv_stream_t *) client,
+                alloc_buffer, read_cb, transform, transform_rounds, max_inflight)) {
+            fprintf(stderr, "Error on creating the client pipeline.\n");
+            /* take it off the backlog anyway, then drop it */
+            uv_accept(server, (uv_stream_t *) client);
+            uv_close((uv_handle_t *) client, conn_release_cb);
+            return;
+        }
+        conn->pipeline.data = conn;
+    }
+
     /* now let bind the client to the server to be used for incomings */
     if (uv_accept(server, (uv_stream_t *) client) == 0) {
+        /* failed options are reported, the client is served anyway */
+        socket_profile_apply_client(&profile, client);
+
+        if (capture_path != NULL)
+            traffic_capture_record(&capture, conn->id, NULL, TRAFFIC_OPEN);
+        if (mode == MODE_BROADCAST)
+            broadcast_join(&broadcast, &conn->sub, (uv_stream_t *) client);
+
         /* start reading from stream */
         int r = uv_read_start((uv_stream_t *) client, alloc_buffer, read_cb);
 
@@ -309,14 +593,210 @@ void connection_cb(uv_stream_t * server, int status) {
         }
     } else {
         /* close client stream on error */
-        uv_close((uv_handle_t *) client, NULL);
+        uv_close((uv_handle_t *) client, close_cb);
     }
 }
 
+/**
+ * Frees a client that was closed before it was served.
+ */
+void conn_release_cb(uv_handle_t *handle) {
+	conn_pool_put(&conn_pool, (conn_t *) handle);
+}
+
+/**
+ * Frees a client once its pipeline has nothing in flight anymore.
+ */
+void pipeline_release_cb(echo_pipeline_t *pipeline) {
+	conn_pool_put(&conn_pool, (conn_t *) pipeline->data);
+}
+
+/**
+ * Callback which is executed when a client stream was closed.
+ */
+void close_cb(uv_handle_t * handle) {
+	conn_t *conn = (conn_t *) handle;
+
+	if (g_stream == (uv_stream_t *) handle)
+		g_stream = NULL;
+	if (conn->paused)
+		QUEUE_REMOVE(&conn->paused_queue);
+	if (conn->sub.stream != NULL)
+		broadcast_leave(&broadcast, &conn->sub);
+
+	if (mode == MODE_ECHO && transform != NULL) {
+		echo_pipeline_close(&conn->pipeline, pipeline_release_cb);
+	} else {
+		conn_pool_put(&conn_pool, conn);
+	}
+}
+
+/**
+ * Frees ring space of finished writes, oldest first: writes to different
+ * clients can finish out of order, but the ring only shrinks at its head.
+ */
+void release_ring_writes() {
+	while (!QUEUE_EMPTY(&ring_writes)) {
+		QUEUE *q = QUEUE_HEAD(&ring_writes);
+		write_req_t *wr = QUEUE_DATA(q, write_req_t, ring_queue);
+
+		if (!wr->ring_done)
+			break;
+		QUEUE_REMOVE(q);
+		byte_ring_consume(&byte_ring, wr->ring_bytes);
+		write_req_pool_put(&write_req_pool, wr);
+	}
+	if (byte_ring_free(&byte_ring) >= ring_low_water)
+		resume_paused_cb(&spill);
+}
+
+void write_req_cb(uv_write_t *req, int status) {
+	write_req_t *wr = (write_req_t *) req;
+
+	loop_monitor_enter(&monitor, (uv_handle_t *) req->handle, "write_req_cb");
+#ifdef ECHO_TRACE
+	wr->stamps.done = uv_hrtime();
+	if (status == 0)
+		echo_trace_done(&trace, &wr->stamps, wr->buf.len);
+#endif
+	if (wr->ring_bytes) {
+		wr->ring_done = 1;
+		release_ring_writes();
+	} else {
+		if (wr->read_buffer)
+			read_buffers_put(&read_buffers, wr->buf.base);
+		else
+			free(wr->buf.base);
+		write_req_pool_put(&write_req_pool, wr);
+	}
+	loop_monitor_leave(&monitor);
+}
+
+/**
+ * Echo mode: send the received data back, through the pipeline if a
+ * transform is configured.
+ */
+void echo_data(uv_stream_t *stream, ssize_t nread, uv_buf_t buf) {
+	if (transform != NULL) {
+		if (echo_pipeline_submit(&((conn_t *) stream)->pipeline, buf.base, nread))
+			fprintf(stderr, "Error on queueing %zd bytes for the transform.\n", nread);
+		read_buffers_put(&read_buffers, buf.base);
+		return;
+	}
+
+	/* hand the read buffer itself to the write */
+	write_req_t *wr = write_req_pool_get(&write_req_pool);
+	if (wr == NULL) {
+		fprintf(stderr, "Error on allocating a write request.\n");
+		read_buffers_put(&read_buffers, buf.base);
+		return;
+	}
+	wr->buf = uv_buf_init(buf.base, nread);
+	wr->read_buffer = 1;
+	wr->ring_bytes = 0;
+#ifdef ECHO_TRACE
+	wr->stamps.read = wr->stamps.dequeue = uv_hrtime();
+#endif
+
+	if (uv_write(&wr->req, stream, &wr->buf, 1, write_req_cb)) {
+		fprintf(stderr, "Error on writing client stream: %s.\n",
+				uv_strerror(uv_last_error(loop)));
+		read_buffers_put(&read_buffers, buf.base);
+		write_req_pool_put(&write_req_pool, wr);
+		return;
+	}
+#ifdef ECHO_TRACE
+	wr->stamps.submit = uv_hrtime();
+#endif
+}
+
+/**
+ * Closes a subscriber that fell too far behind, with -D disconnect.
+ */
+void broadcast_disconnect(broadcast_sub_t *sub) {
+	conn_t *conn = (conn_t *) sub->data;
+
+	if (!uv_is_closing((uv_handle_t *) &conn->handle))
+		uv_close((uv_handle_t *) &conn->handle, close_cb);
+}
+
+void http_write_cb(uv_write_t *req, int status) {
+	loop_monitor_enter(&monitor, (uv_handle_t *) req->handle, "http_write_cb");
+	write_req_pool_put(&write_req_pool, (write_req_t *) req);
+	loop_monitor_leave(&monitor);
+}
+
+/**
+ * Writes a batch of responses, they point into http_responses.
+ */
+void http_write(uv_stream_t *stream, http_batch_t *batch) {
+	write_req_t *wr = write_req_pool_get(&write_req_pool);
+
+	if (wr == NULL) {
+		fprintf(stderr, "Error on allocating a write request.\n");
+		return;
+	}
+	if (uv_write(&wr->req, stream, batch->bufs, batch->nbufs, http_write_cb)) {
+		fprintf(stderr, "Error on writing client stream: %s.\n",
+				uv_strerror(uv_last_error(loop)));
+		write_req_pool_put(&write_req_pool, wr);
+	}
+}
+
+void http_shutdown_cb(uv_shutdown_t *req, int status) {
+	if (!uv_is_closing((uv_handle_t *) req->handle))
+		uv_close((uv_handle_t *) req->handle, close_cb);
+}
+
+/**
+ * Closes a connection once the responses queued on it are written.
+ */
+void http_shutdown(uv_stream_t *stream) {
+	conn_t *conn = (conn_t *) stream;
+
+	uv_read_stop(stream);
+	if (uv_shutdown(&conn->shutdown_req, stream, http_shutdown_cb))
+		uv_close((uv_handle_t *) stream, close_cb);
+}
+
+/**
+ * HTTP mode: answers every request completed by this read, all answers
+ * go out in one write. Requests after one that closes are ignored.
+ */
+void http_data(uv_stream_t *stream, ssize_t nread, uv_buf_t buf) {
+	conn_t *conn = (conn_t *) stream;
+	const char *data = buf.base;
+	size_t len = nread;
+	http_batch_t batch;
+	int r;
+
+	http_batch_init(&batch);
+	while (!batch.close && (r = http_parse(&conn->http, &data, &len)) != HTTP_NEED_MORE) {
+		const http_response_t *response = http_response_for(&http_responses, &conn->http, r);
+		if (http_batch_add(&batch, response)) {
+			http_write(stream, &batch);
+			http_batch_init(&batch);
+			http_batch_add(&batch, response);
+		}
+	}
+	read_buffers_put(&read_buffers, buf.base);
+
+	if (batch.nbufs > 0)
+		http_write(stream, &batch);
+	if (batch.close)
+		http_shutdown(stream);
+}
+
 /**
  * Callback which is executed on each readable state.
  */
 void read_cb(uv_stream_t * stream, ssize_t nread, uv_buf_t buf) {
+	loop_monitor_enter(&monitor, (uv_handle_t *) stream, "read_cb");
+	read_data(stream, nread, buf);
+	loop_monitor_leave(&monitor);
+}
+
+void read_data(uv_stream_t * stream, ssize_t nread, uv_buf_t buf) {
     /* if read bytes counter -1 there is an error or EOF */
     if (nread == -1) {
         if (uv_last_error(loop).code != UV_EOF) {
@@ -324,10 +804,46 @@ void read_cb(uv_stream_t * stream, ssize_t nread, uv_buf_t buf) {
                     uv_strerror(uv_last_error(loop)));
         }
 
-        uv_close((uv_handle_t *) stream, NULL);
+        if (capture_path != NULL)
+            traffic_capture_record(&capture, ((conn_t *) stream)->id, NULL, TRAFFIC_CLOSE);
+        /* the client may only have stopped sending, answer what it asked first */
+        if (mode == MODE_HTTP && uv_last_error(loop).code == UV_EOF)
+            http_shutdown(stream);
+        else
+            uv_close((uv_handle_t *) stream, close_cb);
+        if (!byte_ring_contains(&byte_ring, buf.base))
+            read_buffers_put(&read_buffers, buf.base);
+        return;
+    }
+
+    if (nread == 0) {
+        if (!byte_ring_contains(&byte_ring, buf.base))
+            read_buffers_put(&read_buffers, buf.base);
+        return;
     }
 
     assert(nread<=buf.len); // this should be impossible, uv should never return it
+    read_sizer_update(&((conn_t *) stream)->sizer, nread, buf.len);
+    if (capture_path != NULL)
+        traffic_capture_record(&capture, ((conn_t *) stream)->id, buf.base, nread);
+
+    if (mode == MODE_ECHO) {
+        echo_data(stream, nread, buf);
+        return;
+    }
+    if (mode == MODE_HTTP) {
+        http_data(stream, nread, buf);
+        return;
+    }
+    if (mode == MODE_BROADCAST) {
+        if (broadcast_publish(&broadcast, &((conn_t *) stream)->sub, buf.base, nread))
+            fprintf(stderr, "Error on publishing %zd bytes.\n", nread);
+        read_buffers_put(&read_buffers, buf.base);
+        return;
+    }
+#ifdef ECHO_TRACE
+    uint64_t read_at = uv_hrtime();
+#endif
 
 	printf("READ buffer: ");
     for (size_t i=0; i<nread; ++i) {
@@ -339,13 +855,32 @@ void read_cb(uv_stream_t * stream, ssize_t nread, uv_buf_t buf) {
     printf(" nread=%llu ", (unsigned long long)nread);
     printf(" len=%llu\n", (unsigned long long)buf.len);
 
+    if (byte_ring.base != NULL) {
+#ifdef ECHO_TRACE
+        if (!queue_byte_ring(stream, nread, buf))
+            echo_trace_queued(&trace, read_at);
+#else
+        queue_byte_ring(stream, nread, buf);
+#endif
+        return;
+    }
+
     uv_buf_t write_buf = uv_buf_init((char *) malloc(nread), nread);
 	write_buf.len = nread;
 	memset(write_buf.base, 0, write_buf.len);
 	memcpy(write_buf.base, buf.base, nread);
 
 	printf("push msg to circular buffer\n");
-	int error = buff_circular_push(&buff_circular, &write_buf);
+	int error = 1;
+	// once anything spilled, newer data has to queue behind it
+	if (spill_log_empty(&spill))
+		error = buff_circular_push(&buff_circular, &write_buf);
+	if (error)
+		error = spill_log_push(&spill, &write_buf);
+#ifdef ECHO_TRACE
+	if (!error)
+		echo_trace_queued(&trace, read_at);
+#endif
 	if (error) {
 		printf("circular buffer push error\n");
 		free(write_buf.base);
@@ -355,6 +890,14 @@ void read_cb(uv_stream_t * stream, ssize_t nread, uv_buf_t buf) {
 	printf("circular buffer size: %llu\n", (unsigned long long)buff_circular.size);
 	g_stream = stream;
 
+	// the disk is behind, stop reading until the spill log caught up
+	if (spill_log_full(&spill)) {
+		conn_t *conn = (conn_t *) stream;
+		uv_read_stop(stream);
+		conn->paused = 1;
+		QUEUE_INSERT_TAIL(&paused_conns, &conn->paused_queue);
+	}
+
 //	/* write sync the incoming buffer to the socket */
 //    uv_buf_t write_buf = uv_buf_init((char *) malloc(nread), nread);
 //	write_buf.len = nread;
@@ -371,24 +914,166 @@ void read_cb(uv_stream_t * stream, ssize_t nread, uv_buf_t buf) {
     /* free the remaining memory */
 	//uv_stop(loop);
 	free(write_buf.base);
-    free(buf.base);
+    read_buffers_put(&read_buffers, buf.base);
 //	free(write_buf.base);
 //	free(req);
 }
 
 /**
- * Allocates a buffer which we can use for reading.
+ * Allocates a buffer which we can use for reading, sized by what this
+ * connection read recently.
  */
 uv_buf_t alloc_buffer(uv_handle_t * handle, size_t size) {
-        return uv_buf_init((char *) malloc(size), size);
+	conn_t *conn = (conn_t *) handle;
+
+	if (adaptive_reads)
+		size = read_sizer_next(&conn->sizer, size);
+
+	/* ring mode with -b: read right behind the next record's length */
+	if (byte_ring.base != NULL && mode == MODE_RING
+			&& byte_ring_free(&byte_ring) > RING_HEADER) {
+		size_t room = byte_ring_free(&byte_ring) - RING_HEADER;
+		return uv_buf_init(byte_ring_write_ptr(&byte_ring) + RING_HEADER,
+				room < size ? room : size);
+	}
+	return read_buffers_get(&read_buffers, size);
+}
+
+/**
+ * Ring mode with -b: commits a read that landed in the byte ring. Reads
+ * that did not fit (the ring filled up between two connections' reads)
+ * are copied in if possible and dropped otherwise.
+ * @return 0 if queued
+ */
+int queue_byte_ring(uv_stream_t * stream, ssize_t nread, uv_buf_t buf) {
+	uint32_t len = nread;
+	int error = 0;
+
+	if (byte_ring_contains(&byte_ring, buf.base)) {
+		memcpy(buf.base - RING_HEADER, &len, RING_HEADER);
+		byte_ring_produce(&byte_ring, RING_HEADER + nread);
+	} else {
+		if (byte_ring_free(&byte_ring) >= RING_HEADER + nread) {
+			char *p = byte_ring_write_ptr(&byte_ring);
+			memcpy(p, &len, RING_HEADER);
+			memcpy(p + RING_HEADER, buf.base, nread);
+			byte_ring_produce(&byte_ring, RING_HEADER + nread);
+		} else {
+			ring_dropped++;
+			error = 1;
+		}
+		read_buffers_put(&read_buffers, buf.base);
+	}
+	g_stream = stream;
+
+	if (byte_ring_free(&byte_ring) < ring_low_water) {
+		conn_t *conn = (conn_t *) stream;
+		uv_read_stop(stream);
+		conn->paused = 1;
+		QUEUE_INSERT_TAIL(&paused_conns, &conn->paused_queue);
+	}
+	return error;
+}
+
+/**
+ * Ring mode with -b: writes the oldest unsent record straight from the
+ * ring, its space is consumed once the write finished.
+ */
+void write_byte_ring() {
+	uint32_t len;
+
+	if (g_stream == NULL || ring_sent == byte_ring.tail)
+		return;
+
+	// the record stays unsent, the next write_byte_ring retries it
+	write_req_t *req = write_req_pool_get(&write_req_pool);
+	if (req == NULL) {
+		fprintf(stderr, "Error on allocating a write request.\n");
+		return;
+	}
+
+	char *record = byte_ring.base + (ring_sent & (byte_ring.size - 1));
+	memcpy(&len, record, RING_HEADER);
+#ifdef ECHO_TRACE
+	uint64_t read_at = echo_trace_dequeued(&trace);
+#endif
+	ring_sent += RING_HEADER + len;
+
+	req->buf = uv_buf_init(record + RING_HEADER, len);
+	req->read_buffer = 0;
+	req->ring_bytes = RING_HEADER + len;
+	req->ring_done = 0;
+	QUEUE_INSERT_TAIL(&ring_writes, &req->ring_queue);
+
+	if (req->buf.base[0] == 'z' && ring_sent == byte_ring.tail) {
+		printf("end loop\n");
+		req->ring_done = 1;
+		release_ring_writes();
+		uv_stop(loop);
+		return;
+	}
+	printf("write_buf.len: %llu\n", (unsigned long long)len);
+#ifdef ECHO_TRACE
+	req->stamps.read = read_at;
+	req->stamps.dequeue = uv_hrtime();
+#endif
+	if (uv_write(&req->req, g_stream, &req->buf, 1, write_req_cb)) {
+		fprintf(stderr, "Error on writing client stream: %s.\n",
+				uv_strerror(uv_last_error(loop)));
+		req->ring_done = 1;
+		release_ring_writes();
+		return;
+	}
+#ifdef ECHO_TRACE
+	req->stamps.submit = uv_hrtime();
+#endif
 }
 
-void write_cb(uv_write_t *req, int status) {
-	free(req);
+/**
+ * Restarts reading on connections paused while the spill log was full.
+ */
+void resume_paused_cb(spill_log_t *spill) {
+	while (!QUEUE_EMPTY(&paused_conns)) {
+		QUEUE *q = QUEUE_HEAD(&paused_conns);
+		conn_t *conn = QUEUE_DATA(q, conn_t, paused_queue);
+
+		QUEUE_REMOVE(q);
+		conn->paused = 0;
+		if (!uv_is_closing((uv_handle_t *) &conn->handle))
+			uv_read_start((uv_stream_t *) &conn->handle, alloc_buffer, read_cb);
+	}
+}
+
+/**
+ * Moves spilled buffers back into the ring while it has room.
+ */
+void refill_ring() {
+	while (buff_circular.size < buff_circular.max_size) {
+		uv_buf_t buf;
+		buf.base = NULL;
+		buf.len = 0;
+		if (spill_log_pop(&spill, &buf))
+			break; // nothing spilled, or still on its way back from disk
+		buff_circular_push(&buff_circular, &buf);
+	}
 }
 
 void timer_cb(uv_timer_t* handle) {
+	loop_monitor_enter(&monitor, (uv_handle_t *) handle, "timer_cb");
+	write_ring(handle);
+	loop_monitor_leave(&monitor);
+}
+
+/**
+ * Ring mode: echo the oldest queued message, once per gc_req tick.
+ */
+void write_ring(uv_timer_t* handle) {
 	printf("timer_cb\n");
+	if (byte_ring.base != NULL) {
+		write_byte_ring();
+		return;
+	}
+	refill_ring();
 	if (g_stream == NULL) {
 		return;
 	}
@@ -400,23 +1085,41 @@ void timer_cb(uv_timer_t* handle) {
 	write_buf.base = NULL;
 	write_buf.len = 0;
 	buff_circular_pop(&buff_circular, &write_buf);
-	if (write_buf.base[0] == 'z' && buff_circular.size == 0) {
+#ifdef ECHO_TRACE
+	uint64_t read_at = echo_trace_dequeued(&trace);
+#endif
+	if (write_buf.base[0] == 'z' && buff_circular.size == 0 && spill_log_empty(&spill)) {
 		printf("end loop\n");
 		free(write_buf.base);
 		uv_stop(loop);
 		return;
 	}
 	printf("write_buf.len: %llu\n", (unsigned long long)write_buf.len);
-    /* dynamically allocate memory for a new write task */
-    uv_write_t * req = (uv_write_t *) malloc(sizeof(uv_write_t));
-    int r = uv_write(req, g_stream, &write_buf, 1, write_cb);
+    /* dynamically allocate memory for a new write task, the buffer is
+     * freed with it once the write finished */
+    write_req_t * req = write_req_pool_get(&write_req_pool);
+    if (req == NULL) {
+        fprintf(stderr, "Error on allocating a write request.\n");
+        free(write_buf.base);
+        return;
+    }
+    req->buf = write_buf;
+    req->read_buffer = 0;
+    req->ring_bytes = 0;
+#ifdef ECHO_TRACE
+    req->stamps.read = read_at;
+    req->stamps.dequeue = uv_hrtime();
+#endif
+    int r = uv_write(&req->req, g_stream, &req->buf, 1, write_req_cb);
 
     if (r) {
         fprintf(stderr, "Error on writing client stream: %s.\n",
                 uv_strerror(uv_last_error(loop)));
+        free(write_buf.base);
+        write_req_pool_put(&write_req_pool, req);
+        return;
     }
-
-    /* free the remaining memory */
-	free(write_buf.base);
-	//free(req);
+#ifdef ECHO_TRACE
+    req->stamps.submit = uv_hrtime();
+#endif
 }
\ No newline at end of file
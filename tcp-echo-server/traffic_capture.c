@@ -0,0 +1,57 @@
+#include "traffic_capture.h"
+#include <string.h>
+
+static void writer_closed_cb(fs_writer_t *writer) {
+	traffic_capture_t *capture = (traffic_capture_t *) writer->data;
+
+	capture->bytes = writer->bytes;
+	capture->close_cb(capture);
+}
+
+int traffic_capture_open(uv_loop_t *loop, traffic_capture_t *capture,
+		const char *path, size_t buffer_size) {
+	traffic_header_t header;
+
+	memset(capture, 0, sizeof(*capture));
+	if (buffer_size < sizeof(header)
+			|| fs_writer_open(loop, &capture->writer, path, buffer_size))
+		return -1;
+	capture->writer.data = capture;
+
+	/* the header goes out with the first records */
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRAFFIC_MAGIC, sizeof(header.magic));
+	header.record_size = sizeof(traffic_record_t);
+	memcpy(fs_writer_reserve(&capture->writer, sizeof(header)), &header, sizeof(header));
+	capture->start = uv_hrtime();
+	return 0;
+}
+
+void traffic_capture_record(traffic_capture_t *capture, uint32_t conn,
+		const char *data, uint32_t len) {
+	size_t payload = len == TRAFFIC_OPEN || len == TRAFFIC_CLOSE ? 0 : len;
+	traffic_record_t record;
+
+	if (capture->writer.failed || capture->close_cb != NULL)
+		return;
+	char *out = fs_writer_reserve(&capture->writer, sizeof(record) + payload);
+	if (out == NULL) {
+		capture->dropped++;
+		return;
+	}
+
+	record.time = uv_hrtime() - capture->start;
+	record.conn = conn;
+	record.len = len;
+	memcpy(out, &record, sizeof(record));
+	if (payload)
+		memcpy(out + sizeof(record), data, payload);
+	capture->records++;
+
+	fs_writer_flush(&capture->writer);
+}
+
+void traffic_capture_close(traffic_capture_t *capture, traffic_capture_close_cb close_cb) {
+	capture->close_cb = close_cb;
+	fs_writer_close(&capture->writer, writer_closed_cb);
+}
@@ -0,0 +1,77 @@
+#ifndef TRAFFIC_CAPTURE_H
+#define TRAFFIC_CAPTURE_H
+
+#include <uv.h>
+#include "fs_writer.h"
+
+/**
+ * Records what clients send to the server, for replay.c to send again.
+ *
+ * Records go through an fs_writer, so the loop never waits for the disk.
+ * If both of its buffers are full the record is dropped and counted
+ * instead, the capture never blocks the server and never grows without
+ * bound.
+ */
+
+/**
+ * File layout: one header, then records back to back, each a
+ * traffic_record_t followed by len payload bytes.
+ */
+#define TRAFFIC_MAGIC "ECHOCAP1"
+
+typedef struct {
+	char magic[8];
+	uint32_t record_size; // sizeof(traffic_record_t)
+	uint32_t reserved;
+} traffic_header_t;
+
+/**
+ * len values with no payload that mark a connection's start and end.
+ */
+#define TRAFFIC_OPEN 0xffffffffU
+#define TRAFFIC_CLOSE 0xfffffffeU
+
+typedef struct {
+	uint64_t time; // ns since the capture started
+	uint32_t conn; // connection id, unique within a capture
+	uint32_t len; // payload bytes, or TRAFFIC_OPEN / TRAFFIC_CLOSE
+} traffic_record_t;
+
+typedef struct traffic_capture_s traffic_capture_t;
+
+typedef void (*traffic_capture_close_cb)(traffic_capture_t *capture);
+
+struct traffic_capture_s {
+	void *data;
+	uint64_t records;
+	uint64_t bytes; // written to the file, set once closed
+	uint64_t dropped; // records that found both buffers full
+	// private
+	fs_writer_t writer;
+	uint64_t start;
+	traffic_capture_close_cb close_cb;
+};
+
+/**
+ * Creates (or truncates) path and writes the header. Blocks while opening.
+ * @param path Must stay valid until the capture is closed.
+ * @param buffer_size bytes per buffer, bounds the capture's memory
+ * @return 0 if success
+ */
+int traffic_capture_open(uv_loop_t *loop, traffic_capture_t *capture,
+		const char *path, size_t buffer_size);
+
+/**
+ * Appends a record, len is TRAFFIC_OPEN, TRAFFIC_CLOSE or the size of
+ * data. Never blocks, records that do not fit are dropped.
+ */
+void traffic_capture_record(traffic_capture_t *capture, uint32_t conn,
+		const char *data, uint32_t len);
+
+/**
+ * Writes what is buffered, closes the file and then calls close_cb.
+ * Records after this are ignored.
+ */
+void traffic_capture_close(traffic_capture_t *capture, traffic_capture_close_cb close_cb);
+
+#endif
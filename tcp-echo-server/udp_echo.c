@@ -0,0 +1,290 @@
+#define _GNU_SOURCE // recvmmsg, sendmmsg
+#include "udp_echo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/**
+ * UDP_ECHO_UV: a send back, slot i of the slab goes out with sends[i].
+ */
+typedef struct udp_echo_send_s {
+	uv_udp_send_t req;
+	udp_echo_t *echo;
+	int slot;
+	uv_buf_t buf;
+} udp_echo_send_t;
+
+#ifdef __linux__
+/**
+ * UDP_ECHO_MMSG: one recvmmsg worth of datagrams and the replies to it
+ * not sent yet.
+ */
+typedef struct udp_echo_batch_s {
+	struct mmsghdr msgs[UDP_ECHO_BATCH];
+	struct iovec iovs[UDP_ECHO_BATCH];
+	struct sockaddr_in addrs[UDP_ECHO_BATCH];
+	struct mmsghdr replies[UDP_ECHO_BATCH];
+	int reply_count;
+	int reply_sent;
+} udp_echo_batch_t;
+#endif
+
+int udp_echo_kind_by_name(const char *name, udp_echo_kind_t *kind) {
+	if (!strcmp(name, "uv"))
+		*kind = UDP_ECHO_UV;
+	else if (!strcmp(name, "mmsg"))
+		*kind = UDP_ECHO_MMSG;
+	else
+		return -1;
+	return 0;
+}
+
+static char *slot_base(udp_echo_t *echo, int slot) {
+	return echo->slab + (size_t) slot * UDP_ECHO_DATAGRAM_MAX;
+}
+
+/////////////////////////////////////////////////////////////////////
+// uv_udp_t, one datagram at a time
+
+static uv_buf_t slot_alloc_cb(uv_handle_t *handle, size_t suggested_size) {
+	udp_echo_t *echo = (udp_echo_t *) handle->data;
+
+	// out of slots: read into the spare one after the slab, then drop
+	int slot = echo->free_count > 0 ? echo->free_slots[--echo->free_count] : UDP_ECHO_SLOTS;
+	return uv_buf_init(slot_base(echo, slot), UDP_ECHO_DATAGRAM_MAX);
+}
+
+static void slot_release(udp_echo_t *echo, int slot) {
+	if (slot < UDP_ECHO_SLOTS)
+		echo->free_slots[echo->free_count++] = slot;
+}
+
+static void udp_send_cb(uv_udp_send_t *req, int status) {
+	udp_echo_send_t *send = (udp_echo_send_t *) req;
+	udp_echo_t *echo = send->echo;
+
+	if (status == 0) {
+		echo->datagrams++;
+		echo->bytes += send->buf.len;
+	} else {
+		echo->dropped++;
+	}
+	slot_release(echo, send->slot);
+}
+
+static void udp_recv_cb(uv_udp_t *handle, ssize_t nread, uv_buf_t buf,
+		struct sockaddr *addr, unsigned flags) {
+	udp_echo_t *echo = (udp_echo_t *) handle->data;
+	int slot = (int) ((buf.base - echo->slab) / UDP_ECHO_DATAGRAM_MAX);
+
+	// nread 0 without addr: nothing more to read
+	if (nread <= 0 || addr == NULL || (flags & UV_UDP_PARTIAL) || slot == UDP_ECHO_SLOTS) {
+		if (nread > 0)
+			echo->dropped++;
+		slot_release(echo, slot);
+		return;
+	}
+
+	echo->receives++;
+	udp_echo_send_t *send = &echo->sends[slot];
+	send->buf = uv_buf_init(buf.base, nread);
+	if (uv_udp_send(&send->req, handle, &send->buf, 1,
+			*(struct sockaddr_in *) addr, udp_send_cb)) {
+		echo->dropped++;
+		slot_release(echo, slot);
+	}
+}
+
+static int start_uv(udp_echo_t *echo, struct sockaddr_in addr) {
+	echo->free_slots = (int *) malloc(UDP_ECHO_SLOTS * sizeof(int));
+	echo->sends = (udp_echo_send_t *) malloc(UDP_ECHO_SLOTS * sizeof(udp_echo_send_t));
+	if (echo->free_slots == NULL || echo->sends == NULL)
+		return -1;
+	for (int i = 0; i < UDP_ECHO_SLOTS; ++i) {
+		echo->free_slots[i] = UDP_ECHO_SLOTS - 1 - i;
+		echo->sends[i].echo = echo;
+		echo->sends[i].slot = i;
+	}
+	echo->free_count = UDP_ECHO_SLOTS;
+
+	uv_udp_init(echo->loop, &echo->udp);
+	echo->udp.data = echo;
+	if (uv_udp_bind(&echo->udp, addr, 0))
+		return -1;
+	return uv_udp_recv_start(&echo->udp, slot_alloc_cb, udp_recv_cb);
+}
+
+/////////////////////////////////////////////////////////////////////
+// recvmmsg and sendmmsg
+
+#ifdef __linux__
+
+/**
+ * Sends the replies not sent yet.
+ * @return 0 if all went out, -1 if the socket buffer is full
+ */
+static int flush_replies(udp_echo_t *echo) {
+	udp_echo_batch_t *batch = echo->batch;
+
+	while (batch->reply_sent < batch->reply_count) {
+		struct mmsghdr *next = &batch->replies[batch->reply_sent];
+		int n = sendmmsg(echo->fd, next, batch->reply_count - batch->reply_sent, MSG_DONTWAIT);
+		if (n == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return -1;
+			// this one cannot be sent, go on with the rest
+			echo->dropped++;
+			batch->reply_sent++;
+			continue;
+		}
+		for (int i = 0; i < n; ++i)
+			echo->bytes += next[i].msg_hdr.msg_iov->iov_len;
+		echo->datagrams += n;
+		batch->reply_sent += n;
+	}
+	return 0;
+}
+
+/**
+ * Receives up to UDP_ECHO_BATCH datagrams and queues their replies.
+ * @return datagrams received, 0 if there were none
+ */
+static int receive_batch(udp_echo_t *echo) {
+	udp_echo_batch_t *batch = echo->batch;
+
+	for (int i = 0; i < UDP_ECHO_BATCH; ++i) {
+		struct msghdr *hdr = &batch->msgs[i].msg_hdr;
+		batch->iovs[i].iov_base = slot_base(echo, i);
+		batch->iovs[i].iov_len = UDP_ECHO_DATAGRAM_MAX;
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->msg_name = &batch->addrs[i];
+		hdr->msg_namelen = sizeof(batch->addrs[i]);
+		hdr->msg_iov = &batch->iovs[i];
+		hdr->msg_iovlen = 1;
+	}
+
+	int n = recvmmsg(echo->fd, batch->msgs, UDP_ECHO_BATCH, MSG_DONTWAIT, NULL);
+	if (n == -1) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			fprintf(stderr, "Error on receiving UDP datagrams: %s.\n", strerror(errno));
+		return 0;
+	}
+
+	echo->receives++;
+	batch->reply_count = 0;
+	batch->reply_sent = 0;
+	for (int i = 0; i < n; ++i) {
+		if (batch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			echo->dropped++;
+			continue;
+		}
+		// reply from the same slot to the same address
+		batch->iovs[i].iov_len = batch->msgs[i].msg_len;
+		batch->replies[batch->reply_count++].msg_hdr = batch->msgs[i].msg_hdr;
+	}
+	return n;
+}
+
+static void mmsg_poll_cb(uv_poll_t *handle, int status, int events) {
+	udp_echo_t *echo = (udp_echo_t *) handle->data;
+
+	if (status == -1) {
+		fprintf(stderr, "Error on polling the UDP socket: %s.\n",
+				uv_strerror(uv_last_error(echo->loop)));
+		return;
+	}
+
+	if (events & UV_WRITABLE) {
+		if (flush_replies(echo))
+			return;
+		uv_poll_start(handle, UV_READABLE, mmsg_poll_cb);
+		return;
+	}
+
+	// bounded, so a flood does not keep the loop from other work
+	for (int round = 0; round < UDP_ECHO_ROUNDS; ++round) {
+		int n = receive_batch(echo);
+		if (n == 0)
+			break;
+		if (flush_replies(echo)) {
+			// the slab is still in use, stop receiving until it went out
+			uv_poll_start(handle, UV_WRITABLE, mmsg_poll_cb);
+			return;
+		}
+		if (n < UDP_ECHO_BATCH)
+			break;
+	}
+}
+
+static int start_mmsg(udp_echo_t *echo, struct sockaddr_in addr) {
+	echo->batch = (udp_echo_batch_t *) calloc(1, sizeof(udp_echo_batch_t));
+	if (echo->batch == NULL)
+		return -1;
+
+	echo->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (echo->fd == -1)
+		return -1;
+	if (fcntl(echo->fd, F_SETFL, fcntl(echo->fd, F_GETFL) | O_NONBLOCK) == -1
+			|| bind(echo->fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Error on binding the UDP socket: %s.\n", strerror(errno));
+		return -1;
+	}
+
+	uv_poll_init(echo->loop, &echo->poll, echo->fd);
+	echo->poll.data = echo;
+	return uv_poll_start(&echo->poll, UV_READABLE, mmsg_poll_cb);
+}
+
+#else
+
+static int start_mmsg(udp_echo_t *echo, struct sockaddr_in addr) {
+	fprintf(stderr, "recvmmsg and sendmmsg are Linux only, use -U uv.\n");
+	return -1;
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// common
+
+int udp_echo_start(udp_echo_t *echo, uv_loop_t *loop, udp_echo_kind_t kind,
+		struct sockaddr_in addr) {
+	memset(echo, 0, sizeof(*echo));
+	echo->kind = kind;
+	echo->loop = loop;
+	echo->fd = -1;
+
+	// one spare slot at the end for datagrams that are dropped
+	size_t slots = kind == UDP_ECHO_UV ? UDP_ECHO_SLOTS + 1 : UDP_ECHO_BATCH;
+	echo->slab = (char *) malloc(slots * UDP_ECHO_DATAGRAM_MAX);
+	if (echo->slab == NULL)
+		return -1;
+
+	return kind == UDP_ECHO_UV ? start_uv(echo, addr) : start_mmsg(echo, addr);
+}
+
+void udp_echo_print(const udp_echo_t *echo, FILE *out) {
+	fprintf(out, "udp echo (%s): datagrams %llu, bytes %llu, %.1f datagrams per receive, "
+			"dropped %llu\n", echo->kind == UDP_ECHO_UV ? "uv" : "mmsg",
+			(unsigned long long) echo->datagrams, (unsigned long long) echo->bytes,
+			echo->receives ? (double) echo->datagrams / echo->receives : 0.0,
+			(unsigned long long) echo->dropped);
+}
+
+void udp_echo_destroy(udp_echo_t *echo) {
+	if (echo->fd != -1)
+		close(echo->fd);
+	free(echo->slab);
+	free(echo->free_slots);
+	free(echo->sends);
+	free(echo->batch);
+	echo->slab = NULL;
+	echo->free_slots = NULL;
+	echo->sends = NULL;
+	echo->batch = NULL;
+	echo->fd = -1;
+}
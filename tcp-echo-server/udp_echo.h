@@ -0,0 +1,71 @@
+#ifndef UDP_ECHO_H
+#define UDP_ECHO_H
+
+#include <uv.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * UDP echo for tcp_echo_server -U, every datagram is sent back to where
+ * it came from. Datagrams are received into a slab of fixed size slots
+ * allocated at start, larger ones are truncated by the kernel and
+ * dropped.
+ *
+ *   UDP_ECHO_UV    uv_udp_t, one datagram per callback and per send
+ *   UDP_ECHO_MMSG  own socket watched by uv_poll_t, up to UDP_ECHO_BATCH
+ *                  datagrams per recvmmsg and answered by one sendmmsg,
+ *                  Linux only
+ */
+
+#define UDP_ECHO_DATAGRAM_MAX 2048 // slot size
+#define UDP_ECHO_SLOTS 1024 // UDP_ECHO_UV: datagrams being sent back
+#define UDP_ECHO_BATCH 64 // UDP_ECHO_MMSG: datagrams per system call
+#define UDP_ECHO_ROUNDS 16 // UDP_ECHO_MMSG: batches per readable event
+
+typedef enum {
+	UDP_ECHO_UV,
+	UDP_ECHO_MMSG
+} udp_echo_kind_t;
+
+typedef struct udp_echo_s udp_echo_t;
+
+struct udp_echo_s {
+	udp_echo_kind_t kind;
+	uint64_t datagrams; // sent back
+	uint64_t bytes;
+	uint64_t receives; // callbacks or recvmmsg calls that got datagrams
+	uint64_t dropped; // no free slot, truncated, or the send failed
+	// private
+	uv_loop_t *loop;
+	uv_udp_t udp;
+	uv_poll_t poll;
+	int fd;
+	char *slab;
+	int *free_slots; // UDP_ECHO_UV: stack of slot indexes
+	int free_count;
+	struct udp_echo_send_s *sends; // UDP_ECHO_UV: one per slot
+	struct udp_echo_batch_s *batch; // UDP_ECHO_MMSG
+};
+
+/**
+ * Looks up a kind by name ("uv", "mmsg").
+ * @return 0 if success
+ */
+int udp_echo_kind_by_name(const char *name, udp_echo_kind_t *kind);
+
+/**
+ * Binds addr and starts echoing.
+ * @param echo Must be allocated in caller.
+ * @return 0 if success
+ */
+int udp_echo_start(udp_echo_t *echo, uv_loop_t *loop, udp_echo_kind_t kind,
+		struct sockaddr_in addr);
+
+void udp_echo_print(const udp_echo_t *echo, FILE *out);
+
+/**
+ * Frees the slab, call it after the loop stopped.
+ */
+void udp_echo_destroy(udp_echo_t *echo);
+
+#endif
@@ -0,0 +1,199 @@
+/**
+ * Load generator for tcp_echo_server -U.
+ *
+ * Opens a number of connected UDP sockets, keeps depth datagrams in
+ * flight on each and counts the echoed ones. Datagrams go out with
+ * sendmmsg and come back with recvmmsg, so the generator is not what
+ * limits the rate. A socket that got nothing back for a tick counts what
+ * it has in flight as lost and sends depth new datagrams.
+ *
+ * Linux only.
+ */
+#define _GNU_SOURCE // recvmmsg, sendmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <uv.h>
+
+#define BATCH 64 // datagrams per system call
+#define MAX_SIZE 2048 // the server drops larger datagrams
+#define TICK_MS 100
+
+typedef struct {
+	uv_poll_t poll;
+	int fd;
+	int inflight; // sent and not echoed yet
+	uint64_t received; // since the last tick
+} client_t;
+
+uv_loop_t *loop;
+uv_timer_t stop_timer;
+uv_timer_t tick_timer;
+client_t *clients;
+char payload[MAX_SIZE];
+char receive_slab[BATCH][MAX_SIZE]; // shared, the contents are not looked at
+
+const char *host = "127.0.0.1";
+int port = 3000;
+int sockets = 4;
+size_t msg_size = 64;
+int depth = 64;
+int seconds = 5;
+
+uint64_t datagrams = 0;
+uint64_t bytes = 0;
+uint64_t lost = 0;
+uint64_t start_time;
+int stopping = 0;
+
+/**
+ * Sends up to n datagrams, fewer if the socket buffer fills up.
+ */
+void send_datagrams(client_t *client, int n) {
+	struct mmsghdr msgs[BATCH];
+	struct iovec iov = { payload, msg_size };
+
+	memset(msgs, 0, sizeof(msgs));
+	for (int i = 0; i < BATCH; ++i) {
+		msgs[i].msg_hdr.msg_iov = &iov;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	while (n > 0) {
+		int sent = sendmmsg(client->fd, msgs, n < BATCH ? n : BATCH, MSG_DONTWAIT);
+		if (sent == -1) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED)
+				fprintf(stderr, "send error: %s\n", strerror(errno));
+			return;
+		}
+		client->inflight += sent;
+		n -= sent;
+	}
+}
+
+void poll_cb(uv_poll_t *handle, int status, int events) {
+	client_t *client = (client_t *) handle->data;
+	struct mmsghdr msgs[BATCH];
+	struct iovec iovs[BATCH];
+
+	memset(msgs, 0, sizeof(msgs));
+	for (int i = 0; i < BATCH; ++i) {
+		iovs[i].iov_base = receive_slab[i];
+		iovs[i].iov_len = MAX_SIZE;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	for (;;) {
+		int n = recvmmsg(client->fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+		if (n == -1) {
+			// ECONNREFUSED: the server is not up (yet), the tick retries
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED)
+				fprintf(stderr, "receive error: %s\n", strerror(errno));
+			return;
+		}
+		for (int i = 0; i < n; ++i)
+			bytes += msgs[i].msg_len;
+		datagrams += n;
+		client->received += n;
+		client->inflight -= n;
+		if (client->inflight < 0)
+			client->inflight = 0; // a late echo of one counted as lost
+		if (!stopping)
+			send_datagrams(client, n);
+		if (n < BATCH)
+			return;
+	}
+}
+
+/**
+ * Refills sockets that got nothing back since the last tick.
+ */
+void tick_cb(uv_timer_t *handle, int status) {
+	for (int i = 0; i < sockets; ++i) {
+		client_t *client = &clients[i];
+		if (client->received == 0) {
+			lost += client->inflight;
+			client->inflight = 0;
+			send_datagrams(client, depth);
+		}
+		client->received = 0;
+	}
+}
+
+void stop_cb(uv_timer_t *handle, int status) {
+	double elapsed = (uv_hrtime() - start_time) / 1e9;
+
+	stopping = 1;
+	printf("udp sockets=%d size=%zu depth=%d seconds=%.2f "
+			"datagrams/s=%.0f MB/s=%.2f lost=%llu\n",
+			sockets, msg_size, depth, elapsed,
+			datagrams / elapsed, bytes / elapsed / (1024 * 1024),
+			(unsigned long long) lost);
+
+	for (int i = 0; i < sockets; ++i)
+		uv_close((uv_handle_t *) &clients[i].poll, NULL);
+	uv_close((uv_handle_t *) &tick_timer, NULL);
+	uv_close((uv_handle_t *) &stop_timer, NULL);
+}
+
+void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-h host] [-p port] [-c sockets] "
+			"[-s datagram size] [-d depth] [-t seconds]\n"
+			"  -s  at most %d bytes\n", name, MAX_SIZE);
+}
+
+int main(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "h:p:c:s:d:t:")) != -1) {
+		switch (opt) {
+			case 'h': host = optarg; break;
+			case 'p': port = atoi(optarg); break;
+			case 'c': sockets = atoi(optarg); break;
+			case 's': msg_size = strtoul(optarg, NULL, 10); break;
+			case 'd': depth = atoi(optarg); break;
+			case 't': seconds = atoi(optarg); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (sockets < 1 || msg_size < 1 || msg_size > MAX_SIZE || depth < 1 || seconds < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	loop = uv_default_loop();
+	for (size_t i = 0; i < msg_size; ++i)
+		payload[i] = 'a' + i % 26;
+
+	struct sockaddr_in addr = uv_ip4_addr(host, port);
+	clients = (client_t *) calloc(sockets, sizeof(client_t));
+	for (int i = 0; i < sockets; ++i) {
+		client_t *client = &clients[i];
+		client->fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (client->fd == -1
+				|| fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) | O_NONBLOCK) == -1
+				|| connect(client->fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+			fprintf(stderr, "socket error: %s\n", strerror(errno));
+			return 1;
+		}
+		uv_poll_init(loop, &client->poll, client->fd);
+		client->poll.data = client;
+		uv_poll_start(&client->poll, UV_READABLE, poll_cb);
+		send_datagrams(client, depth);
+	}
+
+	uv_timer_init(loop, &stop_timer);
+	uv_timer_start(&stop_timer, stop_cb, seconds * 1000, 0);
+	uv_timer_init(loop, &tick_timer);
+	uv_timer_start(&tick_timer, tick_cb, TICK_MS, TICK_MS);
+	start_time = uv_hrtime();
+
+	uv_run(loop, UV_RUN_DEFAULT);
+	for (int i = 0; i < sockets; ++i)
+		close(clients[i].fd);
+	free(clients);
+	return 0;
+}
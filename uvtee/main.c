@@ -4,13 +4,33 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stddef.h>
+#include "../internal/pool.h"
 
-/* create a write_request type which contains a buffer and a write request */
+/* size of one read buffer, what libuv suggests for reads */
+#define TEE_BUFFER_SIZE (64 * 1024)
+
+/* a read buffer shared by the writes to stdout and to the file */
+typedef struct {
+    int refs;
+    char base[TEE_BUFFER_SIZE];
+} tee_buffer_t;
+
+/* create a write_request type which contains a write request and a buffer,
+ * the request comes first so a uv_write_t * can be cast back */
 typedef struct {
-    uv_buf_t buffer;
     uv_write_t request;
+    uv_buf_t buffer;
+    tee_buffer_t *data;
 } write_req_t;
 
+/* buffers and write requests are recycled instead of malloc'd per chunk */
+POOL_DEFINE(tee_buffer_pool, tee_buffer_t)
+POOL_DEFINE(write_req_pool, write_req_t)
+
+tee_buffer_pool_t buffer_pool;
+write_req_pool_t write_req_pool;
+
 /* define shared variables */
 uv_loop_t *loop; /* ? why double use ? */
 uv_pipe_t file_pipe;
@@ -31,7 +51,11 @@ int main(int argc, char ** argv) {
     /* contians the file request */
     uv_fs_t file_request;
     /* contains pointer to default loop */
-    uv_loop_t* loop = uv_default_loop();
+    loop = uv_default_loop();
+
+    /* a few reads in flight, each written twice */
+    tee_buffer_pool_init(&buffer_pool, 4, 4);
+    write_req_pool_init(&write_req_pool, 8, 8);
 
     /* where does stdin_pipe come from ? */
 
@@ -60,12 +84,32 @@ int main(int argc, char ** argv) {
     /* start the loop */
     uv_run(loop, UV_RUN_DEFAULT);
 
+    tee_buffer_pool_destroy(&buffer_pool);
+    write_req_pool_destroy(&write_req_pool);
+
     return 0;
 }
 
 /* returns a buffer instance for storing incoming stdin lines */
 uv_buf_t alloc_buffer(uv_handle_t *handle, size_t size) {
-    return uv_buf_init((char *) malloc(size), size);
+    tee_buffer_t *data = tee_buffer_pool_get(&buffer_pool);
+    /* an empty buffer makes the read fail with UV_ENOBUFS */
+    if (data == NULL)
+        return uv_buf_init(NULL, 0);
+    /* the read holds the first reference */
+    data->refs = 1;
+    return uv_buf_init(data->base, sizeof(data->base));
+}
+
+/* drops one reference, the last one returns the buffer to the pool */
+void release_buffer(tee_buffer_t *data) {
+    if (--data->refs == 0)
+        tee_buffer_pool_put(&buffer_pool, data);
+}
+
+/* finds the pooled buffer of a base pointer from alloc_buffer */
+tee_buffer_t *buffer_of(char *base) {
+    return (tee_buffer_t *) (base - offsetof(tee_buffer_t, base));
 }
 
 /* is executed as callback on each incoming stdinput */
@@ -89,22 +133,28 @@ void read_stdin(uv_stream_t *stream, ssize_t nread, uv_buf_t buffer) {
         }
     }
 
-    /* free the buffer */
+    /* drop the reference of the read, the writes hold their own */
     if (buffer.base)
-        free(buffer.base);
+        release_buffer(buffer_of(buffer.base));
 
 }
 
 /* writes the data to some streams */
 void write_data(uv_stream_t *stream, size_t size, uv_buf_t buffer, uv_write_cb callback) {
-    /* create a write request struct */
-    write_req_t *request = (write_req_t*) malloc(sizeof(write_req_t));
-    /* initialize new buffer for write request */
-    request->buffer = uv_buf_init((char*) malloc(size), size);
-    /* copy whole passed buffer to write request (why?) */
-    memcpy(request->buffer.base, buffer.base, size);
+    /* take a write request struct from the pool */
+    write_req_t *request = write_req_pool_get(&write_req_pool);
+    if (request == NULL) {
+        fprintf(stderr, "Error on allocating a write request.\n");
+        return;
+    }
+    /* share the read buffer instead of copying it, it stays alive until
+     * the last write holding a reference finished */
+    request->data = buffer_of(buffer.base);
+    request->data->refs++;
+    request->buffer = uv_buf_init(buffer.base, size);
     /* use uv_write to write something to streams */
-    uv_write((uv_write_t*) request, (uv_stream_t*) stream, &request->buffer, 1, callback);
+    if (uv_write(&request->request, (uv_stream_t*) stream, &request->buffer, 1, callback))
+        free_write_request(&request->request);
 }
 
 /* frees file write request */
@@ -119,9 +169,9 @@ void on_stdout_write(uv_write_t *request, int status) {
 
 /* implementation of freeing algorithm */
 void free_write_request(uv_write_t *request) {
-    /* create a pointer to a pointer ?? WHY? */
+    /* the request is the first member, so this is the write_req_t */
     write_req_t *write_request = (write_req_t*) request;
-    /* free structs */
-    free(write_request->buffer.base);
-    free(write_request);
+    /* give both back */
+    release_buffer(write_request->data);
+    write_req_pool_put(&write_req_pool, write_request);
 }